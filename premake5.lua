@@ -78,6 +78,24 @@ project("PackoTool")
 	filter({})
 
 
+project("PackoBench")
+
+	kind("ConsoleApp")
+	CommonFlags()
+
+	includedirs({"src/"})
+	externalincludedirs({ "libs/", "src/libs" })
+
+	-- common files
+	files({"src/core/**", "src/libs/ghc/*.hpp", "src/libs/json/*.hpp", "src/libs/stb_image/*.h", "src/libs/tinyexr/*.h", "src/libs/glm/*/*.cpp", "src/libs/glm/*/*.hpp", "src/libs/glm/*/*.c", "src/bench/**", "premake5.lua"})
+
+	removefiles({"**.DS_STORE", "**.thumbs"})
+
+	filter("system:linux")
+		links({"pthread"})
+	filter({})
+
+
 project("Packo")
 	
 	kind("WindowedApp")
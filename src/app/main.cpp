@@ -154,21 +154,13 @@ bool loadGraph(std::unique_ptr<Graph>& graph, ErrorContext& errorContext){
 	// Immediately clean up the path.
 	free(rawPath);
 
-	std::ifstream file(path);
-	if(!file.is_open()){
+	// The encoding is detected when loading.
+	json data;
+	if(!Graph::load(path, data)){
 		errorContext.addError("Unable to load graph from file at path \"" + path + "\"");
 		return false;
 	}
 
-	json data = json::parse(file, nullptr, false);
-	// Done with the file.
-	file.close();
-	// Invalid JSON.
-	if(data.is_discarded()){
-		errorContext.addError("Unable to parse graph from file at path \"" + path + "\"");
-		return false;
-	}
-
 	// Issue: numbered inputs/outputs are created before the freelist indices are reset...
 	// So we have to destroy the current graph first.
 	// In case of rollback, use a serialized copy of the old graph and hope for the best.
@@ -211,14 +203,9 @@ void saveGraph(std::unique_ptr<Graph>& graph, ErrorContext& errorContext){
 		path += ".packgraph";
 	}
 
-	std::ofstream file(path);
-	if(!file.is_open()){
+	if(!Graph::save(path, data, Graph::Encoding::JSON)){
 		errorContext.addError("Unable to create file at path \"" + path + "\"");
-		return;
 	}
-
-	file << std::setw(4) << data << "\n";
-	file.close();
 }
 
 /// Input/output files
@@ -229,7 +216,7 @@ struct InputFile {
 };
 
 bool refreshFiles(const fs::path& dir, std::vector<InputFile>& paths){
-	static const std::vector<std::string> validExts = {"png", "bmp", "tga", "jpeg", "exr"};
+	static const std::vector<std::string> validExts = {"png", "bmp", "tga", "jpeg", "exr", "raw"};
 	if(!fs::exists(dir)){
 		paths.clear();
 		return false;
@@ -878,7 +865,12 @@ bool refreshPreviews(const std::unique_ptr<Graph>& graph, const std::vector<Inpu
 	}
 
 	SharedContext sharedContext;
-	allocateContextForBatch(batch, compiledGraph, customResolution, Image::Filter::NEAREST, forceCustomResolution, sharedContext, previewRes);
+	EvaluationSettings settings;
+	settings.outputRes = customResolution;
+	settings.filterOutputRes = Image::Filter::NEAREST;
+	settings.forceOutputRes = forceCustomResolution;
+	settings.precise = true;
+	allocateContextForBatch(batch, compiledGraph, settings, sharedContext, previewRes);
 	for(const CompiledNode& node : compiledGraph.nodes){
 		evaluateGraphStepForBatch(node, compiledGraph.stackSize, sharedContext);
 
@@ -901,7 +893,7 @@ bool refreshPreviews(const std::unique_ptr<Graph>& graph, const std::vector<Inpu
 				const uint srcChannel = reg % 4u;
 				for(uint y = 0; y < outputImg.h(); ++y){
 					for(uint x = 0; x < outputImg.w(); ++x){
-						outputImg.pixel(x,y)[c] = img.pixel(x,y)[srcChannel];
+						outputImg.pixel(x,y)[c] = img.channel(x, y, srcChannel);
 					}
 				}
 			}
@@ -988,6 +980,7 @@ int main(int argc, char** argv){
 
 	// GUI state
 	std::atomic<int> showProgress = -1;
+	EvaluationReport lastReport;
 	std::string searchStr;
 	std::vector<NodeClass> visibleNodeTypes;
 	std::unordered_map<NodeClass, uint> nodesPasteboard;
@@ -996,8 +989,7 @@ int main(int argc, char** argv){
 	std::unordered_map<const Node*, GLuint> texturesToPurge;
 	DeferredNodeToCreate nodeRequestFromLink;
 	ImVec2 mouseRightClick( 0.f, 0.f );
-	glm::ivec2 customResolution = {64, 64};
-	Image::Filter filterCustomResolution = Image::Filter::SMOOTH;
+	EvaluationSettings runSettings;
 	float inputsWindowWidth = (std::min)(300.0f, 0.25f * float(winW));
 	float previewScale = 1.0f;
 	int selectedNodeType = 0;
@@ -1008,7 +1000,6 @@ int main(int argc, char** argv){
 	bool needsPreviewRefresh = true;
 	bool needAutoLayout = true;
 	bool anyPopupOpen = false;
-	bool forceCustomResolution = false;
 
 	while(!glfwWindowShouldClose(window)) {
 
@@ -1082,6 +1073,8 @@ int main(int argc, char** argv){
 						if(ImGui::MenuItem("Preview alpha grid", "", &showAlphaPreview)){
 							needsPreviewRefresh = true;
 						}
+						ImGui::MenuItem("Full precision storage", "", &runSettings.precise);
+						ImGui::MenuItem("Legacy random generators", "", &runSettings.legacyRandom);
 						ImGui::PushItemWidth(130);
 						if(ImGui::Combo("Preview quality", &previewQuality, "High\0Medium\0Low\0")){
 							needsPreviewRefresh = true;
@@ -1093,7 +1086,9 @@ int main(int argc, char** argv){
 						}
 						if(ImGui::InputInt("Random seed", &seed)){
 							Random::seed(seed);
+							needsPreviewRefresh = true;
 						}
+						ImGui::SliderInt("PNG compression", &runSettings.compressionLevel, 0, 9);
 						ImGui::PopItemWidth();
 						ImGui::EndMenu();
 					}
@@ -1123,7 +1118,7 @@ int main(int argc, char** argv){
 					
 					if(ImGui::MenuItem( "Run graph" )){
 						const std::vector<fs::path> inputPaths = filterInputFiles(inputFiles);
-						evaluateInBackground(*graph, errorContext, inputPaths, outputDirectory, customResolution, filterCustomResolution, forceCustomResolution, showProgress);
+						evaluateInBackground(*graph, errorContext, inputPaths, outputDirectory, runSettings, showProgress, lastReport);
 					}
 
 					ImGui::Separator();
@@ -1170,7 +1165,7 @@ int main(int argc, char** argv){
 
 				if(ImGui::Button("Run")){
 					const std::vector<fs::path> inputPaths = filterInputFiles(inputFiles);
-					evaluateInBackground(*graph, errorContext, inputPaths, outputDirectory, customResolution, filterCustomResolution, forceCustomResolution, showProgress);
+					evaluateInBackground(*graph, errorContext, inputPaths, outputDirectory, runSettings, showProgress, lastReport);
 				}
 
 				ImGui::SameLine(inputsWindowWidth - 30.f);
@@ -1181,6 +1176,21 @@ int main(int argc, char** argv){
 
 				if(showProgress >= 0){
 					ImGui::ProgressBar(float(showProgress) / float(kProgressCostGranularity));
+				} else if(lastReport.success){
+					ImGui::TextDisabled("Last run: %.0fms, %.1f Mpix/s", lastReport.totalMs, lastReport.throughput());
+					if(ImGui::IsItemHovered()){
+						double decodeMs = 0.0, computeMs = 0.0, encodeMs = 0.0;
+						for(const BatchReport& batch : lastReport.batches){
+							decodeMs += batch.decodeMs;
+							computeMs += batch.computeMs;
+							encodeMs += batch.encodeMs;
+						}
+						ImGui::SetTooltip("Batches: %u\nDecode: %.0fms\nCompute: %.0fms\nEncode: %.0fms\nPixels: %zu\nTmp images: %.1fMB\nPeak memory: %.1fMB\nNodes: %u (%u before optimization)\nRegisters: %u (%u before optimization)",
+										  uint(lastReport.batches.size()), decodeMs, computeMs, encodeMs, lastReport.pixelCount,
+										  double(lastReport.tmpImageBytes) / (1024.0 * 1024.0), double(lastReport.peakMemory) / (1024.0 * 1024.0),
+										  lastReport.optimizedGraph.nodeCount, lastReport.unoptimizedGraph.nodeCount,
+										  lastReport.optimizedGraph.stackSize, lastReport.unoptimizedGraph.stackSize);
+					}
 				}
 				ImGui::Separator();
 
@@ -1196,13 +1206,13 @@ int main(int argc, char** argv){
 				const std::string outputDirStr = outputDirectory.u8string();
 				ImGui::TextWrapped( "%s", outputDirStr.c_str() );
 
-				editedInputList |= ImGui::Checkbox("Custom resolution", &forceCustomResolution);
-				if(forceCustomResolution){
-					if(ImGui::InputInt2("##res", &customResolution[0])){
-						customResolution = glm::max(customResolution, {4, 4});
+				editedInputList |= ImGui::Checkbox("Custom resolution", &runSettings.forceOutputRes);
+				if(runSettings.forceOutputRes){
+					if(ImGui::InputInt2("##res", &runSettings.outputRes[0])){
+						runSettings.outputRes = glm::max(runSettings.outputRes, {4, 4});
 						editedInputList = true;
 					}
-					if(ImGui::Combo("Filter", (int*)&filterCustomResolution, "Nearest\0Smooth\0")){
+					if(ImGui::Combo("Filter", (int*)&runSettings.filterOutputRes, "Nearest\0Smooth\0Box\0Bilinear\0Mitchell\0Lanczos\0")){
 						editedInputList = true;
 					}
 				}
@@ -1430,7 +1440,7 @@ int main(int argc, char** argv){
 		if(needsPreviewRefresh && showPreview){
 			// Defer purge by one frame because ImGui is keeping a reference to it for the current frame (partial evaluation?).
 			texturesToPurge = textures;
-			if(!refreshPreviews(graph, inputFiles, customResolution, forceCustomResolution, previewQuality, showAlphaPreview, textures)){
+			if(!refreshPreviews(graph, inputFiles, runSettings.outputRes, runSettings.forceOutputRes, previewQuality, showAlphaPreview, textures)){
 				// This failed, don't purge.
 				// TODO: when errors or unused nodes, do something to give feedback to the user.
 				textures = texturesToPurge;
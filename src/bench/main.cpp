@@ -0,0 +1,814 @@
+#include "core/Common.hpp"
+#include "core/Graph.hpp"
+#include "core/Evaluator.hpp"
+#include "core/Random.hpp"
+#include "core/nodes/Nodes.hpp"
+
+#include "core/system/Config.hpp"
+#include "core/system/System.hpp"
+#include "core/system/TextUtilities.hpp"
+
+#include <json/json.hpp>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+class BenchConfig : public Config {
+public:
+
+	explicit BenchConfig(const std::vector<std::string> & argv) : Config(argv) {
+
+		for(const auto & arg : arguments()) {
+			if(arg.key == "resolutions" && !arg.values.empty()){
+				resolutions.clear();
+				for(const std::string& value : arg.values){
+					resolutions.push_back(std::stoi(value));
+				}
+			}
+			if(arg.key == "threads" && !arg.values.empty()){
+				threads.clear();
+				for(const std::string& value : arg.values){
+					threads.push_back(uint(std::stoi(value)));
+				}
+			}
+			if(arg.key == "workloads" && !arg.values.empty()){
+				workloads = arg.values;
+			}
+			if(arg.key == "repeat" && !arg.values.empty()){
+				repeat = uint(std::max(1, std::stoi(arg.values[0])));
+			}
+			if((arg.key == "out" || arg.key == "o") && !arg.values.empty()){
+				outputPath = arg.values[0];
+			}
+			if(arg.key == "baseline" && !arg.values.empty()){
+				baselinePath = arg.values[0];
+			}
+			if(arg.key == "threshold" && !arg.values.empty()){
+				threshold = std::stof(arg.values[0]);
+			}
+			if(arg.key == "scratch" && !arg.values.empty()){
+				scratchDir = arg.values[0];
+			}
+			if(arg.key == "nodes"){
+				nodes = true;
+			}
+			if(arg.key == "node-size" && !arg.values.empty()){
+				nodeSize = std::max(1, std::stoi(arg.values[0]));
+			}
+			if(arg.key == "sort" && !arg.values.empty()){
+				sortKey = TextUtilities::lowercase(arg.values[0]);
+			}
+			if(arg.key == "graphs"){
+				graphs = true;
+			}
+			if(arg.key == "graph-size" && !arg.values.empty()){
+				graphSize = uint(std::max(3, std::stoi(arg.values[0])));
+			}
+			if(arg.key == "batches" && !arg.values.empty()){
+				batchCount = uint(std::max(1, std::stoi(arg.values[0])));
+			}
+			if(arg.key == "tiled"){
+				tileSize = arg.values.empty() ? EvaluationSettings::kDefaultTileSize : uint(std::max(1, std::stoi(arg.values[0])));
+			}
+		}
+
+		std::sort(threads.begin(), threads.end());
+		threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+
+		registerSection("Workloads");
+		registerArgument("workloads", "", "Workloads to run, among arithmetic_chain, fan_out, global_stack and channel_packing (default: all).", "names");
+		registerArgument("resolutions", "", "Square image sizes to evaluate at (default: 256 1024 2048).", "sizes");
+		registerArgument("threads", "", "Thread counts to evaluate with (default: 1 and all cores but one).", "counts");
+		registerArgument("repeat", "", "Number of runs for each configuration, the fastest is kept (default: 3).", "count");
+		registerArgument("batches", "", "Number of batches of each workload, small batches are evaluated together (default: 1).", "count");
+		registerArgument("scratch", "", "Directory for generated inputs and outputs (default: temporary directory).", "path");
+		registerArgument("tiled", "", "Evaluate the workloads tile by tile, after checking that the results are bit-identical to the default evaluation.", "tile size");
+
+		registerSection("Nodes");
+		registerArgument("nodes", "", "Benchmark each node type individually instead of the workloads.");
+		registerArgument("node-size", "", "Square image size for node benchmarks (default: 256).", "size");
+		registerArgument("sort", "", "Sort the node table by name, evaluate or prepare (default: evaluate).", "key");
+
+		registerSection("Graphs");
+		registerArgument("graphs", "", "Validate, compile and load in each encoding very large chain, diamond and cyclic graphs instead of the workloads, and check the results.");
+		registerArgument("graph-size", "", "Approximate node count of each large graph (default: 100000).", "count");
+
+		registerSection("Results");
+		registerArgument("out", "o", "Write the JSON results to a file instead of the standard output.", "path");
+		registerArgument("baseline", "", "Compare against previous JSON results and fail on regressions.", "path");
+		registerArgument("threshold", "", "Allowed throughput regression against the baseline, in percent (default: 10).", "percent");
+	}
+
+	std::vector<int> resolutions{256, 1024, 2048};
+	std::vector<uint> threads{1u, System::threadCount()};
+	std::vector<std::string> workloads;
+	uint repeat{3u};
+	uint batchCount{1u};
+	uint tileSize{0u};
+	fs::path outputPath;
+	fs::path baselinePath;
+	fs::path scratchDir;
+	float threshold{10.f};
+	bool nodes{false};
+	int nodeSize{256};
+	std::string sortKey{"evaluate"};
+	bool graphs{false};
+	uint graphSize{100000u};
+};
+
+// Helper to build synthetic graphs.
+class GraphBuilder {
+public:
+
+	explicit GraphBuilder(Graph& graph) : _editor(graph) {}
+
+	uint add(NodeClass type, uint channels = 1u){
+		Node* node = createNode(type);
+		if(node->channeled()){
+			node->setChannelCount(channels);
+		}
+		_lastNode = node;
+		return _editor.addNode(node);
+	}
+
+	uint constant(float value, uint channels){
+		const uint id = add(NodeClass::CONST_FLOAT, channels);
+		_lastNode->attributes()[0].flt = value;
+		return id;
+	}
+
+	void link(uint from, uint fromSlot, uint to, uint toSlot){
+		_editor.addLink(from, fromSlot, to, toSlot);
+	}
+
+	// Connect count consecutive slots.
+	void link(uint from, uint fromSlot, uint to, uint toSlot, uint count){
+		for(uint i = 0u; i < count; ++i){
+			link(from, fromSlot + i, to, toSlot + i);
+		}
+	}
+
+	Node* lastNode(){ return _lastNode; }
+
+private:
+	GraphEditor _editor;
+	Node* _lastNode{nullptr};
+};
+
+struct Workload {
+	std::string name;
+	uint inputCount;
+	std::function<void(GraphBuilder&)> build;
+};
+
+// Long sequence of point-wise operations.
+void buildArithmeticChain(GraphBuilder& builder){
+	const uint kChainLength = 64u;
+	const uint gradient = builder.add(NodeClass::GRADIENT);
+	uint previous = gradient;
+	for(uint i = 0u; i < kChainLength; ++i){
+		uint node = 0u;
+		if(i % 4u == 3u){
+			node = builder.add(NodeClass::SINE, 4u);
+			builder.link(previous, 0u, node, 0u, 4u);
+		} else {
+			node = builder.add(i % 2u == 0u ? NodeClass::PRODUCT : NodeClass::ADD, 4u);
+			const uint constant = builder.constant(i % 2u == 0u ? 0.99f : 0.01f, 4u);
+			builder.link(previous, 0u, node, 0u, 4u);
+			builder.link(constant, 0u, node, 4u, 4u);
+		}
+		previous = node;
+	}
+	const uint output = builder.add(NodeClass::OUTPUT_IMG);
+	builder.link(previous, 0u, output, 0u, 4u);
+}
+
+// Many independent branches from a single source, that are all alive before being summed.
+void buildFanOut(GraphBuilder& builder){
+	const uint kBranchCount = 32u;
+	const uint gradient = builder.add(NodeClass::GRADIENT);
+	std::vector<uint> branches;
+	for(uint i = 0u; i < kBranchCount; ++i){
+		const uint product = builder.add(NodeClass::PRODUCT, 4u);
+		const uint constant = builder.constant(float(i + 1u), 4u);
+		builder.link(gradient, 0u, product, 0u, 4u);
+		builder.link(constant, 0u, product, 4u, 4u);
+		const uint sine = builder.add(NodeClass::SINE, 4u);
+		builder.link(product, 0u, sine, 0u, 4u);
+		branches.push_back(sine);
+	}
+	uint sum = branches[0];
+	for(uint i = 1u; i < kBranchCount; ++i){
+		const uint add = builder.add(NodeClass::ADD, 4u);
+		builder.link(sum, 0u, add, 0u, 4u);
+		builder.link(branches[i], 0u, add, 4u, 4u);
+		sum = add;
+	}
+	const uint output = builder.add(NodeClass::OUTPUT_IMG);
+	builder.link(sum, 0u, output, 0u, 4u);
+}
+
+// Successive global nodes, each requiring a full flush.
+void buildGlobalStack(GraphBuilder& builder){
+	const uint gradient = builder.add(NodeClass::GRADIENT);
+	const uint blur = builder.add(NodeClass::GAUSSIAN_BLUR, 4u);
+	builder.lastNode()->attributes()[0].flt = 8.f;
+	builder.link(gradient, 0u, blur, 0u, 4u);
+	const uint median = builder.add(NodeClass::MEDIAN_FILTER);
+	builder.lastNode()->attributes()[0].flt = 2.f;
+	builder.link(blur, 0u, median, 0u);
+	builder.link(blur, 1u, median, 1u);
+	const uint greater = builder.add(NodeClass::GREATER);
+	const uint threshold = builder.constant(0.5f, 1u);
+	builder.link(median, 0u, greater, 0u);
+	builder.link(threshold, 0u, greater, 1u);
+	const uint flood = builder.add(NodeClass::FLOOD_FILL);
+	builder.link(greater, 0u, flood, 0u);
+	const uint output = builder.add(NodeClass::OUTPUT_IMG);
+	builder.link(flood, 0u, output, 0u);
+	builder.link(flood, 1u, output, 1u);
+	builder.link(blur, 2u, output, 2u);
+	builder.link(median, 0u, output, 3u);
+}
+
+// Gather channels from several inputs.
+void buildChannelPacking(GraphBuilder& builder){
+	const uint output = builder.add(NodeClass::OUTPUT_IMG);
+	for(uint i = 0u; i < 4u; ++i){
+		const uint input = builder.add(NodeClass::INPUT_IMG);
+		builder.link(input, i, output, i);
+	}
+}
+
+const std::vector<Workload>& allWorkloads(){
+	static const std::vector<Workload> workloads = {
+		{"arithmetic_chain", 0u, buildArithmeticChain},
+		{"fan_out", 0u, buildFanOut},
+		{"global_stack", 0u, buildGlobalStack},
+		{"channel_packing", 4u, buildChannelPacking},
+	};
+	return workloads;
+}
+
+// Generate distinct input images at a given resolution.
+std::vector<fs::path> generateInputs(const fs::path& dir, uint count, int resolution){
+	std::vector<fs::path> paths;
+	for(uint i = 0u; i < count; ++i){
+		const fs::path path = dir / ("input_" + std::to_string(resolution) + "_" + std::to_string(i) + ".png");
+		if(!fs::exists(path)){
+			const uint size = uint(resolution);
+			Image image(size, size, Image::Storage::UNORM8);
+			for(int y = 0; y < resolution; ++y){
+				for(int x = 0; x < resolution; ++x){
+					const float u = float(x) / float(resolution);
+					const float v = float(y) / float(resolution);
+					image.setColor(x, y, glm::fract(glm::vec4(u, v, u * v, u + v) * float(i + 1u)));
+				}
+			}
+			image.save(path, Image::Format::PNG);
+		}
+		paths.push_back(path);
+	}
+	return paths;
+}
+
+double elapsedMs(const std::chrono::steady_clock::time_point& start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Measure {
+	double compile{0.0};
+	double allocate{0.0};
+	double evaluate{0.0};
+	double save{0.0};
+	double total{0.0};
+};
+
+bool runOnce(const Graph& graph, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const EvaluationSettings& settings, Measure& measure){
+	// Stages are measured separately on the full-image path.
+	ErrorContext errors;
+	CompiledGraph compiledGraph;
+	auto start = std::chrono::steady_clock::now();
+	if(!compile(graph, true, errors, compiledGraph)){
+		return false;
+	}
+	measure.compile = elapsedMs(start);
+
+	std::vector<Batch> batches;
+	if(!generateBatches(compiledGraph.inputs, compiledGraph.outputs, inputPaths, outputDir, batches)){
+		return false;
+	}
+	for(const Batch& batch : batches){
+		SharedContext sharedContext;
+		start = std::chrono::steady_clock::now();
+		allocateContextForBatch(batch, compiledGraph, settings, sharedContext);
+		measure.allocate += elapsedMs(start);
+		start = std::chrono::steady_clock::now();
+		if(settings.tileSize != 0u){
+			evaluateGraphForBatchTiled(compiledGraph, sharedContext, settings.tileSize, settings.memoryBudget);
+		} else {
+			evaluateGraphForBatchOptimized(compiledGraph, sharedContext);
+		}
+		measure.evaluate += elapsedMs(start);
+		start = std::chrono::steady_clock::now();
+		saveContextForBatch(batch, sharedContext, settings);
+		measure.save += elapsedMs(start);
+	}
+	compiledGraph.clearInternalNodes();
+
+	// End-to-end run, as performed by the tool.
+	start = std::chrono::steady_clock::now();
+	if(!evaluate(graph, errors, inputPaths, outputDir, settings)){
+		return false;
+	}
+	measure.total = elapsedMs(start);
+	return true;
+}
+
+// Evaluate a graph with the segment and tiled evaluations, and check that all outputs are bit-identical.
+bool compareTiledEvaluation(const Graph& graph, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const EvaluationSettings& settings){
+	ErrorContext errors;
+	CompiledGraph compiledGraph;
+	if(!compile(graph, true, errors, compiledGraph)){
+		return false;
+	}
+	std::vector<Batch> batches;
+	if(!generateBatches(compiledGraph.inputs, compiledGraph.outputs, inputPaths, outputDir, batches)){
+		return false;
+	}
+	EvaluationSettings segmentSettings = settings;
+	segmentSettings.tileSize = 0u;
+	size_t differences = 0u;
+	for(const Batch& batch : batches){
+		SharedContext reference;
+		allocateContextForBatch(batch, compiledGraph, segmentSettings, reference);
+		evaluateGraphForBatchOptimized(compiledGraph, reference);
+		SharedContext tiled;
+		allocateContextForBatch(batch, compiledGraph, settings, tiled);
+		evaluateGraphForBatchTiled(compiledGraph, tiled, settings.tileSize, settings.memoryBudget);
+
+		for(size_t i = 0u; i < reference.outputImages.size(); ++i){
+			const Image& expected = reference.outputImages[i];
+			const Image& result = tiled.outputImages[i];
+			for(uint y = 0u; y < expected.h(); ++y){
+				for(uint x = 0u; x < expected.w(); ++x){
+					for(uint c = 0u; c < 4u; ++c){
+						differences += glm::floatBitsToUint(expected.channel(x, y, c)) != glm::floatBitsToUint(result.channel(x, y, c)) ? 1u : 0u;
+					}
+				}
+			}
+		}
+	}
+	compiledGraph.clearInternalNodes();
+	if(differences != 0u){
+		Log::Error() << differences << " output values differ between the segment and tiled evaluations." << std::endl;
+	}
+	return differences == 0u;
+}
+
+struct NodeMeasure {
+	std::string name;
+	uint channels;
+	double evaluateNs;
+	double prepareMs;
+};
+
+// Repeat evaluation at each pixel to amortize the context creation.
+const uint kEvaluationsPerPixel = 8u;
+
+// Evaluate a single node on a synthetic context, with inputs and outputs in consecutive registers.
+NodeMeasure benchmarkNode(const Node& node, const std::string& name, int size, uint repeat){
+	const uint inputCount = uint(node.inputs().size());
+	const uint outputCount = uint(node.outputs().size());
+	const uint stackSize = std::max(inputCount + outputCount, 1u);
+	CompiledNode compiledNode{ &node, {}, {} };
+	for(uint i = 0u; i < inputCount; ++i){
+		compiledNode.inputs.push_back(int(i));
+	}
+	for(uint i = 0u; i < outputCount; ++i){
+		compiledNode.outputs.push_back(int(inputCount + i));
+	}
+
+	const uint w = uint(size);
+	const uint h = uint(size);
+	SharedContext sharedContext;
+	sharedContext.dims = {size, size};
+	sharedContext.scale = {1.f, 1.f};
+	// Synthetic content for nodes reading images.
+	auto addImage = [w, h](std::vector<Image>& images){
+		Image& image = images.emplace_back(w, h, Image::Storage::FLOAT32);
+		for(uint y = 0u; y < h; ++y){
+			for(uint x = 0u; x < w; ++x){
+				image.setColor(int(x), int(y), Random::Color());
+			}
+		}
+	};
+	uint inputImageCount = 1u;
+	if(const InputNode* input = dynamic_cast<const InputNode*>(&node)){
+		inputImageCount = input->index() + 1u;
+	}
+	uint outputImageCount = 1u;
+	if(const OutputNode* output = dynamic_cast<const OutputNode*>(&node)){
+		outputImageCount = output->index() + 1u;
+	}
+	for(uint i = 0u; i < inputImageCount; ++i){
+		addImage(sharedContext.inputImages);
+	}
+	for(uint i = 0u; i < outputImageCount; ++i){
+		sharedContext.outputImages.emplace_back(w, h, Image::Storage::FLOAT32);
+	}
+	for(uint i = 0u; i < (stackSize + 3u) / 4u; ++i){
+		addImage(sharedContext.tmpImagesRead);
+		sharedContext.tmpImagesWrite.emplace_back(w, h, Image::Storage::FLOAT32);
+	}
+	sharedContext.tmpImagesGlobal.emplace_back(w, h, Image::Storage::FLOAT32);
+
+	NodeMeasure measure{ name, node.channelCount(), 0.0, 0.0 };
+	if(node.global()){
+		measure.prepareMs = std::numeric_limits<double>::max();
+		for(uint r = 0u; r < repeat; ++r){
+			const auto start = std::chrono::steady_clock::now();
+			node.prepare(sharedContext, compiledNode.inputs, Region::full(sharedContext.dims));
+			measure.prepareMs = std::min(measure.prepareMs, elapsedMs(start));
+		}
+	}
+
+	// Measure the cost of the context setup alone, to subtract it.
+	auto runPixels = [&sharedContext, &compiledNode, w, h, stackSize, inputCount](uint evaluations){
+		for(uint y = 0u; y < h; ++y){
+			for(uint x = 0u; x < w; ++x){
+				LocalContext context(&sharedContext, {x, y}, stackSize);
+				for(uint i = 0u; i < inputCount; ++i){
+					context.stack[i] = sharedContext.tmpImagesRead[i / 4u].channel(x, y, i % 4u);
+				}
+				for(uint e = 0u; e < evaluations; ++e){
+					compiledNode.node->evaluate(context, compiledNode.inputs, compiledNode.outputs);
+				}
+			}
+		}
+	};
+	double setupMs = std::numeric_limits<double>::max();
+	double totalMs = std::numeric_limits<double>::max();
+	for(uint r = 0u; r < repeat; ++r){
+		auto start = std::chrono::steady_clock::now();
+		runPixels(0u);
+		setupMs = std::min(setupMs, elapsedMs(start));
+		start = std::chrono::steady_clock::now();
+		runPixels(kEvaluationsPerPixel);
+		totalMs = std::min(totalMs, elapsedMs(start));
+	}
+	const double evaluateMs = std::max(totalMs - setupMs, 0.0);
+	measure.evaluateNs = evaluateMs * 1e6 / (double(w) * double(h) * double(kEvaluationsPerPixel));
+	return measure;
+}
+
+// Benchmark each exposed node type, at each channel count it supports.
+std::vector<NodeMeasure> benchmarkNodes(int size, uint repeat){
+	std::vector<NodeMeasure> measures;
+	for(uint type = 0u; type < NodeClass::COUNT_EXPOSED; ++type){
+		Node* node = createNode(NodeClass(type));
+		const uint maxChannels = node->channeled() ? 4u : 1u;
+		for(uint channels = 1u; channels <= maxChannels; ++channels){
+			node->setChannelCount(channels);
+			measures.push_back(benchmarkNode(*node, getNodeName(NodeClass(type)), size, repeat));
+		}
+		delete node;
+	}
+	return measures;
+}
+
+void printNodeTable(std::vector<NodeMeasure> measures, const std::string& sortKey){
+	if(sortKey == "name"){
+		std::stable_sort(measures.begin(), measures.end(), [](const NodeMeasure& a, const NodeMeasure& b){ return a.name < b.name; });
+	} else if(sortKey == "prepare"){
+		std::stable_sort(measures.begin(), measures.end(), [](const NodeMeasure& a, const NodeMeasure& b){ return a.prepareMs > b.prepareMs; });
+	} else {
+		std::stable_sort(measures.begin(), measures.end(), [](const NodeMeasure& a, const NodeMeasure& b){ return a.evaluateNs > b.evaluateNs; });
+	}
+	Log::Info() << std::left << std::setw(24) << "Node" << std::right << std::setw(10) << "Channels" << std::setw(18) << "Evaluate (ns/px)" << std::setw(16) << "Prepare (ms)" << std::endl;
+	for(const NodeMeasure& measure : measures){
+		Log::Info() << std::left << std::setw(24) << measure.name << std::right << std::setw(10) << measure.channels
+			<< std::setw(18) << std::fixed << std::setprecision(2) << measure.evaluateNs << std::setw(16) << measure.prepareMs << std::endl;
+	}
+}
+
+// Long sequence of nodes, each depending on the previous one.
+// If looping, the first node of the chain also depends on the last one.
+void buildLargeChain(GraphBuilder& builder, uint nodeCount, bool loop){
+	const uint constant = builder.constant(0.001f, 1u);
+	const uint first = builder.add(NodeClass::ADD);
+	builder.link(constant, 0u, first, 1u);
+	uint previous = first;
+	for(uint i = 1u; i < nodeCount; ++i){
+		const uint node = builder.add(NodeClass::ADD);
+		builder.link(previous, 0u, node, 0u);
+		builder.link(constant, 0u, node, 1u);
+		previous = node;
+	}
+	builder.link(loop ? previous : constant, 0u, first, 0u);
+	const uint output = builder.add(NodeClass::OUTPUT_IMG);
+	for(uint i = 0u; i < 4u; ++i){
+		builder.link(previous, 0u, output, i);
+	}
+}
+
+// Sequence of diamonds, each splitting in two branches that are merged back.
+void buildLargeDiamonds(GraphBuilder& builder, uint nodeCount){
+	uint previous = builder.constant(0.5f, 1u);
+	for(uint i = 0u; i < nodeCount / 3u; ++i){
+		const uint sine = builder.add(NodeClass::SINE);
+		const uint cosine = builder.add(NodeClass::COSINE);
+		const uint add = builder.add(NodeClass::ADD);
+		builder.link(previous, 0u, sine, 0u);
+		builder.link(previous, 0u, cosine, 0u);
+		builder.link(sine, 0u, add, 0u);
+		builder.link(cosine, 0u, add, 1u);
+		previous = add;
+	}
+	const uint output = builder.add(NodeClass::OUTPUT_IMG);
+	for(uint i = 0u; i < 4u; ++i){
+		builder.link(previous, 0u, output, i);
+	}
+}
+
+struct EncodingMeasure {
+	std::string name;
+	size_t bytes{0u};
+	double loadMs{0.0};
+};
+
+struct GraphMeasure {
+	std::string name;
+	uint nodeCount{0u};
+	double buildMs{0.0};
+	double validateMs{0.0};
+	double compileMs{0.0};
+	std::vector<EncodingMeasure> encodings;
+	bool success{false};
+};
+
+// Save a graph in each encoding, and measure the time to load it back.
+bool measureLoading(Graph& graph, const fs::path& dir, std::vector<EncodingMeasure>& measures){
+	static const std::vector<std::pair<std::string, Graph::Encoding>> encodings = {
+		{"json", Graph::Encoding::JSON}, {"cbor", Graph::Encoding::CBOR}, {"msgpack", Graph::Encoding::MESSAGEPACK},
+	};
+	json data;
+	graph.serialize(data);
+	const uint linkCount = graph.getLinkCount();
+
+	for(const auto& encoding : encodings){
+		const fs::path path = dir / ("graph." + encoding.first);
+		if(!Graph::save(path, data, encoding.second)){
+			return false;
+		}
+		EncodingMeasure& measure = measures.emplace_back();
+		measure.name = encoding.first;
+		measure.bytes = fs::file_size(path);
+
+		const auto start = std::chrono::steady_clock::now();
+		json loadedData;
+		Graph loadedGraph;
+		if(!Graph::load(path, loadedData) || !loadedGraph.deserialize(loadedData)){
+			return false;
+		}
+		measure.loadMs = elapsedMs(start);
+		if(loadedGraph.getLinkCount() != linkCount){
+			return false;
+		}
+	}
+	return true;
+}
+
+// Validate and compile a large graph, checking that cycles are reported for all their nodes.
+GraphMeasure stressGraph(const std::string& name, const std::function<void(GraphBuilder&)>& build, uint cycleNodeCount, const fs::path& dir){
+	GraphMeasure measure;
+	measure.name = name;
+	Graph graph;
+	auto start = std::chrono::steady_clock::now();
+	{
+		GraphBuilder builder(graph);
+		build(builder);
+	}
+	measure.buildMs = elapsedMs(start);
+	GraphNodes nodes(graph);
+	measure.nodeCount = uint(std::distance(nodes.begin(), nodes.end()));
+
+	ErrorContext errors;
+	start = std::chrono::steady_clock::now();
+	const bool valid = validate(graph, errors);
+	measure.validateMs = elapsedMs(start);
+
+	if(cycleNodeCount != 0u){
+		measure.success = !valid && errors.errorCount() == cycleNodeCount;
+		if(!measure.success){
+			Log::Error() << name << ": expected " << cycleNodeCount << " nodes in a cycle, got " << errors.errorCount() << " errors." << std::endl;
+		}
+		return measure;
+	}
+
+	CompiledGraph compiledGraph;
+	start = std::chrono::steady_clock::now();
+	const bool compiled = compile(graph, true, errors, compiledGraph);
+	measure.compileMs = elapsedMs(start);
+	// Uniform nodes are moved out of the per-pixel nodes, that also contain internal nodes.
+	size_t compiledNodeCount = compiledGraph.uniforms.size();
+	for(const CompiledNode& compiledNode : compiledGraph.nodes){
+		compiledNodeCount += compiledNode.node->type() < NodeClass::COUNT_EXPOSED ? 1u : 0u;
+	}
+	measure.success = valid && compiled && !errors.hasErrors() && compiledNodeCount == measure.nodeCount;
+	if(!measure.success){
+		Log::Error() << name << ": unable to compile the graph. " << errors.summarizeErrors() << std::endl;
+	}
+	compiledGraph.clearInternalNodes();
+
+	if(!measureLoading(graph, dir, measure.encodings)){
+		Log::Error() << name << ": unable to save and load the graph." << std::endl;
+		measure.success = false;
+	}
+	return measure;
+}
+
+std::vector<GraphMeasure> stressGraphs(uint nodeCount, const fs::path& dir){
+	std::vector<GraphMeasure> measures;
+	measures.push_back(stressGraph("chain", [nodeCount](GraphBuilder& builder){
+		buildLargeChain(builder, nodeCount, false);
+	}, 0u, dir));
+	measures.push_back(stressGraph("diamonds", [nodeCount](GraphBuilder& builder){
+		buildLargeDiamonds(builder, nodeCount);
+	}, 0u, dir));
+	measures.push_back(stressGraph("cycle", [nodeCount](GraphBuilder& builder){
+		buildLargeChain(builder, nodeCount, true);
+	}, nodeCount, dir));
+	return measures;
+}
+
+// Compare throughputs against a previous run, returns the number of regressions.
+uint compareToBaseline(const json& results, const json& baseline, float threshold){
+	uint regressions = 0u;
+	for(const json& entry : results["results"]){
+		for(const json& reference : baseline["results"]){
+			if(reference["workload"] != entry["workload"] || reference["resolution"] != entry["resolution"] || reference["threads"] != entry["threads"] || reference.value("batches", 1u) != entry.value("batches", 1u)){
+				continue;
+			}
+			const double current = entry["mpixelsPerSecond"];
+			const double previous = reference["mpixelsPerSecond"];
+			const double change = previous > 0.0 ? 100.0 * (current - previous) / previous : 0.0;
+			const bool regressed = change < -double(threshold);
+			(regressed ? Log::Error() : Log::Info()) << entry["workload"].get<std::string>() << " at " << entry["resolution"].get<int>() << "px with " << entry["threads"].get<uint>() << " threads: "
+				<< previous << " -> " << current << " Mpix/s (" << (change >= 0.0 ? "+" : "") << change << "%)" << std::endl;
+			regressions += regressed ? 1u : 0u;
+		}
+	}
+	return regressions;
+}
+
+int main(int argc, char** argv){
+
+	BenchConfig config(std::vector<std::string>(argv, argv+argc));
+	if(config.showHelp(false)){
+		return 0;
+	}
+
+	Random::seed(743936);
+
+	fs::path scratchDir = config.scratchDir;
+	if(scratchDir.empty()){
+		scratchDir = fs::temp_directory_path() / "packo_bench";
+	}
+	const fs::path inputDir = scratchDir / "inputs";
+	const fs::path outputDir = scratchDir / "outputs";
+	fs::create_directories(inputDir);
+	fs::create_directories(outputDir);
+
+	json results;
+	results["date"] = System::timestamp();
+	results["hardwareThreads"] = std::thread::hardware_concurrency();
+	results["results"] = json::array();
+
+	if(config.nodes){
+		// Nodes are evaluated on a single thread.
+		System::setThreadCount(1u);
+		const std::vector<NodeMeasure> measures = benchmarkNodes(config.nodeSize, config.repeat);
+		System::setThreadCount(0u);
+		printNodeTable(measures, config.sortKey);
+
+		results["nodeSize"] = config.nodeSize;
+		results["nodes"] = json::array();
+		for(const NodeMeasure& measure : measures){
+			json& entry = results["nodes"].emplace_back();
+			entry["node"] = measure.name;
+			entry["channels"] = measure.channels;
+			entry["evaluateNsPerPixel"] = measure.evaluateNs;
+			entry["prepareMs"] = measure.prepareMs;
+		}
+		if(!config.outputPath.empty() && !System::writeStringToFile(results.dump(4), config.outputPath)){
+			return 1;
+		}
+		return 0;
+	}
+
+	if(config.graphs){
+		const std::vector<GraphMeasure> measures = stressGraphs(config.graphSize, outputDir);
+		bool success = true;
+		results["graphs"] = json::array();
+		for(const GraphMeasure& measure : measures){
+			json& entry = results["graphs"].emplace_back();
+			entry["graph"] = measure.name;
+			entry["nodeCount"] = measure.nodeCount;
+			entry["stagesMs"] = { {"build", measure.buildMs}, {"validate", measure.validateMs}, {"compile", measure.compileMs} };
+			for(const EncodingMeasure& encoding : measure.encodings){
+				entry["load"][encoding.name] = { {"bytes", encoding.bytes}, {"ms", encoding.loadMs} };
+			}
+			entry["success"] = measure.success;
+			success = success && measure.success;
+		}
+		const std::string resultsStr = results.dump(4);
+		if(config.outputPath.empty()){
+			std::cout << resultsStr << std::endl;
+		} else if(!System::writeStringToFile(resultsStr, config.outputPath)){
+			return 1;
+		}
+		return success ? 0 : 1;
+	}
+
+	for(const Workload& workload : allWorkloads()){
+		if(!config.workloads.empty() && std::find(config.workloads.begin(), config.workloads.end(), workload.name) == config.workloads.end()){
+			continue;
+		}
+		Graph graph;
+		{
+			GraphBuilder builder(graph);
+			workload.build(builder);
+		}
+		for(int resolution : config.resolutions){
+			// Graphs without inputs are evaluated once per path.
+			const uint pathCount = config.batchCount == 1u ? workload.inputCount : std::max(workload.inputCount, 1u) * config.batchCount;
+			const std::vector<fs::path> inputPaths = generateInputs(inputDir, pathCount, resolution);
+			EvaluationSettings settings;
+			settings.outputRes = {resolution, resolution};
+			settings.forceOutputRes = true;
+			settings.tileSize = config.tileSize;
+			if(settings.tileSize != 0u && !compareTiledEvaluation(graph, inputPaths, outputDir, settings)){
+				Log::Error() << "Tiled evaluation of workload " << workload.name << " is not bit-identical." << std::endl;
+				return 1;
+			}
+
+			for(uint threads : config.threads){
+				System::setThreadCount(threads);
+				Measure best;
+				best.total = std::numeric_limits<double>::max();
+				bool success = true;
+				for(uint r = 0u; r < config.repeat; ++r){
+					Measure measure;
+					if(!runOnce(graph, inputPaths, outputDir, settings, measure)){
+						success = false;
+						break;
+					}
+					if(measure.total < best.total){
+						best = measure;
+					}
+				}
+				if(!success){
+					Log::Error() << "Unable to evaluate workload " << workload.name << "." << std::endl;
+					return 1;
+				}
+				const double pixelCount = double(resolution) * double(resolution) * double(config.batchCount);
+				json& entry = results["results"].emplace_back();
+				entry["workload"] = workload.name;
+				entry["resolution"] = resolution;
+				entry["threads"] = threads;
+				entry["batches"] = config.batchCount;
+				entry["tileSize"] = settings.tileSize;
+				entry["mpixelsPerSecond"] = pixelCount / (best.total * 1000.0);
+				entry["totalMs"] = best.total;
+				entry["stagesMs"] = { {"compile", best.compile}, {"allocate", best.allocate}, {"evaluate", best.evaluate}, {"save", best.save} };
+				// Peak of the whole process up to this point.
+				entry["peakRSSBytes"] = System::peakMemoryUsage();
+			}
+		}
+	}
+	System::setThreadCount(0u);
+
+	const std::string resultsStr = results.dump(4);
+	if(config.outputPath.empty()){
+		std::cout << resultsStr << std::endl;
+	} else if(!System::writeStringToFile(resultsStr, config.outputPath)){
+		return 1;
+	}
+
+	if(!config.baselinePath.empty()){
+		json baseline = json::parse(System::loadStringFromFile(config.baselinePath), nullptr, false);
+		if(baseline.is_discarded() || !baseline.contains("results")){
+			Log::Error() << "Unable to parse baseline at path \"" << config.baselinePath.string() << "\"" << std::endl;
+			return 1;
+		}
+		const uint regressions = compareToBaseline(results, baseline, config.threshold);
+		if(regressions != 0u){
+			Log::Error() << regressions << " regression(s) above " << config.threshold << "%." << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
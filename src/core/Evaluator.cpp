@@ -2,16 +2,30 @@
 #include "core/Graph.hpp"
 #include "core/nodes/Nodes.hpp"
 #include "core/Image.hpp"
+#include "core/PNGWriter.hpp"
+#include "core/Random.hpp"
 #include "core/system/System.hpp"
+#include "core/system/Profiler.hpp"
+#include "core/system/TextUtilities.hpp"
 
+#include <json/json.hpp>
 #include <unordered_map>
 #include <unordered_set>
 #include <sstream>
 #include <deque>
 #include <chrono>
+#include <mutex>
+#include <atomic>
 
 #define PARALLEL_FOR
 
+// Number of pixels evaluated at once when streaming outputs.
+const uint kStreamingStripPixelCount = 1u << 20u;
+// Maximum number of pixels of small batches evaluated together.
+const size_t kPackedGroupPixelCount = 1u << 20u;
+// When profiling, the cost of each node is measured on one pixel out of kProfileSampleStride in each direction.
+const uint kProfileSampleStride = 8u;
+
 
 void ErrorContext::addError(const std::string& message, const Node* node, int slot){
 	_errors.emplace_back(message, node, slot);
@@ -75,23 +89,27 @@ public:
 		uint to;
 	};
 
-	struct Neighbor {
-		Vertex* node;
-		std::vector<Edge> edges;
+	/// Contiguous range in one of the flat adjacency arrays.
+	template<typename T>
+	struct Range {
+		T* first{nullptr};
+		T* last{nullptr};
 
-		Neighbor(Vertex* _node, uint from, uint to) : node(_node) {
-			edges.push_back({from, to});
-		}
+		T* begin() const { return first; }
+		T* end() const { return last; }
+		size_t size() const { return last - first; }
+		bool empty() const { return first == last; }
+	};
 
-		void addEdge(uint from, uint to){
-			edges.push_back({from, to});
-		}
+	struct Neighbor {
+		Vertex* node;
+		Range<Edge> edges;
 	};
 
 	struct Vertex {
 		const Node* node;
-		std::vector<Neighbor> children;
-		std::vector<Neighbor> parents;
+		Range<Neighbor> children;
+		Range<Neighbor> parents;
 
 		uint tmpData{0u};
 
@@ -100,81 +118,73 @@ public:
 
 	WorkGraph(const Graph& graph, ErrorContext& errorContext) : _context(errorContext){
 
+		// Allocate nodes, and keep track of their vertex for each graph index.
+		const uint nodeCount = graph.getNodeCountUpperBound();
+		std::vector<uint> vertexIndices(nodeCount, kInvalidVertex);
 		GraphNodes nodesIt(graph);
-		// Allocate nodes.
 		for(uint node : nodesIt){
+			vertexIndices[node] = ( uint )_nodesPool.size();
 			_nodesPool.emplace_back(graph.node(node));
 		}
 		// Insert working nodes.
+		nodes.reserve(_nodesPool.size());
 		for(Vertex& node : _nodesPool){
 			nodes.push_back(&node);
 		}
 
-		uint linkCount = graph.getLinkCount();
+		std::vector<VertexLink> links;
+		const uint linkCount = graph.getLinkCount();
+		links.reserve(linkCount);
 		for(uint lid = 0; lid < linkCount; ++lid){
 			const Graph::Link& link = graph.link(lid);
-			const Node* linkFrom = graph.node(link.from.node);
-			const Node* linkTo = graph.node(link.to.node);
-
-			auto fromNode = std::find_if(nodes.begin(), nodes.end(), [linkFrom](const Vertex* const node){
-				return node->node == linkFrom;
-			});
-			auto toNode = std::find_if(nodes.begin(), nodes.end(), [linkTo](const Vertex* const node){
-				return node->node == linkTo;
-			});
-
-			if(fromNode == nodes.end() || toNode == nodes.end()){
+			const uint fromNode = link.from.node < nodeCount ? vertexIndices[link.from.node] : kInvalidVertex;
+			const uint toNode = link.to.node < nodeCount ? vertexIndices[link.to.node] : kInvalidVertex;
+			if(fromNode == kInvalidVertex || toNode == kInvalidVertex){
 				// Incorrect link
 				continue;
 			}
+			links.push_back({fromNode, toNode, {link.from.slot, link.to.slot}});
+		}
 
-			std::vector<Neighbor>& fromChildren = (*fromNode)->children;
-			auto child = std::find_if(fromChildren.begin(), fromChildren.end(), [&toNode](const Neighbor& child){
-				return child.node == *toNode;
-			});
-			if(child == fromChildren.end()){
-				fromChildren.emplace_back(*toNode, link.from.slot, link.to.slot);
-			} else {
-				child->addEdge( link.from.slot, link.to.slot);
-			}
-
-			std::vector<Neighbor>& toParents = (*toNode)->parents;
-			auto parent = std::find_if(toParents.begin(), toParents.end(), [&fromNode](const Neighbor& parent){
-				return parent.node == *fromNode;
-			});
-
-			if(parent == toParents.end()){
-				toParents.emplace_back(*fromNode, link.from.slot, link.to.slot);
-			} else {
-				parent->addEdge( link.from.slot, link.to.slot);
-			}
-
+		// Build flat adjacency arrays, children first then parents.
+		_edges.resize(2u * links.size());
+		std::vector<FlatNeighbor> neighbors;
+		neighbors.reserve(2u * links.size());
+		std::vector<std::pair<uint, uint>> childrenRanges = buildAdjacency(links, true, 0u, neighbors);
+		std::vector<std::pair<uint, uint>> parentsRanges = buildAdjacency(links, false, ( uint )links.size(), neighbors);
+
+		// Now that storage is final, convert indices to pointers.
+		_neighbors.reserve(neighbors.size());
+		for(const FlatNeighbor& neighbor : neighbors){
+			Edge* firstEdge = _edges.data() + neighbor.firstEdge;
+			_neighbors.push_back({&_nodesPool[neighbor.vertex], {firstEdge, firstEdge + neighbor.edgeCount}});
+		}
+		for(uint vid = 0u; vid < _nodesPool.size(); ++vid){
+			Vertex& vertex = _nodesPool[vid];
+			vertex.children = {_neighbors.data() + childrenRanges[vid].first, _neighbors.data() + childrenRanges[vid].second};
+			vertex.parents = {_neighbors.data() + parentsRanges[vid].first, _neighbors.data() + parentsRanges[vid].second};
 		}
 	}
 
 	bool validateInputs(){
 		bool incompleteNodes = false;
+		std::vector<bool> filledSlots;
 		// Check that all nodes have their inputs filled.
 		for(uint nid = 0; nid < ( uint )nodes.size();){
 			const Vertex* node = nodes[nid];
 			const uint tgtSlotCount = ( uint )node->node->inputs().size();
 
-			// Check that each slot is assigned to one of the parents.
-			for(uint sid = 0; sid < tgtSlotCount; ++sid){
-				bool foundSlot = false;
-				// Find the parent.
-				for(const Neighbor& neigh : node->parents){
-					for(const Edge& edge : neigh.edges){
-						if(edge.to == sid){
-							foundSlot = true;
-							break;
-						}
-					}
-					if(foundSlot){
-						break;
+			// Mark each slot assigned to one of the parents.
+			filledSlots.assign(tgtSlotCount, false);
+			for(const Neighbor& neigh : node->parents){
+				for(const Edge& edge : neigh.edges){
+					if(edge.to < tgtSlotCount){
+						filledSlots[edge.to] = true;
 					}
 				}
-				if(!foundSlot){
+			}
+			for(uint sid = 0; sid < tgtSlotCount; ++sid){
+				if(!filledSlots[sid]){
 					_context.addError("Missing input", node->node, sid);
 					incompleteNodes = true;
 				}
@@ -190,38 +200,78 @@ public:
 		}
 	}
 
-	bool hasCycle(Vertex* node){
-		// Have we already visited the node.
-		if(node->tmpData != 0u){
-			_context.addError("Cycle detected", node->node);
-			return true;
-		}
-		// Mark as visited
-		node->tmpData = 1u;
-		bool childHasCycle = false;
-		for(const Neighbor& child : node->children){
-			childHasCycle |= hasCycle(child.node);
-		}
-		// Unmark
-		node->tmpData = 0u;
-		return childHasCycle;
-	}
-
 	bool validateCycles(){
-		purgeTmpData();
-
-		// Collect roots.
-		std::vector<Vertex*> roots;
-		for(Vertex* node : nodes){
-			if(node->parents.empty()){
-				roots.push_back(node);
+		// Find strongly connected components with Tarjan's algorithm, iteratively to support deep graphs.
+		// Any component with more than one node, or a node linked to itself, is a cycle.
+		const uint vertexCount = ( uint )_nodesPool.size();
+		std::vector<uint> order(vertexCount, kInvalidVertex);
+		std::vector<uint> lowLinks(vertexCount, 0u);
+		std::vector<bool> inCycle(vertexCount, false);
+		std::vector<bool> onStack(vertexCount, false);
+		std::vector<uint> componentStack;
+		// Each call frame stores the vertex and the next child to visit.
+		std::vector<std::pair<uint, Neighbor*>> callStack;
+		uint currentOrder = 0u;
+		bool foundCycle = false;
+
+		for(uint rootId = 0u; rootId < vertexCount; ++rootId){
+			if(order[rootId] != kInvalidVertex){
+				continue;
+			}
+			callStack.push_back({rootId, _nodesPool[rootId].children.begin()});
+			order[rootId] = lowLinks[rootId] = currentOrder++;
+			componentStack.push_back(rootId);
+			onStack[rootId] = true;
+
+			while(!callStack.empty()){
+				const uint vid = callStack.back().first;
+				Neighbor*& nextChild = callStack.back().second;
+				if(nextChild != _nodesPool[vid].children.end()){
+					const uint cid = vertexIndex(nextChild->node);
+					++nextChild;
+					if(cid == vid){
+						inCycle[vid] = true;
+					}
+					if(order[cid] == kInvalidVertex){
+						// Visit the child.
+						order[cid] = lowLinks[cid] = currentOrder++;
+						componentStack.push_back(cid);
+						onStack[cid] = true;
+						callStack.push_back({cid, _nodesPool[cid].children.begin()});
+					} else if(onStack[cid]){
+						lowLinks[vid] = (std::min)(lowLinks[vid], order[cid]);
+					}
+					continue;
+				}
+				// All children visited, is the vertex the root of a component?
+				if(lowLinks[vid] == order[vid]){
+					const bool isCycle = componentStack.back() != vid;
+					uint member = kInvalidVertex;
+					do {
+						member = componentStack.back();
+						componentStack.pop_back();
+						onStack[member] = false;
+						if(isCycle){
+							inCycle[member] = true;
+						}
+					} while(member != vid);
+				}
+				callStack.pop_back();
+				// Propagate to the parent frame.
+				if(!callStack.empty()){
+					const uint pid = callStack.back().first;
+					lowLinks[pid] = (std::min)(lowLinks[pid], lowLinks[vid]);
+				}
 			}
 		}
-		bool rootHasCycle = false;
-		for(Vertex* root : roots){
-			rootHasCycle |= hasCycle(root);
+		// Report all nodes involved in a cycle.
+		for(const Vertex* node : nodes){
+			if(inCycle[vertexIndex(node)]){
+				_context.addError("Cycle detected", node->node);
+				foundCycle = true;
+			}
 		}
-		return !rootHasCycle;
+		return !foundCycle;
 	}
 
 	bool validateOutputNames(){
@@ -247,47 +297,40 @@ public:
 		return !duplicated;
 	}
 
-	void checkConnectionToOutputs(Vertex* vertex){
-		if(vertex->tmpData == 1u){
-			return;
-		}
-
-		if(vertex->node->type() == NodeClass::OUTPUT_IMG ){
-			vertex->tmpData = 1u;
-			return;
-		}
-
-		bool connected = false;
-		for(Neighbor& child : vertex->children){
-			checkConnectionToOutputs(child.node);
-			connected |= child.node->tmpData == 1u;
+	void checkConnectionToOutputs(){
+		// Walk up from outputs, all visited nodes are connected.
+		std::vector<Vertex*> nodesToProcess;
+		for(Vertex* node : nodes){
+			if(node->node->type() == NodeClass::OUTPUT_IMG){
+				node->tmpData = 1u;
+				nodesToProcess.push_back(node);
+			}
 		}
-		if(connected){
-			vertex->tmpData = 1u;
+		while(!nodesToProcess.empty()){
+			Vertex* vertex = nodesToProcess.back();
+			nodesToProcess.pop_back();
+			for(Neighbor& parent : vertex->parents){
+				if(parent.node->tmpData == 0u){
+					parent.node->tmpData = 1u;
+					nodesToProcess.push_back(parent.node);
+				}
+			}
 		}
 	}
 
 	void cleanUnconnectedComponents(){
 		purgeTmpData();
-		// Collect roots.
-		std::vector<Vertex*> roots;
-		for(Vertex* node : nodes){
-			if(node->parents.empty()){
-				roots.push_back(node);
-			}
-		}
-		for(Vertex* node : roots){
-			checkConnectionToOutputs(node);
-		}
+		checkConnectionToOutputs();
+
 		for(Vertex* vert : nodes){
-			auto itp = std::remove_if(vert->parents.begin(), vert->parents.end(), [](const Neighbor& parent){
+			Neighbor* itp = std::remove_if(vert->parents.begin(), vert->parents.end(), [](const Neighbor& parent){
 				return parent.node->tmpData == 0u;
 			});
-			vert->parents.erase( itp, vert->parents.end() );
-			auto itc = std::remove_if(vert->children.begin(), vert->children.end(), [](const Neighbor& child){
+			vert->parents.last = itp;
+			Neighbor* itc = std::remove_if(vert->children.begin(), vert->children.end(), [](const Neighbor& child){
 				return child.node->tmpData == 0u;
 			});
-			vert->children.erase( itc, vert->children.end() );
+			vert->children.last = itc;
 
 		}
 		auto itn = std::remove_if(nodes.begin(), nodes.end(), [](const Vertex* node){
@@ -299,44 +342,35 @@ public:
 	void compile(CompiledGraph& compiledGraph, bool optimize){
 		std::vector<Vertex*> orderedNodes;
 		orderedNodes.reserve(nodes.size());
-		purgeTmpData();
-		// Collect roots.
+		// Count parents left to process for each node, roots are ready.
 		std::deque<Vertex*> nodesToProcess;
+		// When optimizing, global nodes wait until no per-pixel node is ready, so that more of them
+		// can read registers backed up by a previous global node instead of flushing again.
+		std::deque<Vertex*> globalNodesToProcess;
 		for(Vertex* node : nodes){
+			node->tmpData = ( uint )node->parents.size();
 			if(node->parents.empty()){
 				nodesToProcess.push_back(node);
 			}
 		}
 		//
-		while(!nodesToProcess.empty()){
-			Vertex* top = nodesToProcess.front();
-			nodesToProcess.pop_front();
-			if(top->tmpData == 1u)
-				continue;
-
-			bool parentsReady = true;
-			for(Neighbor& parent : top->parents){
-				if(parent.node->tmpData == 0u){
-					parentsReady = false;
-					break;
-				}
-			}
-			// Skip if not ready yet.
-			if(!parentsReady){
-				nodesToProcess.push_back(top);
-				continue;
-			}
-			// The node can be processed, mark as complete.
+		while(!nodesToProcess.empty() || !globalNodesToProcess.empty()){
+			std::deque<Vertex*>& readyNodes = nodesToProcess.empty() ? globalNodesToProcess : nodesToProcess;
+			Vertex* top = readyNodes.front();
+			readyNodes.pop_front();
+			// The node can be processed.
 			orderedNodes.push_back(top);
-			top->tmpData = 1u;
-			// Insert all children
+			// Insert children once all their parents have been processed.
 			for(Neighbor& child : top->children){
-				// If a child is already processed, nothing to do, its own children
-				// have already been enqueued.
-				if(child.node->tmpData == 1u)
-					continue;
-				// Put them at the front to preserve consecutive nodes as much as possible.
-				nodesToProcess.push_front(child.node);
+				--child.node->tmpData;
+				if(child.node->tmpData == 0u){
+					// Put them at the front to preserve consecutive nodes as much as possible.
+					if(optimize && child.node->node->global()){
+						globalNodesToProcess.push_front(child.node);
+					} else {
+						nodesToProcess.push_front(child.node);
+					}
+				}
 			}
 		}
 		nodes = orderedNodes;
@@ -408,7 +442,7 @@ public:
 		compiledGraph.stackSize = stackSize + countDummyRegister;
 		compiledGraph.firstDummyRegister = stackSize;
 
-		bool hasGlobalNodes = false;
+		bool hasPreparedNodes = false;
 		for (CompiledNode& node : compiledGraph.nodes) {
 			// Safety check.
 			uint slotId = 0u;
@@ -425,48 +459,181 @@ public:
 					currentDummyRegister = (std::min)(currentDummyRegister + 1u, compiledGraph.stackSize - 1);
 				}
 			}
-			if(node.node->global()){
-				hasGlobalNodes = true;
+			if(node.node->access() > Access::REMAP){
+				hasPreparedNodes = true;
 			}
 		}
 
 		// By default, assume we'll want to store all registers in image channels.
 		compiledGraph.tmpImageCount = (compiledGraph.stackSize + 3u)/4u;
-		compiledGraph.tmpGlobalImageCount = hasGlobalNodes ? 1u : 0u;
+		// Remaps directly read the images, other global nodes prepare their data in a global image.
+		compiledGraph.tmpGlobalImageCount = hasPreparedNodes ? 1u : 0u;
 		// Refresh in/out nodes.
 		compiledGraph.collectInputsAndOutputs();
+
+		// Only decode the input channels that are read by other nodes.
+		// Unoptimized graphs can display all registers, including dummy ones.
+		compiledGraph.inputChannels.assign(compiledGraph.inputs.size(), 0xFu);
+		if(optimize){
+			for(const CompiledNode& node : compiledGraph.nodes){
+				if(node.node->type() != NodeClass::INPUT_IMG){
+					continue;
+				}
+				uint mask = 0u;
+				for(uint c = 0u; c < node.outputs.size(); ++c){
+					if(node.outputs[c] < firstDummyRegister){
+						mask |= 1u << c;
+					}
+				}
+				const auto input = std::find(compiledGraph.inputs.begin(), compiledGraph.inputs.end(), node.node);
+				compiledGraph.inputChannels[std::distance(compiledGraph.inputs.begin(), input)] = mask;
+			}
+		}
 	}
 
 	std::vector<Vertex*> nodes;
 
 private:
 
+	static const uint kInvalidVertex = 0xFFFFFFFF;
+
+	uint vertexIndex(const Vertex* vertex) const { return uint(vertex - _nodesPool.data()); }
+
+	struct VertexLink {
+		uint from;
+		uint to;
+		Edge edge;
+	};
+
+	struct FlatNeighbor {
+		uint vertex;
+		uint firstEdge;
+		uint edgeCount;
+	};
+
+	/// Group links per vertex, and then per neighbor in order of first appearance, preserving link order for edges.
+	/// Edges are stored in _edges starting at firstEdge, neighbors appended to the list, and each vertex neighbors range returned.
+	std::vector<std::pair<uint, uint>> buildAdjacency(const std::vector<VertexLink>& links, bool children, uint firstEdge, std::vector<FlatNeighbor>& neighbors){
+		const uint vertexCount = ( uint )_nodesPool.size();
+		const uint linkCount = ( uint )links.size();
+		// Counting sort of the links by vertex.
+		std::vector<uint> offsets(vertexCount + 1u, 0u);
+		for(const VertexLink& link : links){
+			++offsets[(children ? link.from : link.to) + 1u];
+		}
+		for(uint vid = 0u; vid < vertexCount; ++vid){
+			offsets[vid + 1u] += offsets[vid];
+		}
+		std::vector<uint> sortedLinks(linkCount);
+		std::vector<uint> cursors(offsets.begin(), offsets.end() - 1);
+		for(uint lid = 0u; lid < linkCount; ++lid){
+			const uint vertex = children ? links[lid].from : links[lid].to;
+			sortedLinks[cursors[vertex]++] = lid;
+		}
+
+		std::vector<std::pair<uint, uint>> ranges(vertexCount);
+		std::vector<uint> lastVertex(vertexCount, kInvalidVertex);
+		std::vector<uint> neighborIndex(vertexCount, 0u);
+		for(uint vid = 0u; vid < vertexCount; ++vid){
+			const uint firstNeighbor = ( uint )neighbors.size();
+			// Create neighbors and count their edges.
+			for(uint lid = offsets[vid]; lid < offsets[vid + 1u]; ++lid){
+				const VertexLink& link = links[sortedLinks[lid]];
+				const uint other = children ? link.to : link.from;
+				if(lastVertex[other] != vid){
+					lastVertex[other] = vid;
+					neighborIndex[other] = ( uint )neighbors.size();
+					neighbors.push_back({other, 0u, 0u});
+				}
+				++neighbors[neighborIndex[other]].edgeCount;
+			}
+			// Each neighbor gets a contiguous range of edges.
+			uint currentEdge = firstEdge + offsets[vid];
+			for(uint nid = firstNeighbor; nid < neighbors.size(); ++nid){
+				neighbors[nid].firstEdge = currentEdge;
+				currentEdge += neighbors[nid].edgeCount;
+				neighbors[nid].edgeCount = 0u;
+			}
+			for(uint lid = offsets[vid]; lid < offsets[vid + 1u]; ++lid){
+				const VertexLink& link = links[sortedLinks[lid]];
+				FlatNeighbor& neighbor = neighbors[neighborIndex[children ? link.to : link.from]];
+				_edges[neighbor.firstEdge + neighbor.edgeCount] = link.edge;
+				++neighbor.edgeCount;
+			}
+			ranges[vid] = {firstNeighbor, ( uint )neighbors.size()};
+		}
+		return ranges;
+	}
+
 	ErrorContext& _context;
 
 	std::vector<Vertex> _nodesPool;
+	std::vector<Neighbor> _neighbors;
+	std::vector<Edge> _edges;
 
 };
 
+Image::Storage storageForRange(const ValueRange& range){
+	if(range.binary && range.within(0.f, 1.f)){
+		return Image::Storage::UNORM8;
+	}
+	if(range.within(0.f, 1.f)){
+		return Image::Storage::UNORM16;
+	}
+	if(range.within(-1.f, 1.f)){
+		return Image::Storage::HALF;
+	}
+	return Image::Storage::FLOAT32;
+}
+
 void CompiledGraph::ensureGlobalNodesConsistency(){
 	// Find all flush nodes, find all "in transit" registers, assign them images.
 	// Then when executing, before each "flush" node have a "backup" node and afterwards a "restore" node.
 	struct Split {
 		uint index;
 		std::unordered_set<uint> redirections;
+		std::vector<ValueRange> ranges;
+		std::vector<Image::Storage> storages;
 	};
 	std::vector<Split> splits;
 	std::unordered_set<uint> registersInFlight;
 
 	const int nodeCount = int(nodes.size());
+
+	// Global nodes only read their inputs from the backup. If all their inputs were written before the previous flush,
+	// they are in flight there and already backed up: the node can be evaluated in the same segment, without a flush
+	// of its own. Independent branches thus share segments, and their global nodes are prepared concurrently.
+	std::vector<bool> fused(nodeCount, false);
+	{
+		std::vector<int> writers(stackSize, -1);
+		int lastFlush = -1;
+		for(int i = 0; i < nodeCount; ++i){
+			const CompiledNode& compiledNode = nodes[i];
+			if(compiledNode.node->global()){
+				bool backedUp = lastFlush >= 0;
+				for(int index : compiledNode.inputs){
+					backedUp = backedUp && writers[index] < lastFlush;
+				}
+				fused[i] = backedUp;
+				if(!backedUp){
+					lastFlush = i;
+				}
+			}
+			for(int index : compiledNode.outputs){
+				writers[index] = i;
+			}
+		}
+	}
+
 	for(int i = nodeCount - 1; i >= 0; --i){
 		const CompiledNode& compiledNode = nodes[i];
 		// Remove in flight registers provided by this node.
 		for(int index : compiledNode.outputs){
 			registersInFlight.erase(index);
 		}
-		// If the node is global, list it.
-		if(compiledNode.node->global()){
-			splits.insert(splits.begin(), {uint(i), registersInFlight});
+		// If the node is global and needs a flush, list it.
+		if(compiledNode.node->global() && !fused[i]){
+			splits.insert(splits.begin(), {uint(i), registersInFlight, {}, {}});
 		}
 		// Inputs need to be provided if there is a flush node before.
 		for(int index : compiledNode.inputs){
@@ -476,8 +643,36 @@ void CompiledGraph::ensureGlobalNodesConsistency(){
 		}
 	}
 
+	// Estimate the range of each register when reaching each flush node, to pick the backup precision.
+	{
+		std::vector<ValueRange> registerRanges(stackSize);
+		std::vector<ValueRange> inputRanges;
+		std::vector<ValueRange> outputRanges;
+		uint splitId = 0u;
+		for(int i = 0; i < nodeCount; ++i){
+			const CompiledNode& compiledNode = nodes[i];
+			if(splitId < splits.size() && splits[splitId].index == uint(i)){
+				splits[splitId].ranges = registerRanges;
+				++splitId;
+			}
+			inputRanges.resize(compiledNode.inputs.size());
+			for(size_t j = 0; j < compiledNode.inputs.size(); ++j){
+				inputRanges[j] = registerRanges[compiledNode.inputs[j]];
+			}
+			outputRanges.assign(compiledNode.outputs.size(), ValueRange());
+			compiledNode.node->evaluateRanges(inputRanges, outputRanges);
+			for(size_t j = 0; j < compiledNode.outputs.size(); ++j){
+				registerRanges[compiledNode.outputs[j]] = outputRanges[j];
+			}
+		}
+	}
+
+	// Maximum number of channels of each storage type needed by a split.
+	const Image::Storage storageTypes[] = { Image::Storage::FLOAT32, Image::Storage::HALF, Image::Storage::UNORM16, Image::Storage::UNORM8 };
+	const uint storageTypeCount = sizeof(storageTypes) / sizeof(storageTypes[0]);
+	uint maxTmpChannelCounts[storageTypeCount] = {0u, 0u, 0u, 0u};
+
 	uint totalShift = 0u;
-	uint maxTmpChannelCount = 0u;
 	for(Split& split : splits){
 		const uint backupIndex  = split.index + totalShift;
 		const uint globalIndex  = backupIndex + 1u;
@@ -489,9 +684,8 @@ void CompiledGraph::ensureGlobalNodesConsistency(){
 
 		CompiledNode& backup  = nodes[backupIndex];
 		CompiledNode& global  = nodes[globalIndex];
-		CompiledNode& restore = nodes[restoreIndex];
 		backup.node = new BackupNode();
-		restore.node = new RestoreNode();
+		nodes[restoreIndex].node = new RestoreNode();
 
 		// Backup nodesetup
 		{
@@ -503,11 +697,43 @@ void CompiledGraph::ensureGlobalNodesConsistency(){
 					backup.inputs.push_back(redir);
 				}
 			}
-			// Move each register to an image channel, in order.
+			// Pick the storage of each register based on its range.
+			uint channelCounts[storageTypeCount] = {0u, 0u, 0u, 0u};
+			for(int reg : backup.inputs){
+				const Image::Storage storage = storageForRange(split.ranges[reg]);
+				split.storages.push_back(storage);
+				++channelCounts[uint(storage)];
+			}
+			for(uint i = 0; i < storageTypeCount; ++i){
+				maxTmpChannelCounts[i] = (std::max)(maxTmpChannelCounts[i], channelCounts[i]);
+			}
+		}
+	}
+
+	// Allocate images for each storage type, and the first channel of each type.
+	uint firstStorageChannel[storageTypeCount];
+	tmpImageStorages.clear();
+	for(uint i = 0; i < storageTypeCount; ++i){
+		firstStorageChannel[i] = uint(tmpImageStorages.size()) * 4u;
+		const uint imageCount = (maxTmpChannelCounts[i] + 3u) / 4u;
+		tmpImageStorages.insert(tmpImageStorages.end(), imageCount, storageTypes[i]);
+	}
+	tmpImageCount = uint(tmpImageStorages.size());
+
+	for(Split& split : splits){
+		CompiledNode& backup  = nodes[split.index - 1u];
+		CompiledNode& global  = nodes[split.index];
+		CompiledNode& restore = nodes[split.index + 1u];
+
+		// Move each register to an image channel of the proper storage, in order.
+		{
+			uint channelCounts[storageTypeCount] = {0u, 0u, 0u, 0u};
 			const uint backupInputCount = ( uint )backup.inputs.size();
 			backup.outputs.resize(backupInputCount);
 			for(uint i = 0; i < backupInputCount; ++i){
-				backup.outputs[i] = i;
+				const uint storage = uint(split.storages[i]);
+				backup.outputs[i] = firstStorageChannel[storage] + channelCounts[storage];
+				++channelCounts[storage];
 			}
 		}
 		// Global node adjustments
@@ -515,7 +741,7 @@ void CompiledGraph::ensureGlobalNodesConsistency(){
 			// The global node will have access to all the backed up images.
 			const uint nodeInputCount = ( uint )global.inputs.size();
 			for(uint i = 0; i < nodeInputCount; ++i){
-				global.inputs[i] = i;
+				global.inputs[i] = backup.outputs[i];
 			}
 			// The global node will directly write its outputs to the registers for each pixel.
 			// As long as the operation is a gathering.
@@ -532,11 +758,183 @@ void CompiledGraph::ensureGlobalNodesConsistency(){
 				}
 			}
 		}
+	}
+
+	// Fused nodes read their inputs from the channels of the previous backup.
+	const CompiledNode* backup = nullptr;
+	for(uint i = 0; i < nodes.size(); ++i){
+		CompiledNode& compiledNode = nodes[i];
+		if(compiledNode.node->type() == NodeClass::INTERNAL_BACKUP){
+			backup = &compiledNode;
+			continue;
+		}
+		if(!compiledNode.node->global() || startsSegment(i)){
+			continue;
+		}
+		assert(backup);
+		for(int& input : compiledNode.inputs){
+			const auto backedUp = std::find(backup->inputs.begin(), backup->inputs.end(), input);
+			assert(backedUp != backup->inputs.end());
+			input = backup->outputs[std::distance(backup->inputs.begin(), backedUp)];
+		}
+	}
+
+	// Nodes prepared in the same segment each need their own global image.
+	globalImageIds.clear();
+	uint segmentImageCount = 0u;
+	for(uint i = 0; i < nodes.size(); ++i){
+		const Node* node = nodes[i].node;
+		if(startsSegment(i)){
+			segmentImageCount = 0u;
+		}
+		if(node->access() <= Access::REMAP){
+			continue;
+		}
+		if(node->id() >= globalImageIds.size()){
+			globalImageIds.resize(node->id() + 1u, 0u);
+		}
+		globalImageIds[node->id()] = segmentImageCount++;
+		tmpGlobalImageCount = (std::max)(tmpGlobalImageCount, segmentImageCount);
+	}
+}
+
+bool CompiledGraph::startsSegment(uint nodeId) const {
+	return nodeId > 0u && nodes[nodeId].node->global() && nodes[nodeId - 1u].node->type() == NodeClass::INTERNAL_BACKUP;
+}
+
+// Global and restore nodes read image channels instead of registers, as well as uniform nodes that read batch values.
+bool readsRegisters(const Node* node){
+	return !node->global() && node->type() != NodeClass::INTERNAL_RESTORE && node->type() != NodeClass::INTERNAL_UNIFORM;
+}
+
+// Backup nodes write image channels instead of registers.
+bool writesRegisters(const Node* node){
+	return node->type() != NodeClass::INTERNAL_BACKUP;
+}
+
+void CompiledGraph::hoistUniformNodes(){
+	// Classify registers as constant, uniform or varying, following nodes in order.
+	// A register is only reused once all nodes have read its previous value.
+	const uint nodeCount = ( uint )nodes.size();
+	std::vector<Variation> registerVariations(stackSize, Variation::CONSTANT);
+	std::vector<bool> hoisted(nodeCount, false);
+	std::vector<bool> probed(nodeCount, false);
+	for(uint i = 0; i < nodeCount; ++i){
+		const CompiledNode& compiledNode = nodes[i];
+		const Node* node = compiledNode.node;
+		Variation inputs = Variation::VARYING;
+		if(readsRegisters(node)){
+			inputs = Variation::CONSTANT;
+			for(int reg : compiledNode.inputs){
+				inputs = (std::max)(inputs, registerVariations[reg]);
+			}
+		}
+		const Variation outputs = node->variation(inputs);
+		// Restored registers keep the values they had before the global node.
+		if(writesRegisters(node) && node->type() != NodeClass::INTERNAL_RESTORE){
+			for(int reg : compiledNode.outputs){
+				registerVariations[reg] = outputs;
+			}
+		}
+		hoisted[i] = outputs != Variation::VARYING;
+		// Some nodes have uniform outputs even when reading varying inputs.
+		probed[i] = hoisted[i] && node->variation(Variation::VARYING) != Variation::VARYING;
+	}
+
+	// Outputs of a uniform node have to be loaded in registers if a per-pixel or a probed node reads them.
+	std::vector<bool> needsLoad(nodeCount, false);
+	std::vector<bool> liveRegisters(stackSize, false);
+	for(uint i = nodeCount; i-- > 0u;){
+		const CompiledNode& compiledNode = nodes[i];
+		if(writesRegisters(compiledNode.node)){
+			for(int reg : compiledNode.outputs){
+				needsLoad[i] = needsLoad[i] || liveRegisters[reg];
+				liveRegisters[reg] = false;
+			}
+		}
+		if((!hoisted[i] || probed[i]) && readsRegisters(compiledNode.node)){
+			for(int reg : compiledNode.inputs){
+				liveRegisters[reg] = true;
+			}
+		}
+	}
+
+	// Move uniform nodes out of the per-pixel nodes, replacing them by a load if needed.
+	std::vector<CompiledNode> pixelNodes;
+	pixelNodes.reserve(nodeCount);
+	uniforms.clear();
+	uniformValueCount = 0u;
+	for(uint i = 0; i < nodeCount; ++i){
+		if(!hoisted[i]){
+			pixelNodes.push_back(nodes[i]);
+			continue;
+		}
+		CompiledUniform& uniform = uniforms.emplace_back();
+		uniform.node = nodes[i];
+		uniform.index = ( uint )pixelNodes.size();
+		uniform.firstValue = uniformValueCount;
+		uniform.probed = probed[i];
+		const uint outputCount = ( uint )nodes[i].outputs.size();
+		uniformValueCount += outputCount;
+		// Global nodes stay in place to be prepared, and load their own outputs.
+		if(nodes[i].node->global()){
+			pixelNodes.push_back(nodes[i]);
+		} else if(needsLoad[i]){
+			CompiledNode& load = pixelNodes.emplace_back();
+			load.node = new UniformNode();
+			load.outputs = nodes[i].outputs;
+			for(uint j = 0; j < outputCount; ++j){
+				load.inputs.push_back(uniform.firstValue + j);
+			}
+		}
+	}
+	nodes.swap(pixelNodes);
 
-		// Number of backup channels needed.
-		maxTmpChannelCount = (std::max)(maxTmpChannelCount, uint(backup.inputs.size()));
+	// Probed nodes depend on per-pixel nodes of their segment, find them by walking back to the global node starting it.
+	std::vector<bool> neededRegisters(stackSize, false);
+	for(CompiledUniform& uniform : uniforms){
+		if(!uniform.probed){
+			continue;
+		}
+		uint neededCount = 0u;
+		auto require = [&neededRegisters, &neededCount](const CompiledNode& compiledNode){
+			if(!readsRegisters(compiledNode.node)){
+				return;
+			}
+			for(int reg : compiledNode.inputs){
+				if(!neededRegisters[reg]){
+					neededRegisters[reg] = true;
+					++neededCount;
+				}
+			}
+		};
+		require(uniform.node);
+		for(uint j = uniform.index; j-- > 0u && neededCount != 0u;){
+			const CompiledNode& compiledNode = nodes[j];
+			bool required = false;
+			if(writesRegisters(compiledNode.node)){
+				for(int reg : compiledNode.outputs){
+					if(neededRegisters[reg]){
+						neededRegisters[reg] = false;
+						--neededCount;
+						required = true;
+					}
+				}
+			}
+			if(required){
+				uniform.probe.push_back(j);
+				require(compiledNode);
+			}
+			if(startsSegment(j)){
+				break;
+			}
+		}
+		std::reverse(uniform.probe.begin(), uniform.probe.end());
+		assert(neededCount == 0u);
+		if(neededCount != 0u){
+			neededRegisters.assign(stackSize, false);
+		}
 	}
-	tmpImageCount = (maxTmpChannelCount + 3u) / 4u;
 }
 
 void CompiledGraph::collectInputsAndOutputs(){
@@ -578,6 +976,11 @@ CompiledGraph::CompiledGraph(const CompiledGraph& other){
 	tmpImageCount = other.tmpImageCount;
 	tmpGlobalImageCount = other.tmpGlobalImageCount;
 	firstDummyRegister = other.firstDummyRegister;
+	tmpImageStorages = other.tmpImageStorages;
+	globalImageIds = other.globalImageIds;
+	inputChannels = other.inputChannels;
+	uniforms = other.uniforms;
+	uniformValueCount = other.uniformValueCount;
 	// We need to clone internal nodes.
 	std::unordered_map<const Node*, const Node*> newNodes;
 	for(CompiledNode& node : nodes){
@@ -589,6 +992,9 @@ CompiledGraph::CompiledGraph(const CompiledGraph& other){
 				case INTERNAL_RESTORE:
 					node.node = new RestoreNode();
 					break;
+				case INTERNAL_UNIFORM:
+					node.node = new UniformNode();
+					break;
 				default:
 					assert(false);
 					break;
@@ -630,20 +1036,21 @@ bool generateBatches(const std::vector<const Node*>& inputs, const std::vector<c
 			const OutputNode* node = static_cast<const OutputNode*>(outputs[outputId]);
 			Batch::Output& outFile = batch.outputs.emplace_back();
 			outFile.path = outputPath / node->generateFileName(batchId, outFile.format);
+			outFile.exr = node->exrOptions();
 		}
 	}
 	return true;
 }
 
-glm::ivec2 computeOutputResolution(const std::vector<Image>& images, const glm::ivec2& fallbackRes)
+glm::ivec2 computeOutputResolution(const std::vector<glm::ivec2>& sizes, const glm::ivec2& fallbackRes)
 {
-	if(images.empty()){
+	if(sizes.empty()){
 		return fallbackRes;
 	}
 
 	glm::ivec2 tgtRes{INT_MAX, INT_MAX };
-	for(const Image& img : images){
-		tgtRes = glm::min(tgtRes, {img.w(), img.h() });
+	for(const glm::ivec2& size : sizes){
+		tgtRes = glm::min(tgtRes, size);
 	}
 	return tgtRes;
 }
@@ -693,22 +1100,83 @@ bool compile( const Graph& editGraph, bool optimize, ErrorContext& errors, Compi
 
 	if(optimize){
 		compiledGraph.ensureGlobalNodesConsistency();
+		compiledGraph.hoistUniformNodes();
 	}
 	return true;
 }
 
-void allocateContextForBatch(const Batch& batch, const CompiledGraph& compiledGraph, const glm::ivec2& fallbackRes, Image::Filter filter, bool forceRes,SharedContext& sharedContext, const glm::ivec2& maxRes){
+bool isHDRFile(const fs::path& path){
+	const std::string ext = TextUtilities::lowercase(path.extension().string());
+	return ext == ".exr" || ext == ".raw";
+}
+
+// Images are kept in memory as long as they fit in the budget, the others are stored out-of-core.
+class MemoryBudget {
+public:
+
+	explicit MemoryBudget(size_t budget) : _remaining(budget), _unlimited(budget == 0u) {}
+
+	bool reserve(uint w, uint h, Image::Storage storage){
+		if(_unlimited){
+			return true;
+		}
+		const size_t size = Image::byteSize(w, h, storage);
+		if(size > _remaining){
+			_remaining = 0u;
+			return false;
+		}
+		_remaining -= size;
+		return true;
+	}
+
+private:
+	size_t _remaining;
+	bool _unlimited;
+};
+
+bool loadInputsForBatch(const Batch& batch, const CompiledGraph& compiledGraph, const EvaluationSettings& settings, MemoryBudget& budget, SharedContext& sharedContext, const glm::ivec2& maxRes){
 
 	const uint inputCountInBatch  = ( uint )batch.inputs.size();
-	const uint outputCountInBatch = ( uint )batch.outputs.size();
+	assert(inputCountInBatch == compiledGraph.inputs.size());
+
+	// Input nodes fetch their image using their own index.
+	std::vector<uint> slots(inputCountInBatch);
+	uint slotCount = 0u;
+	for(uint i = 0u; i < inputCountInBatch; ++i){
+		slots[i] = static_cast<const InputNode*>(compiledGraph.inputs[i])->index();
+		slotCount = (std::max)(slotCount, slots[i] + 1u);
+	}
+	sharedContext.inputImages.resize(slotCount);
+
+	// Decode all inputs concurrently, skipping the ones that are not read.
+	// Unread inputs still contribute to the output resolution.
+	std::vector<glm::ivec2> sizes(inputCountInBatch, glm::ivec2(0));
+	System::forParallel(0, inputCountInBatch, [&batch, &compiledGraph, &slots, &sizes, &sharedContext](size_t i){
+		const uint channels = compiledGraph.inputChannels[i];
+		if(channels == 0u){
+			uint w = 0u;
+			uint h = 0u;
+			Image::info(batch.inputs[i], w, h);
+			sizes[i] = {w, h};
+			return;
+		}
+		Image& img = sharedContext.inputImages[slots[i]];
+		Profiler::Scope scope([&batch, i](){ return "Decode " + batch.inputs[i].filename().string(); }, "io");
+		img.load(batch.inputs[i], channels);
+		sizes[i] = {img.w(), img.h()};
+	});
 
-	sharedContext.inputImages.resize(inputCountInBatch);
+	// Reduced precision storage assumes that inputs are in [0,1].
+	bool hdrInputs = false;
 	for(uint i = 0u; i < inputCountInBatch; ++i){
-		sharedContext.inputImages[i].load(batch.inputs[i]);
+		hdrInputs |= compiledGraph.inputChannels[i] != 0u && isHDRFile(batch.inputs[i]);
 	}
+	sharedContext.randomSeed = Random::getSeed();
+	sharedContext.legacyRandom = settings.legacyRandom;
+
 	// Find the minimal size among images (or the fallback if no inputs)
-	glm::ivec2 outRes = computeOutputResolution( sharedContext.inputImages, fallbackRes );
-	outRes = forceRes ? fallbackRes : outRes;
+	glm::ivec2 outRes = computeOutputResolution( sizes, settings.outputRes );
+	outRes = settings.forceOutputRes ? settings.outputRes : outRes;
 	// Use our target resolution
 	sharedContext.scale = {1.f, 1.f};
 	sharedContext.dims = outRes;
@@ -720,25 +1188,73 @@ void allocateContextForBatch(const Batch& batch, const CompiledGraph& compiledGr
 	}
 
 	// Ensure all images are the same size.
-	for( Image& img : sharedContext.inputImages ){
+	System::forParallel(0, inputCountInBatch, [&batch, &compiledGraph, &settings, &slots, &sharedContext](size_t i){
+		if(compiledGraph.inputChannels[i] == 0u){
+			return;
+		}
+		Image& img = sharedContext.inputImages[slots[i]];
 		if( (img.w() != uint(sharedContext.dims.x)) || (img.h() != uint(sharedContext.dims.y)) ){
-			img.resize( sharedContext.dims, filter );
+			Profiler::Scope scope([&batch, i](){ return "Resize " + batch.inputs[i].filename().string(); }, "resize");
+			img.resize( sharedContext.dims, settings.filterOutputRes );
+		}
+		// Resampled LDR inputs are stored with 16 bits per channel.
+		if(!settings.precise && !isHDRFile(batch.inputs[i]) && img.storage() == Image::Storage::FLOAT32){
+			img.convert(Image::Storage::UNORM16);
+		}
+	});
+	for(Image& img : sharedContext.inputImages){
+		if(img.w() * img.h() != 0u && !img.outOfCore() && !budget.reserve(img.w(), img.h(), img.storage())){
+			img.moveOutOfCore();
 		}
 	}
+	return hdrInputs;
+}
+
+Image::Storage outputStorage(const Batch::Output& output, bool precise){
+	const bool ldrOutput = output.format != Image::Format::EXR && output.format != Image::Format::RAW;
+	return (!precise && ldrOutput) ? Image::Storage::UNORM16 : Image::Storage::FLOAT32;
+}
+
+Region outputRegion(const EvaluationSettings& settings, const glm::ivec2& dims){
+	const Region region = settings.region.clamped(dims);
+	return region.empty() ? Region::full(dims) : region;
+}
+
+void allocateContextForBatch(const Batch& batch, const CompiledGraph& compiledGraph, const EvaluationSettings& settings, SharedContext& sharedContext, const glm::ivec2& maxRes){
+
+	const uint outputCountInBatch = ( uint )batch.outputs.size();
+
+	MemoryBudget budget(settings.memoryBudget);
+	const bool hdrInputs = loadInputsForBatch(batch, compiledGraph, settings, budget, sharedContext, maxRes);
 
-	// Allocate outputs
 	const uint w = sharedContext.dims.x;
 	const uint h = sharedContext.dims.y;
-	for(uint i = 0u; i < outputCountInBatch; ++i){
-		sharedContext.outputImages.emplace_back(w, h);
-	}
-	// Allocate tmp images
-	for(uint i = 0u; i < compiledGraph.tmpImageCount; ++i){
-		sharedContext.tmpImagesRead.emplace_back(w, h);
-		sharedContext.tmpImagesWrite.emplace_back(w, h);
+	// Allocate tmp images first, as they are accessed by all segments.
+	// The tiled evaluation allocates the images of each segment on demand, based on a first set.
+	const bool tiled = settings.tileSize != 0u;
+	const bool reducedPrecision = !settings.precise && !hdrInputs;
+	const uint tmpImageCount = tiled && canStreamGraph(compiledGraph) ? 0u : compiledGraph.tmpImageCount;
+	for(uint i = 0u; i < tmpImageCount; ++i){
+		const bool hasStorage = reducedPrecision && i < compiledGraph.tmpImageStorages.size();
+		const Image::Storage storage = hasStorage ? compiledGraph.tmpImageStorages[i] : Image::Storage::FLOAT32;
+		if(!tiled){
+			sharedContext.tmpImagesRead.emplace_back(w, h, storage, glm::vec4(0.0f), !budget.reserve(w, h, storage));
+		}
+		sharedContext.tmpImagesWrite.emplace_back(w, h, storage, glm::vec4(0.0f), !budget.reserve(w, h, storage));
 	}
 	for(uint i = 0u; i < compiledGraph.tmpGlobalImageCount; ++i){
-		sharedContext.tmpImagesGlobal.emplace_back(w, h);
+		sharedContext.tmpImagesGlobal.emplace_back(w, h, Image::Storage::FLOAT32, glm::vec4(0.0f), !budget.reserve(w, h, Image::Storage::FLOAT32));
+	}
+	sharedContext.globalImageIds = compiledGraph.globalImageIds;
+	sharedContext.uniforms.assign(compiledGraph.uniformValueCount, 0.0f);
+	// Outputs are written once, sequentially, and only cover the requested region.
+	sharedContext.region = outputRegion(settings, sharedContext.dims);
+	sharedContext.outputOrigin = sharedContext.region.min;
+	const uint outW = sharedContext.region.size().x;
+	const uint outH = sharedContext.region.size().y;
+	for(uint i = 0u; i < outputCountInBatch; ++i){
+		const Image::Storage storage = outputStorage(batch.outputs[i], settings.precise);
+		sharedContext.outputImages.emplace_back(outW, outH, storage, glm::vec4(0.0f), !budget.reserve(outW, outH, storage));
 	}
 }
 
@@ -748,7 +1264,8 @@ void evaluateGraphStepForBatch(const CompiledNode& compiledNode, uint stackSize,
 	const uint h = sharedContext.dims.y;
 
 	if(compiledNode.node->global()){
-		compiledNode.node->prepare(sharedContext, compiledNode.inputs);
+		Profiler::Scope scope([&compiledNode](){ return "Prepare " + compiledNode.node->name(); }, "prepare");
+		compiledNode.node->prepare(sharedContext, compiledNode.inputs, Region::full(sharedContext.dims));
 	}
 
 #ifdef PARALLEL_FOR
@@ -761,13 +1278,13 @@ void evaluateGraphStepForBatch(const CompiledNode& compiledNode, uint stackSize,
 			LocalContext context(&sharedContext, {x,y}, stackSize);
 			// Transfer inputs to registers
 			for(uint sid = 0; sid < stackSize; ++sid){
-				context.stack[sid] = context.shared->tmpImagesRead[sid/4].pixel(x,y)[sid%4];
+				context.stack[sid] = context.shared->tmpImagesRead[sid/4].channel(x, y, sid%4);
 			}
 			// Run the compiled graph, assigning to registers, passing the context along.
 			compiledNode.node->evaluate(context, compiledNode.inputs, compiledNode.outputs);
 			// Transfer registers to outputs
 			for(uint sid = 0; sid < stackSize; ++sid){
-				context.shared->tmpImagesWrite[sid/4].pixel(x,y)[sid%4] = context.stack[sid];
+				context.shared->tmpImagesWrite[sid/4].setChannel(x, y, sid%4, context.stack[sid]);
 			}
 		}
 	}
@@ -784,60 +1301,280 @@ void evaluateGraphForBatchLockstep(const CompiledGraph& compiledGraph, SharedCon
 	}
 }
 
-void evaluateGraphForBatchOptimized(const CompiledGraph& compiledGraph, SharedContext& sharedContext){
-	const uint compiledNodeCount = ( uint )compiledGraph.nodes.size();
-	const uint w = sharedContext.dims.x;
-	const uint h = sharedContext.dims.y;
-	uint currentStartNodeId = 0u;
-
-	std::chrono::time_point<std::chrono::high_resolution_clock> start = std::chrono::high_resolution_clock::now();
-
-	while(currentStartNodeId < compiledNodeCount){
-		// Find the next global node
-		uint nextGlobalNodeId = currentStartNodeId + 1;
-		for(; nextGlobalNodeId < compiledNodeCount; ++nextGlobalNodeId){
-			if(compiledGraph.nodes[ nextGlobalNodeId ].node->global())
-				break;
-		}
-		// Now we have a range [currentStartNode, nextGlobalNodeId[ to execute per-pixel.
-		// The only potential global node is the first one.
-		// These nodes can work on the whole image at once, in a non-trivially-parallelizable way.
-		// They require some internal storage (from their prepare call to their evaluate call)
-		// We can't use tmpImagesWrite because another thread might have overwritten the value of a neighboring pixel in it
-		// before the current thread read its neighbors pixels.
-		// We could
-		// * allocate the storage in the prepare call: this puts large data on the node
-		// * have the caller setup an image outside the external loop. In each loop, we only have one global node.
-		{
-			const CompiledNode& compiledNode = compiledGraph.nodes[currentStartNodeId];
-			if(compiledNode.node->global()){
-				compiledNode.node->prepare(sharedContext, compiledNode.inputs);
-			}
-
+// Same as evaluateSegmentForRegion, but each thread records the rows it evaluates,
+// and the cost of each node is sampled on a subset of pixels.
+void evaluateSegmentForRegionProfiled(const CompiledGraph& compiledGraph, uint firstNodeId, uint endNodeId, const Region& region, SharedContext& sharedContext){
+	using Clock = Profiler::Clock;
+	const Clock::time_point segmentStart = Clock::now();
+
+	const uint firstRow = region.min.y;
+	const uint endRow = region.max.y;
+	const uint firstColumn = region.min.x;
+	const uint endColumn = region.max.x;
+	const uint nodeCount = endNodeId - firstNodeId;
+	const uint rowCount = endRow - firstRow;
+	const uint chunkCount = (std::min)(System::threadCount(), (std::max)(rowCount, 1u));
+	const uint rowsPerChunk = (rowCount + chunkCount - 1u) / chunkCount;
+
+	std::vector<double> nodeCosts(nodeCount, 0.0);
+	size_t sampleCount = 0u;
+	std::mutex costsLock;
+
+	System::forParallel(0, chunkCount, [&sharedContext, &compiledGraph, &nodeCosts, &sampleCount, &costsLock, firstNodeId, endNodeId, nodeCount, firstRow, endRow, firstColumn, endColumn, rowsPerChunk](size_t chunk){
+		const uint chunkFirstRow = firstRow + uint(chunk) * rowsPerChunk;
+		const uint chunkEndRow = (std::min)(chunkFirstRow + rowsPerChunk, endRow);
+		if(chunkFirstRow >= chunkEndRow){
+			return;
 		}
-#ifdef PARALLEL_FOR
-		System::forParallel(0, h, [&sharedContext, currentStartNodeId, nextGlobalNodeId, w, &compiledGraph](size_t y){
-#else
-		for( uint y = 0; y < h; ++y ){
-#endif
-			for( uint x = 0; x < w; ++x ){
-				// Create local context (shared context + x,y coords and a scratch space)
+		Profiler::Scope scope([chunkFirstRow, chunkEndRow](){ return "Rows " + std::to_string(chunkFirstRow) + "-" + std::to_string(chunkEndRow - 1u); }, "segment");
+		std::vector<double> localCosts(nodeCount, 0.0);
+		size_t localSampleCount = 0u;
+		for( uint y = chunkFirstRow; y < chunkEndRow; ++y ){
+			for( uint x = firstColumn; x < endColumn; ++x ){
 				LocalContext context(&sharedContext, {x,y}, compiledGraph.stackSize);
-
-				// Run the compiled graph, assigning to registers, passing the context along.
-				for(uint nodeId = currentStartNodeId; nodeId < nextGlobalNodeId; ++nodeId){
+				const bool sampled = (x % kProfileSampleStride == 0u) && (y % kProfileSampleStride == 0u);
+				for(uint nodeId = firstNodeId; nodeId < endNodeId; ++nodeId){
 					const CompiledNode& compiledNode = compiledGraph.nodes[nodeId];
+					if(!sampled){
+						compiledNode.node->evaluate(context, compiledNode.inputs, compiledNode.outputs);
+						continue;
+					}
+					const Clock::time_point start = Clock::now();
 					compiledNode.node->evaluate(context, compiledNode.inputs, compiledNode.outputs);
+					localCosts[nodeId - firstNodeId] += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
 				}
+				localSampleCount += sampled ? 1u : 0u;
 			}
 		}
+		std::lock_guard<std::mutex> guard(costsLock);
+		for(uint i = 0u; i < nodeCount; ++i){
+			nodeCosts[i] += localCosts[i];
+		}
+		sampleCount += localSampleCount;
+	});
+
+	// Split the segment duration between nodes based on their sampled cost, on the calling thread.
+	const Clock::time_point segmentEnd = Clock::now();
+	double totalCost = 0.0;
+	for(double cost : nodeCosts){
+		totalCost += cost;
+	}
+	if(sampleCount == 0u || totalCost <= 0.0){
+		return;
+	}
+	const double pixelCount = double(endColumn - firstColumn) * double(rowCount);
+	Clock::time_point nodeStart = segmentStart;
+	for(uint i = 0u; i < nodeCount; ++i){
+		const Clock::duration duration = std::chrono::duration_cast<Clock::duration>((segmentEnd - segmentStart) * (nodeCosts[i] / totalCost));
+		const double nsPerPixel = nodeCosts[i] / double(sampleCount);
+		const Node* node = compiledGraph.nodes[firstNodeId + i].node;
+		Profiler::addEvent(node->name(), "node", nodeStart, nodeStart + duration, { {"nsPerPixel", nsPerPixel}, {"estimatedCpuMs", nsPerPixel * pixelCount * 1e-6} });
+		nodeStart += duration;
+	}
+}
+
+void evaluateSegmentForRegion(const CompiledGraph& compiledGraph, uint firstNodeId, uint endNodeId, const Region& region, SharedContext& sharedContext){
+	if(region.empty()){
+		return;
+	}
+	if(Profiler::enabled()){
+		evaluateSegmentForRegionProfiled(compiledGraph, firstNodeId, endNodeId, region, sharedContext);
+		return;
+	}
+	const uint firstColumn = region.min.x;
+	const uint endColumn = region.max.x;
 #ifdef PARALLEL_FOR
-		);
+	System::forParallel(region.min.y, region.max.y, [&sharedContext, firstNodeId, endNodeId, firstColumn, endColumn, &compiledGraph](size_t y){
+#else
+	for( uint y = region.min.y; y < region.max.y; ++y ){
 #endif
+		for( uint x = firstColumn; x < endColumn; ++x ){
+			// Create local context (shared context + x,y coords and a scratch space)
+			LocalContext context(&sharedContext, {x,y}, compiledGraph.stackSize);
 
-		std::swap(sharedContext.tmpImagesRead, sharedContext.tmpImagesWrite);
+			// Run the compiled graph, assigning to registers, passing the context along.
+			for(uint nodeId = firstNodeId; nodeId < endNodeId; ++nodeId){
+				const CompiledNode& compiledNode = compiledGraph.nodes[nodeId];
+				compiledNode.node->evaluate(context, compiledNode.inputs, compiledNode.outputs);
+			}
+		}
+	}
+#ifdef PARALLEL_FOR
+	);
+#endif
+}
+
+// Evaluate once the uniform nodes of a segment, and store their outputs in the batch values.
+// Uniform nodes only read registers written by previous uniform nodes, possibly in previous segments, so they share the same context.
+void evaluateUniformsForSegment(const CompiledGraph& compiledGraph, uint firstNodeId, uint endNodeId, LocalContext& context){
+	SharedContext& sharedContext = *context.shared;
+	const std::vector<CompiledUniform>& uniforms = compiledGraph.uniforms;
+	auto uniform = std::lower_bound(uniforms.begin(), uniforms.end(), firstNodeId, [](const CompiledUniform& u, uint nodeId){
+		return u.index < nodeId;
+	});
+	if(uniform == uniforms.end() || uniform->index >= endNodeId){
+		return;
+	}
+	Profiler::Scope scope([firstNodeId, endNodeId](){ return "Uniforms " + std::to_string(firstNodeId) + "-" + std::to_string(endNodeId - 1u); }, "prepare");
+	for(; uniform != uniforms.end() && uniform->index < endNodeId; ++uniform){
+		const CompiledNode& compiledNode = uniform->node;
+		if(uniform->probed){
+			// Evaluate the per-pixel nodes it depends on at the pixel it reads.
+			const glm::ivec2 coords = compiledNode.node->footprint(Region::full(sharedContext.dims), sharedContext).min;
+			LocalContext probe(&sharedContext, coords, compiledGraph.stackSize);
+			for(uint nodeId : uniform->probe){
+				const CompiledNode& probeNode = compiledGraph.nodes[nodeId];
+				probeNode.node->evaluate(probe, probeNode.inputs, probeNode.outputs);
+			}
+			compiledNode.node->evaluate(probe, compiledNode.inputs, compiledNode.outputs);
+			for(int reg : compiledNode.outputs){
+				context.stack[reg] = probe.stack[reg];
+			}
+		} else {
+			compiledNode.node->evaluate(context, compiledNode.inputs, compiledNode.outputs);
+		}
+		const uint outputCount = ( uint )compiledNode.outputs.size();
+		for(uint i = 0u; i < outputCount; ++i){
+			sharedContext.uniforms[uniform->firstValue + i] = context.stack[compiledNode.outputs[i]];
+		}
+	}
+}
 
-		currentStartNodeId = nextGlobalNodeId;
+// Global nodes of a segment only read the previous backup and write their own global image, prepare them concurrently.
+// The segment waits for all of them: nodes reading the whole image are the longest and are started first.
+// The threads are split between the nodes prepared together, so that their own loops don't spawn more threads.
+void prepareGlobalNodes(const CompiledGraph& compiledGraph, std::vector<uint>& nodeIds, const Region& region, SharedContext& sharedContext){
+	std::stable_sort(nodeIds.begin(), nodeIds.end(), [&compiledGraph](uint a, uint b){
+		return compiledGraph.nodes[a].node->access() > compiledGraph.nodes[b].node->access();
+	});
+	const uint nodeCount = ( uint )nodeIds.size();
+	std::atomic<uint> nextNode{0u};
+	auto prepareNodes = [&compiledGraph, &nodeIds, &region, &sharedContext, &nextNode, nodeCount](size_t){
+		for(uint i = nextNode++; i < nodeCount; i = nextNode++){
+			const CompiledNode& compiledNode = compiledGraph.nodes[nodeIds[i]];
+			Profiler::Scope scope([&compiledNode](){ return "Prepare " + compiledNode.node->name(); }, "prepare");
+			compiledNode.node->prepare(sharedContext, compiledNode.inputs, region);
+		}
+	};
+	const uint threadCount = System::availableThreadCount();
+	const uint workerCount = (std::min)(threadCount, nodeCount);
+	if(workerCount > 1u){
+		System::forParallel(0, workerCount, [&prepareNodes, threadCount, workerCount](size_t worker){
+			System::ThreadBudgetScope budget(threadCount / workerCount + (worker < threadCount % workerCount ? 1u : 0u));
+			prepareNodes(worker);
+		});
+	} else {
+		prepareNodes(0);
+	}
+}
+
+// Find the pixels read by the probed uniform nodes of each segment.
+void computeSegmentProbes(const CompiledGraph& compiledGraph, const SharedContext& sharedContext, const std::vector<uint>& segmentStarts, std::vector<Region>& probes){
+	const uint compiledNodeCount = ( uint )compiledGraph.nodes.size();
+	const Region fullRegion = Region::full(sharedContext.dims);
+	probes.assign(segmentStarts.size(), Region());
+	for(const CompiledUniform& uniform : compiledGraph.uniforms){
+		if(!uniform.probed || uniform.index >= compiledNodeCount){
+			continue;
+		}
+		const uint segmentId = uint(std::upper_bound(segmentStarts.begin(), segmentStarts.end(), uniform.index) - segmentStarts.begin()) - 1u;
+		probes[segmentId] = Region::hull(probes[segmentId], uniform.node.node->footprint(fullRegion, sharedContext));
+	}
+}
+
+// Split the graph in segments starting at each flushing global node, and find the region each segment has to evaluate
+// so that the requested region of the outputs is complete. Regions are propagated backward: a segment provides
+// the footprint of the global nodes of the next segment, and the pixels of all registers backed up before it.
+// Demands also contain the pixels read by the probed uniform nodes of each segment.
+void computeSegmentRegions(const CompiledGraph& compiledGraph, const SharedContext& sharedContext, std::vector<uint>& segmentStarts, std::vector<Region>& regions, std::vector<Region>& demands){
+	const uint compiledNodeCount = ( uint )compiledGraph.nodes.size();
+	segmentStarts.clear();
+	std::vector<bool> hasOutputs;
+	for(uint nodeId = 0u; nodeId < compiledNodeCount; ++nodeId){
+		const Node* node = compiledGraph.nodes[nodeId].node;
+		if(nodeId == 0u || compiledGraph.startsSegment(nodeId)){
+			segmentStarts.push_back(nodeId);
+			hasOutputs.push_back(false);
+		}
+		if(node->type() == NodeClass::OUTPUT_IMG){
+			hasOutputs.back() = true;
+		}
+	}
+	const Region fullRegion = Region::full(sharedContext.dims);
+	const Region requested = sharedContext.region.empty() ? fullRegion : sharedContext.region.clamped(sharedContext.dims);
+
+	const uint segmentCount = ( uint )segmentStarts.size();
+	std::vector<Region> probes;
+	computeSegmentProbes(compiledGraph, sharedContext, segmentStarts, probes);
+
+	regions.assign(segmentCount, Region());
+	demands.assign(segmentCount, Region());
+	for(uint segmentId = segmentCount; segmentId-- > 0u;){
+		Region& region = regions[segmentId];
+		if(hasOutputs[segmentId]){
+			region = requested;
+		}
+		if(segmentId + 1u < segmentCount){
+			const Region& nextDemand = demands[segmentId + 1u];
+			if(!nextDemand.empty()){
+				region = Region::hull(region, nextDemand);
+				// The next segment can contain other global nodes reading the same backup.
+				const uint nextEnd = segmentId + 2u < segmentCount ? segmentStarts[segmentId + 2u] : compiledNodeCount;
+				for(uint nodeId = segmentStarts[segmentId + 1u]; nodeId < nextEnd; ++nodeId){
+					const Node* node = compiledGraph.nodes[nodeId].node;
+					if(node->global()){
+						region = Region::hull(region, node->footprint(nextDemand, sharedContext));
+					}
+				}
+			}
+		}
+		region = region.clamped(sharedContext.dims);
+		demands[segmentId] = Region::hull(region, probes[segmentId]).clamped(sharedContext.dims);
+	}
+}
+
+void evaluateGraphForBatchOptimized(const CompiledGraph& compiledGraph, SharedContext& sharedContext){
+	const uint compiledNodeCount = ( uint )compiledGraph.nodes.size();
+
+	std::chrono::time_point<std::chrono::high_resolution_clock> start = std::chrono::high_resolution_clock::now();
+
+	std::vector<uint> segmentStarts;
+	std::vector<Region> regions;
+	std::vector<Region> demands;
+	computeSegmentRegions(compiledGraph, sharedContext, segmentStarts, regions, demands);
+
+	LocalContext uniformContext(&sharedContext, {0, 0}, compiledGraph.stackSize);
+	std::vector<uint> preparedNodes;
+	const uint segmentCount = ( uint )segmentStarts.size();
+	for(uint segmentId = 0u; segmentId < segmentCount; ++segmentId){
+		const uint currentStartNodeId = segmentStarts[segmentId];
+		const uint nextGlobalNodeId = segmentId + 1u < segmentCount ? segmentStarts[segmentId + 1u] : compiledNodeCount;
+		// Now we have a range [currentStartNode, nextGlobalNodeId[ to execute per-pixel.
+		// Global nodes are the first one, and possibly other global nodes reading the same backup.
+		// These nodes can work on the whole image at once, in a non-trivially-parallelizable way.
+		// They require some internal storage (from their prepare call to their evaluate call)
+		// We can't use tmpImagesWrite because another thread might have overwritten the value of a neighboring pixel in it
+		// before the current thread read its neighbors pixels.
+		// We could
+		// * allocate the storage in the prepare call: this puts large data on the node
+		// * have the caller setup images outside the external loop. In each loop, each prepared global node has its own image.
+		if(!demands[segmentId].empty()){
+			preparedNodes.clear();
+			for(uint nodeId = currentStartNodeId; nodeId < nextGlobalNodeId; ++nodeId){
+				if(compiledGraph.nodes[nodeId].node->access() > Access::REMAP){
+					preparedNodes.push_back(nodeId);
+				}
+			}
+			prepareGlobalNodes(compiledGraph, preparedNodes, demands[segmentId], sharedContext);
+			evaluateUniformsForSegment(compiledGraph, currentStartNodeId, nextGlobalNodeId, uniformContext);
+		}
+		{
+			Profiler::Scope scope([currentStartNodeId, nextGlobalNodeId](){ return "Segment " + std::to_string(currentStartNodeId) + "-" + std::to_string(nextGlobalNodeId - 1u); }, "segment");
+			// Only evaluate the pixels needed by the next segments.
+			evaluateSegmentForRegion(compiledGraph, currentStartNodeId, nextGlobalNodeId, regions[segmentId], sharedContext);
+		}
+
+		std::swap(sharedContext.tmpImagesRead, sharedContext.tmpImagesWrite);
 	}
 
 	std::chrono::time_point<std::chrono::high_resolution_clock> end = std::chrono::high_resolution_clock::now();
@@ -845,84 +1582,805 @@ void evaluateGraphForBatchOptimized(const CompiledGraph& compiledGraph, SharedCo
 	Log::Info() << "Batch took " << duration << "ms." << std::endl;
 }
 
-void saveContextForBatch(const Batch& batch, const SharedContext& context){
+// Evaluate a segment on the regions of several batches at once, with one parallel loop over the rows of all of them.
+void evaluateSegmentForLayers(const CompiledGraph& compiledGraph, uint firstNodeId, uint endNodeId, const std::vector<const Region*>& regions, std::vector<SharedContext>& contexts){
+	const uint layerCount = ( uint )contexts.size();
+	if(Profiler::enabled()){
+		for(uint layerId = 0u; layerId < layerCount; ++layerId){
+			evaluateSegmentForRegion(compiledGraph, firstNodeId, endNodeId, *regions[layerId], contexts[layerId]);
+		}
+		return;
+	}
+	// First row of each layer in the packed rows.
+	std::vector<size_t> rowOffsets(layerCount + 1u, 0u);
+	for(uint layerId = 0u; layerId < layerCount; ++layerId){
+		const Region& region = *regions[layerId];
+		rowOffsets[layerId + 1u] = rowOffsets[layerId] + (region.empty() ? 0u : size_t(region.size().y));
+	}
+#ifdef PARALLEL_FOR
+	System::forParallel(0, rowOffsets.back(), [&contexts, &regions, &rowOffsets, firstNodeId, endNodeId, &compiledGraph](size_t row){
+#else
+	for(size_t row = 0u; row < rowOffsets.back(); ++row){
+#endif
+		const uint layerId = uint(std::upper_bound(rowOffsets.begin(), rowOffsets.end(), row) - rowOffsets.begin()) - 1u;
+		const Region& region = *regions[layerId];
+		const uint y = region.min.y + uint(row - rowOffsets[layerId]);
+		for( uint x = region.min.x; x < uint(region.max.x); ++x ){
+			LocalContext context(&contexts[layerId], {x,y}, compiledGraph.stackSize);
+			for(uint nodeId = firstNodeId; nodeId < endNodeId; ++nodeId){
+				const CompiledNode& compiledNode = compiledGraph.nodes[nodeId];
+				compiledNode.node->evaluate(context, compiledNode.inputs, compiledNode.outputs);
+			}
+		}
+	}
+#ifdef PARALLEL_FOR
+	);
+#endif
+}
+
+// Evaluate the graph for several small batches as if they were layers of a single image: for each segment, the layers
+// are prepared concurrently, then all their pixels are evaluated in a single parallel loop.
+void evaluateGraphForBatchesPacked(const CompiledGraph& compiledGraph, std::vector<SharedContext>& contexts){
+	const uint compiledNodeCount = ( uint )compiledGraph.nodes.size();
+	const uint layerCount = ( uint )contexts.size();
+
+	std::chrono::time_point<std::chrono::high_resolution_clock> start = std::chrono::high_resolution_clock::now();
+
+	// Segments only depend on the graph, their regions on the resolution of each layer.
+	std::vector<uint> segmentStarts;
+	std::vector<std::vector<Region>> regions(layerCount);
+	std::vector<std::vector<Region>> demands(layerCount);
+	std::vector<LocalContext> uniformContexts;
+	uniformContexts.reserve(layerCount);
+	for(uint layerId = 0u; layerId < layerCount; ++layerId){
+		computeSegmentRegions(compiledGraph, contexts[layerId], segmentStarts, regions[layerId], demands[layerId]);
+		uniformContexts.emplace_back(&contexts[layerId], glm::vec2(0.0f), compiledGraph.stackSize);
+	}
+
+	std::vector<const Region*> segmentRegions(layerCount);
+	const uint segmentCount = ( uint )segmentStarts.size();
+	for(uint segmentId = 0u; segmentId < segmentCount; ++segmentId){
+		const uint currentStartNodeId = segmentStarts[segmentId];
+		const uint nextGlobalNodeId = segmentId + 1u < segmentCount ? segmentStarts[segmentId + 1u] : compiledNodeCount;
+		// Each layer is prepared on a single thread, layers are spread over threads.
+		System::forParallel(0, layerCount, [&compiledGraph, &contexts, &demands, &uniformContexts, segmentId, currentStartNodeId, nextGlobalNodeId](size_t layerId){
+			const Region& demand = demands[layerId][segmentId];
+			if(demand.empty()){
+				return;
+			}
+			System::SerialScope serial;
+			std::vector<uint> preparedNodes;
+			for(uint nodeId = currentStartNodeId; nodeId < nextGlobalNodeId; ++nodeId){
+				if(compiledGraph.nodes[nodeId].node->access() > Access::REMAP){
+					preparedNodes.push_back(nodeId);
+				}
+			}
+			prepareGlobalNodes(compiledGraph, preparedNodes, demand, contexts[layerId]);
+			evaluateUniformsForSegment(compiledGraph, currentStartNodeId, nextGlobalNodeId, uniformContexts[layerId]);
+		});
+		{
+			Profiler::Scope scope([currentStartNodeId, nextGlobalNodeId](){ return "Segment " + std::to_string(currentStartNodeId) + "-" + std::to_string(nextGlobalNodeId - 1u); }, "segment");
+			for(uint layerId = 0u; layerId < layerCount; ++layerId){
+				segmentRegions[layerId] = &regions[layerId][segmentId];
+			}
+			evaluateSegmentForLayers(compiledGraph, currentStartNodeId, nextGlobalNodeId, segmentRegions, contexts);
+		}
+		for(SharedContext& context : contexts){
+			std::swap(context.tmpImagesRead, context.tmpImagesWrite);
+		}
+	}
+
+	std::chrono::time_point<std::chrono::high_resolution_clock> end = std::chrono::high_resolution_clock::now();
+	const long long duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+	Log::Info() << "Batches took " << duration << "ms (" << layerCount << " packed)." << std::endl;
+}
+
+// Evaluate a graph split in segments tile by tile, starting from the tiles of the outputs and pulling on demand
+// the tiles of the previous segments they depend on. Each tile of a segment is evaluated at most once, and the images
+// written by a segment are recycled for other segments as soon as all the tiles of the next segment are evaluated.
+class TiledEvaluator {
+public:
+
+	TiledEvaluator(const CompiledGraph& compiledGraph, SharedContext& sharedContext, uint tileSize, size_t memoryBudget);
+
+	void evaluate();
+
+	size_t imageBytes() const { return _imageBytes; }
+
+private:
+
+	struct Segment {
+		uint firstNodeId{0u};
+		uint endNodeId{0u};
+		// Registers backed up for the next segment, and storage of the prepared node.
+		std::vector<Image> images;
+		std::vector<Image> globals;
+		std::vector<bool> computed;
+		// Tiles requested by the next segment and the outputs, known in advance.
+		std::vector<bool> needed;
+		uint remainingTiles{0u};
+		bool active{false};
+		bool hasOutputs{false};
+		bool hasPrepare{false};
+		// Some nodes are prepared once for the whole image instead of for each tile.
+		bool hasWholePrepare{false};
+	};
+
+	template<typename Func>
+	void forEachTile(const Region& region, const Func& func) const {
+		const Region clamped = region.clamped(_context.dims);
+		if(clamped.empty()){
+			return;
+		}
+		const glm::ivec2 first = clamped.min / int(_tileSize);
+		const glm::ivec2 last = (clamped.max - 1) / int(_tileSize);
+		for(int y = first.y; y <= last.y; ++y){
+			for(int x = first.x; x <= last.x; ++x){
+				func(uint(y) * _tileCount.x + uint(x));
+			}
+		}
+	}
+
+	Region tileRegion(uint tileId) const;
+
+	// Pixels of the previous segment read to evaluate a region of a segment.
+	Region inputRegion(uint segmentId, const Region& region) const;
+
+	// Pixels of the previous segment read to prepare the segment and evaluate its uniforms.
+	Region setupRegion(uint segmentId) const;
+
+	void setupUntil(uint segmentId);
+
+	void setup(uint segmentId);
+
+	void computeTile(uint segmentId, uint tileId);
+
+	void pullTiles(uint segmentId, const Region& region);
+
+	void prepare(uint segmentId, const Region& region, bool whole);
+
+	void allocate(uint segmentId);
+
+	void swapImages(uint segmentId);
+
+	std::vector<Image> acquire(std::vector<std::vector<Image>>& pool, const std::vector<Image::Storage>& storages);
+
+	void recycle(std::vector<std::vector<Image>>& pool, std::vector<Image>& images);
+
+	const CompiledGraph& _graph;
+	SharedContext& _context;
+	LocalContext _uniformContext;
+	MemoryBudget _budget;
+	std::vector<Segment> _segments;
+	std::vector<Region> _probes;
+	std::vector<uint> _preparedNodes;
+	std::vector<Image::Storage> _storages;
+	std::vector<Image::Storage> _globalStorages;
+	std::vector<std::vector<Image>> _freeImages;
+	std::vector<std::vector<Image>> _freeGlobals;
+	Region _requested;
+	glm::uvec2 _tileCount{0u, 0u};
+	uint _tileSize;
+	uint _nextSetup{0u};
+	size_t _imageBytes{0u};
+};
+
+TiledEvaluator::TiledEvaluator(const CompiledGraph& compiledGraph, SharedContext& sharedContext, uint tileSize, size_t memoryBudget) :
+	_graph(compiledGraph), _context(sharedContext), _uniformContext(&sharedContext, {0, 0}, compiledGraph.stackSize), _budget(memoryBudget), _tileSize(tileSize) {
+
+	const uint compiledNodeCount = ( uint )compiledGraph.nodes.size();
+	std::vector<uint> segmentStarts;
+	std::vector<Region> regions;
+	std::vector<Region> demands;
+	computeSegmentRegions(compiledGraph, sharedContext, segmentStarts, regions, demands);
+	computeSegmentProbes(compiledGraph, sharedContext, segmentStarts, _probes);
+
+	// Images already allocated for the batch count against the budget,
+	// and the tmp images are reused for the first segments.
+	for(const std::vector<Image>* images : { &sharedContext.inputImages, &sharedContext.outputImages, &sharedContext.tmpImagesWrite, &sharedContext.tmpImagesGlobal }){
+		for(const Image& image : *images){
+			_budget.reserve(image.w(), image.h(), image.storage());
+		}
+	}
+	for(const Image& image : sharedContext.tmpImagesWrite){
+		_storages.push_back(image.storage());
+		_imageBytes += Image::byteSize(image.w(), image.h(), image.storage());
+	}
+	for(const Image& image : sharedContext.tmpImagesGlobal){
+		_globalStorages.push_back(image.storage());
+		_imageBytes += Image::byteSize(image.w(), image.h(), image.storage());
+	}
+	recycle(_freeImages, sharedContext.tmpImagesWrite);
+	recycle(_freeGlobals, sharedContext.tmpImagesGlobal);
+	sharedContext.tmpImagesRead.clear();
+
+	_tileCount = (glm::uvec2(sharedContext.dims) + _tileSize - 1u) / _tileSize;
+	const uint tileTotal = _tileCount.x * _tileCount.y;
+	const uint segmentCount = ( uint )segmentStarts.size();
+	_segments.resize(segmentCount);
+	for(uint segmentId = 0u; segmentId < segmentCount; ++segmentId){
+		Segment& segment = _segments[segmentId];
+		segment.firstNodeId = segmentStarts[segmentId];
+		segment.endNodeId = segmentId + 1u < segmentCount ? segmentStarts[segmentId + 1u] : compiledNodeCount;
+		segment.active = !demands[segmentId].empty();
+		segment.computed.assign(tileTotal, false);
+		segment.needed.assign(tileTotal, false);
+		for(uint nodeId = segment.firstNodeId; nodeId < segment.endNodeId; ++nodeId){
+			const Node* node = compiledGraph.nodes[nodeId].node;
+			segment.hasOutputs = segment.hasOutputs || node->type() == NodeClass::OUTPUT_IMG;
+			segment.hasPrepare = segment.hasPrepare || node->access() > Access::REMAP;
+			segment.hasWholePrepare = segment.hasWholePrepare || node->access() > Access::STENCIL;
+		}
+	}
+
+	// Find backward the tiles each segment will be asked for.
+	_requested = sharedContext.region.empty() ? Region::full(sharedContext.dims) : sharedContext.region.clamped(sharedContext.dims);
+	for(uint segmentId = segmentCount; segmentId-- > 0u;){
+		Segment& segment = _segments[segmentId];
+		auto markTile = [&segment](uint tileId){
+			segment.needed[tileId] = true;
+		};
+		if(segment.hasOutputs){
+			forEachTile(_requested, markTile);
+		}
+		if(segmentId + 1u < segmentCount && _segments[segmentId + 1u].active){
+			const Segment& next = _segments[segmentId + 1u];
+			for(uint tileId = 0u; tileId < tileTotal; ++tileId){
+				if(next.needed[tileId]){
+					forEachTile(inputRegion(segmentId + 1u, tileRegion(tileId)), markTile);
+				}
+			}
+			forEachTile(setupRegion(segmentId + 1u), markTile);
+		}
+		segment.remainingTiles = uint(std::count(segment.needed.begin(), segment.needed.end(), true));
+	}
+}
+
+void TiledEvaluator::evaluate(){
+	const uint segmentCount = ( uint )_segments.size();
+	for(uint segmentId = 0u; segmentId < segmentCount; ++segmentId){
+		if(_segments[segmentId].hasOutputs){
+			forEachTile(_requested, [this, segmentId](uint tileId){
+				computeTile(segmentId, tileId);
+			});
+		}
+	}
+}
+
+Region TiledEvaluator::tileRegion(uint tileId) const {
+	const glm::ivec2 tile(tileId % _tileCount.x, tileId / _tileCount.x);
+	const glm::ivec2 min = tile * int(_tileSize);
+	return Region(min, min + int(_tileSize)).clamped(_context.dims);
+}
+
+Region TiledEvaluator::inputRegion(uint segmentId, const Region& region) const {
+	const Segment& segment = _segments[segmentId];
+	Region input = region;
+	for(uint nodeId = segment.firstNodeId; nodeId < segment.endNodeId; ++nodeId){
+		const Node* node = _graph.nodes[nodeId].node;
+		if(node->global()){
+			input = Region::hull(input, node->footprint(region, _context));
+		}
+	}
+	return input.clamped(_context.dims);
+}
+
+Region TiledEvaluator::setupRegion(uint segmentId) const {
+	Region region;
+	if(_segments[segmentId].hasWholePrepare){
+		region = inputRegion(segmentId, Region::full(_context.dims));
+	}
+	if(!_probes[segmentId].empty()){
+		region = Region::hull(region, inputRegion(segmentId, _probes[segmentId]));
+	}
+	return region;
+}
+
+void TiledEvaluator::setupUntil(uint segmentId){
+	// Uniform nodes read the registers of the previous ones, segments are set up in order.
+	while(_nextSetup <= segmentId){
+		setup(_nextSetup);
+		++_nextSetup;
+	}
+}
+
+void TiledEvaluator::setup(uint segmentId){
+	const Segment& segment = _segments[segmentId];
+	if(!segment.active){
+		return;
+	}
+	if(segmentId > 0u){
+		pullTiles(segmentId - 1u, setupRegion(segmentId));
+	}
+	allocate(segmentId);
+	swapImages(segmentId);
+	prepare(segmentId, Region::full(_context.dims), true);
+	if(!_probes[segmentId].empty()){
+		prepare(segmentId, _probes[segmentId], false);
+	}
+	evaluateUniformsForSegment(_graph, segment.firstNodeId, segment.endNodeId, _uniformContext);
+	swapImages(segmentId);
+}
+
+void TiledEvaluator::computeTile(uint segmentId, uint tileId){
+	Segment& segment = _segments[segmentId];
+	if(segment.computed[tileId]){
+		return;
+	}
+	assert(segment.active && segment.needed[tileId]);
+	setupUntil(segmentId);
+
+	const Region region = tileRegion(tileId);
+	if(segmentId > 0u){
+		pullTiles(segmentId - 1u, inputRegion(segmentId, region));
+	}
+	allocate(segmentId);
+	swapImages(segmentId);
+	prepare(segmentId, region, false);
+	evaluateSegmentForRegion(_graph, segment.firstNodeId, segment.endNodeId, region, _context);
+	swapImages(segmentId);
+
+	segment.computed[tileId] = true;
+	// Once complete, the segment doesn't read its prepared data nor the previous segment anymore.
+	if(--segment.remainingTiles == 0u){
+		recycle(_freeGlobals, segment.globals);
+		if(segmentId > 0u){
+			recycle(_freeImages, _segments[segmentId - 1u].images);
+		}
+	}
+}
+
+void TiledEvaluator::pullTiles(uint segmentId, const Region& region){
+	forEachTile(region, [this, segmentId](uint tileId){
+		computeTile(segmentId, tileId);
+	});
+}
+
+void TiledEvaluator::prepare(uint segmentId, const Region& region, bool whole){
+	const Segment& segment = _segments[segmentId];
+	_preparedNodes.clear();
+	for(uint nodeId = segment.firstNodeId; nodeId < segment.endNodeId; ++nodeId){
+		const Access access = _graph.nodes[nodeId].node->access();
+		// Remaps directly read the backup, stencils only need the pixels around the region.
+		if(access > Access::REMAP && (access > Access::STENCIL) == whole){
+			_preparedNodes.push_back(nodeId);
+		}
+	}
+	if(!_preparedNodes.empty()){
+		prepareGlobalNodes(_graph, _preparedNodes, region, _context);
+	}
+}
+
+void TiledEvaluator::allocate(uint segmentId){
+	Segment& segment = _segments[segmentId];
+	// The last segment has no backup to write.
+	if(segment.images.empty() && segmentId + 1u < _segments.size()){
+		segment.images = acquire(_freeImages, _storages);
+	}
+	if(segment.globals.empty() && segment.hasPrepare){
+		segment.globals = acquire(_freeGlobals, _globalStorages);
+	}
+}
+
+void TiledEvaluator::swapImages(uint segmentId){
+	Segment& segment = _segments[segmentId];
+	std::swap(_context.tmpImagesWrite, segment.images);
+	std::swap(_context.tmpImagesGlobal, segment.globals);
+	if(segmentId > 0u){
+		std::swap(_context.tmpImagesRead, _segments[segmentId - 1u].images);
+	}
+}
+
+std::vector<Image> TiledEvaluator::acquire(std::vector<std::vector<Image>>& pool, const std::vector<Image::Storage>& storages){
+	if(!pool.empty()){
+		std::vector<Image> images = std::move(pool.back());
+		pool.pop_back();
+		return images;
+	}
+	const uint w = _context.dims.x;
+	const uint h = _context.dims.y;
+	std::vector<Image> images;
+	for(Image::Storage storage : storages){
+		images.emplace_back(w, h, storage, glm::vec4(0.0f), !_budget.reserve(w, h, storage));
+		_imageBytes += Image::byteSize(w, h, storage);
+	}
+	return images;
+}
+
+void TiledEvaluator::recycle(std::vector<std::vector<Image>>& pool, std::vector<Image>& images){
+	if(!images.empty()){
+		pool.push_back(std::move(images));
+		images.clear();
+	}
+}
+
+size_t evaluateGraphForBatchTiled(const CompiledGraph& compiledGraph, SharedContext& sharedContext, uint tileSize, size_t memoryBudget){
+	std::chrono::time_point<std::chrono::high_resolution_clock> start = std::chrono::high_resolution_clock::now();
+
+	TiledEvaluator evaluator(compiledGraph, sharedContext, tileSize, memoryBudget);
+	evaluator.evaluate();
+
+	std::chrono::time_point<std::chrono::high_resolution_clock> end = std::chrono::high_resolution_clock::now();
+	const long long duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+	Log::Info() << "Batch took " << duration << "ms (tiled)." << std::endl;
+	return evaluator.imageBytes();
+}
+
+bool canStreamGraph(const CompiledGraph& compiledGraph){
+	// Without any global node, each pixel only depends on the inputs at the same location.
+	for(const CompiledNode& compiledNode : compiledGraph.nodes){
+		if(compiledNode.node->global()){
+			return false;
+		}
+	}
+	return compiledGraph.tmpGlobalImageCount == 0u;
+}
+
+double millisecondsSince(const std::chrono::steady_clock::time_point& start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void evaluateGraphForBatchStreamed(const Batch& batch, const CompiledGraph& compiledGraph, const EvaluationSettings& settings, SharedContext& sharedContext, BatchReport& report){
+	std::chrono::steady_clock::time_point stageStart = std::chrono::steady_clock::now();
+	MemoryBudget budget(settings.memoryBudget);
+	loadInputsForBatch(batch, compiledGraph, settings, budget, sharedContext, {INT_MAX, INT_MAX});
+	report.decodeMs = millisecondsSince(stageStart);
+
+	std::chrono::time_point<std::chrono::high_resolution_clock> start = std::chrono::high_resolution_clock::now();
+
+	// Only the requested region is evaluated and saved.
+	sharedContext.region = outputRegion(settings, sharedContext.dims);
+	const Region& region = sharedContext.region;
+	const uint w = region.size().x;
+	const uint h = region.size().y;
+	const uint stripHeight = glm::clamp(kStreamingStripPixelCount / (std::max)(w, 1u), 1u, (std::max)(h, 1u));
+	const uint outputCountInBatch = ( uint )batch.outputs.size();
+	const uint compiledNodeCount = ( uint )compiledGraph.nodes.size();
+
+	// Outputs only store the current strip. PNG files are encoded incrementally,
+	// other formats are accumulated in a full image.
+	std::vector<std::unique_ptr<PNGWriter>> writers(outputCountInBatch);
+	std::vector<Image> fullOutputs;
+	for(uint i = 0u; i < outputCountInBatch; ++i){
+		const Batch::Output& output = batch.outputs[i];
+		const Image::Storage storage = outputStorage(output, settings.precise);
+		sharedContext.outputImages.emplace_back(w, stripHeight, storage);
+		if(output.format == Image::Format::PNG){
+			fs::path dstPath = output.path;
+			dstPath.replace_extension("png");
+			writers[i].reset(new PNGWriter());
+			if(writers[i]->open(dstPath, w, h, settings.compressionLevel)){
+				fullOutputs.emplace_back();
+				continue;
+			}
+			writers[i].reset();
+		}
+		fullOutputs.emplace_back(w, h, storage, glm::vec4(0.0f), !budget.reserve(w, h, storage));
+	}
+
+	sharedContext.uniforms.assign(compiledGraph.uniformValueCount, 0.0f);
+	{
+		LocalContext uniformContext(&sharedContext, {0, 0}, compiledGraph.stackSize);
+		evaluateUniformsForSegment(compiledGraph, 0u, compiledNodeCount, uniformContext);
+	}
+
+	std::vector<uchar> ldrRows;
+	for(uint y = 0u; y < h; y += stripHeight){
+		const uint rowCount = (std::min)(stripHeight, h - y);
+		const glm::ivec2 stripOrigin = region.min + glm::ivec2(0, y);
+		sharedContext.outputOrigin = stripOrigin;
+		stageStart = std::chrono::steady_clock::now();
+		{
+			Profiler::Scope scope([&stripOrigin, rowCount](){ return "Strip " + std::to_string(stripOrigin.y) + "-" + std::to_string(stripOrigin.y + rowCount - 1u); }, "segment");
+			evaluateSegmentForRegion(compiledGraph, 0u, compiledNodeCount, Region(stripOrigin, stripOrigin + glm::ivec2(w, rowCount)), sharedContext);
+		}
+		report.computeMs += millisecondsSince(stageStart);
+
+		stageStart = std::chrono::steady_clock::now();
+		for(uint i = 0u; i < outputCountInBatch; ++i){
+			const Image& strip = sharedContext.outputImages[i];
+			Profiler::Scope scope([&batch, i](){ return "Encode " + batch.outputs[i].path.filename().string(); }, "io");
+			if(writers[i]){
+				ldrRows.resize(size_t(w) * rowCount * 4u);
+				strip.getLDRRows(0u, rowCount, ldrRows.data());
+				writers[i]->write(ldrRows.data(), rowCount);
+			} else {
+				fullOutputs[i].copyRows(strip, 0u, y, rowCount);
+			}
+		}
+		report.encodeMs += millisecondsSince(stageStart);
+	}
+	sharedContext.outputOrigin = {0, 0};
+
+	stageStart = std::chrono::steady_clock::now();
+	for(uint i = 0u; i < outputCountInBatch; ++i){
+		Profiler::Scope scope([&batch, i](){ return "Encode " + batch.outputs[i].path.filename().string(); }, "io");
+		if(writers[i]){
+			writers[i]->close();
+		} else {
+			fullOutputs[i].save(batch.outputs[i].path, batch.outputs[i].format, settings.compressionLevel, batch.outputs[i].exr);
+		}
+	}
+	report.encodeMs += millisecondsSince(stageStart);
+
+	std::chrono::time_point<std::chrono::high_resolution_clock> end = std::chrono::high_resolution_clock::now();
+	const long long duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+	Log::Info() << "Batch took " << duration << "ms (streamed)." << std::endl;
+}
+
+void saveContextForBatch(const Batch& batch, const SharedContext& context, const EvaluationSettings& settings){
 	// Save outputs
 	for (uint i = 0u; i < batch.outputs.size(); ++i) {
 		const Batch::Output& output = batch.outputs[i];
-		context.outputImages[i].save(output.path, output.format);
+		Profiler::Scope scope([&output](){ return "Encode " + output.path.filename().string(); }, "io");
+		context.outputImages[i].save(output.path, output.format, settings.compressionLevel, output.exr);
 	}
 }
 
+size_t tmpImagesByteSize(const SharedContext& context){
+	size_t size = 0u;
+	for(const std::vector<Image>* images : { &context.tmpImagesRead, &context.tmpImagesWrite, &context.tmpImagesGlobal }){
+		for(const Image& image : *images){
+			size += Image::byteSize(image.w(), image.h(), image.storage());
+		}
+	}
+	return size;
+}
 
-bool evaluate(const Graph& editGraph, ErrorContext& errors, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const glm::ivec2& outputRes, Image::Filter filterOutputRes, bool forceOutputRes){
+void evaluateBatch(const Batch& batch, const CompiledGraph& compiledGraph, const EvaluationSettings& settings, bool streamed, EvaluationReport& report){
+	BatchReport& batchReport = report.batches.emplace_back();
+	batchReport.streamed = streamed;
+	batchReport.tiled = !streamed && settings.tileSize != 0u;
+
+	SharedContext sharedContext;
+	sharedContext.batch = uint(report.batches.size() - 1u);
+	if(streamed){
+		evaluateGraphForBatchStreamed(batch, compiledGraph, settings, sharedContext, batchReport);
+	} else {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		allocateContextForBatch(batch, compiledGraph, settings, sharedContext);
+		batchReport.decodeMs = millisecondsSince(start);
+
+		size_t tmpImageBytes = tmpImagesByteSize(sharedContext);
+		start = std::chrono::steady_clock::now();
+		if(batchReport.tiled){
+			tmpImageBytes = evaluateGraphForBatchTiled(compiledGraph, sharedContext, settings.tileSize, settings.memoryBudget);
+		} else {
+			evaluateGraphForBatchOptimized(compiledGraph, sharedContext);
+		}
+		batchReport.computeMs = millisecondsSince(start);
+		report.tmpImageBytes = (std::max)(report.tmpImageBytes, tmpImageBytes);
 
-	CompiledGraph compiledGraph;
-	if(!compile(editGraph, true, errors, compiledGraph)){
-		return false;
+		start = std::chrono::steady_clock::now();
+		saveContextForBatch(batch, sharedContext, settings);
+		batchReport.encodeMs = millisecondsSince(start);
+	}
+	batchReport.resolution = sharedContext.dims;
+	// Only pixels of the requested region are produced.
+	const glm::ivec2 regionSize = sharedContext.region.size();
+	report.pixelCount += size_t(regionSize.x) * size_t(regionSize.y);
+}
+
+// Evaluate consecutive batches together, sharing each parallel loop between all of them.
+void evaluatePackedBatches(const std::vector<Batch>& batches, uint firstBatchId, uint batchCount, const CompiledGraph& compiledGraph, const EvaluationSettings& settings, EvaluationReport& report){
+	if(batchCount == 1u){
+		evaluateBatch(batches[firstBatchId], compiledGraph, settings, settings.tileSize == 0u && canStreamGraph(compiledGraph), report);
+		return;
+	}
+	const uint firstReportId = uint(report.batches.size());
+	std::vector<SharedContext> contexts(batchCount);
+	for(uint i = 0u; i < batchCount; ++i){
+		contexts[i].batch = firstReportId + i;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	System::forParallel(0, batchCount, [&batches, firstBatchId, &compiledGraph, &settings, &contexts](size_t i){
+		System::SerialScope serial;
+		allocateContextForBatch(batches[firstBatchId + i], compiledGraph, settings, contexts[i]);
+	});
+	const double decodeMs = millisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	evaluateGraphForBatchesPacked(compiledGraph, contexts);
+	const double computeMs = millisecondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	System::forParallel(0, batchCount, [&batches, firstBatchId, &settings, &contexts](size_t i){
+		System::SerialScope serial;
+		saveContextForBatch(batches[firstBatchId + i], contexts[i], settings);
+	});
+	const double encodeMs = millisecondsSince(start);
+
+	// Stages are shared, each batch is attributed an even part of them.
+	size_t tmpImageBytes = 0u;
+	for(const SharedContext& context : contexts){
+		BatchReport& batchReport = report.batches.emplace_back();
+		batchReport.resolution = context.dims;
+		batchReport.decodeMs = decodeMs / double(batchCount);
+		batchReport.computeMs = computeMs / double(batchCount);
+		batchReport.encodeMs = encodeMs / double(batchCount);
+		batchReport.packedCount = batchCount;
+		const glm::ivec2 regionSize = context.region.size();
+		report.pixelCount += size_t(regionSize.x) * size_t(regionSize.y);
+		tmpImageBytes += tmpImagesByteSize(context);
+	}
+	report.tmpImageBytes = (std::max)(report.tmpImageBytes, tmpImageBytes);
+}
+
+// Resolution of the outputs of a batch, only reading the headers of its inputs.
+glm::ivec2 batchResolution(const Batch& batch, const EvaluationSettings& settings){
+	if(settings.forceOutputRes){
+		return settings.outputRes;
+	}
+	std::vector<glm::ivec2> sizes(batch.inputs.size(), glm::ivec2(0));
+	for(size_t i = 0u; i < batch.inputs.size(); ++i){
+		uint w = 0u;
+		uint h = 0u;
+		Image::info(batch.inputs[i], w, h);
+		sizes[i] = {w, h};
+	}
+	return computeOutputResolution(sizes, settings.outputRes);
+}
+
+// Group consecutive small batches of the same resolution, and return the number of batches in each group.
+std::vector<uint> packBatches(const std::vector<Batch>& batches, const EvaluationSettings& settings){
+	const uint batchCount = ( uint )batches.size();
+	if(settings.packedPixelCount == 0u || settings.tileSize != 0u || batchCount < 2u){
+		return std::vector<uint>(batchCount, 1u);
+	}
+	std::vector<glm::ivec2> resolutions(batchCount);
+	System::forParallel(0, batchCount, [&batches, &settings, &resolutions](size_t i){
+		resolutions[i] = batchResolution(batches[i], settings);
+	});
+
+	std::vector<uint> groups;
+	for(uint batchId = 0u; batchId < batchCount;){
+		const glm::ivec2& resolution = resolutions[batchId];
+		const size_t pixelCount = size_t(resolution.x) * size_t(resolution.y);
+		uint count = 1u;
+		if(pixelCount < settings.packedPixelCount){
+			const size_t maxCount = kPackedGroupPixelCount / (std::max)(pixelCount, size_t(1u));
+			while(batchId + count < batchCount && count < maxCount && resolutions[batchId + count] == resolution){
+				++count;
+			}
+		}
+		groups.push_back(count);
+		batchId += count;
+	}
+	return groups;
+}
+
+// Compile the graph for evaluation and collect statistics before and after optimization.
+bool prepareEvaluation(const Graph& editGraph, ErrorContext& errors, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, CompiledGraph& compiledGraph, std::vector<Batch>& batches, EvaluationReport& report){
+	{
+		Profiler::Scope scope("Compile", "compile");
+		if(!compile(editGraph, true, errors, compiledGraph)){
+			return false;
+		}
+	}
+	{
+		ErrorContext unoptimizedErrors;
+		CompiledGraph unoptimizedGraph;
+		if(compile(editGraph, false, unoptimizedErrors, unoptimizedGraph)){
+			report.unoptimizedGraph = GraphStatistics(unoptimizedGraph);
+		}
 	}
+	report.optimizedGraph = GraphStatistics(compiledGraph);
 
 	if(outputDir.empty()){
 		errors.addError("Not output directory specified.");
 		return false;
 	}
-	
-	// Populate batches with file info.
-	std::vector<Batch> batches;
 
 	// Collect file nodes.
 	if(!generateBatches( compiledGraph.inputs, compiledGraph.outputs, inputPaths, outputDir, batches)){
 		errors.addError("Not enough input files.");
 		return false;
 	}
+	return true;
+}
 
-	for(const Batch& batch : batches){
-		SharedContext sharedContext;
-		allocateContextForBatch(batch, compiledGraph, outputRes, filterOutputRes, forceOutputRes, sharedContext);
+GraphStatistics::GraphStatistics(const CompiledGraph& compiledGraph) :
+	nodeCount(uint(compiledGraph.nodes.size())), uniformCount(uint(compiledGraph.uniforms.size())), stackSize(compiledGraph.stackSize), tmpImageCount(compiledGraph.tmpImageCount) {
+	for(uint nodeId = 0u; nodeId < nodeCount; ++nodeId){
+		flushCount += compiledGraph.startsSegment(nodeId) ? 1u : 0u;
+	}
+}
 
-		evaluateGraphForBatchOptimized(compiledGraph, sharedContext);
+double EvaluationReport::throughput() const {
+	return totalMs > 0.0 ? double(pixelCount) / (totalMs * 1000.0) : 0.0;
+}
 
-		saveContextForBatch(batch, sharedContext);
+void EvaluationReport::serialize(json& data) const {
+	data["success"] = success;
+	data["batchCount"] = batches.size();
+	data["pixelCount"] = pixelCount;
+	data["totalMs"] = totalMs;
+	data["megapixelsPerSecond"] = throughput();
+	data["peakMemoryBytes"] = peakMemory;
+	data["tmpImageBytes"] = tmpImageBytes;
+
+	json& batchesData = data["batches"];
+	batchesData = json::array();
+	for(const BatchReport& batch : batches){
+		json& batchData = batchesData.emplace_back();
+		batchData["resolution"] = { batch.resolution.x, batch.resolution.y };
+		batchData["decodeMs"] = batch.decodeMs;
+		batchData["computeMs"] = batch.computeMs;
+		batchData["encodeMs"] = batch.encodeMs;
+		batchData["streamed"] = batch.streamed;
+		batchData["tiled"] = batch.tiled;
+		batchData["packed"] = batch.packedCount;
 	}
 
-	return true;
+	const std::pair<const char*, const GraphStatistics*> graphs[] = { {"unoptimized", &unoptimizedGraph}, {"optimized", &optimizedGraph} };
+	for(const auto& graph : graphs){
+		json& graphData = data["graph"][graph.first];
+		graphData["nodeCount"] = graph.second->nodeCount;
+		graphData["uniformCount"] = graph.second->uniformCount;
+		graphData["flushCount"] = graph.second->flushCount;
+		graphData["stackSize"] = graph.second->stackSize;
+		graphData["tmpImageCount"] = graph.second->tmpImageCount;
+	}
 }
 
-bool evaluateInBackground(const Graph& editGraph, ErrorContext& errors, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const glm::ivec2& outputRes, Image::Filter filterOutputRes, bool forceOutputRes, std::atomic<int>& progress){
+EvaluationReport evaluate(const Graph& editGraph, ErrorContext& errors, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const EvaluationSettings& settings){
 
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	EvaluationReport report;
 	CompiledGraph compiledGraph;
-	if(!compile(editGraph, true, errors, compiledGraph)){
-		return false;
+	// Populate batches with file info.
+	std::vector<Batch> batches;
+	if(!prepareEvaluation(editGraph, errors, inputPaths, outputDir, compiledGraph, batches, report)){
+		return report;
 	}
 
-	if(outputDir.empty()){
-		errors.addError("Not output directory specified.");
-		return false;
+	// Small batches are evaluated together.
+	const std::vector<uint> groups = packBatches(batches, settings);
+	uint batchId = 0u;
+	for(uint count : groups){
+		Profiler::Scope scope([batchId, count](){ return count == 1u ? "Batch " + std::to_string(batchId) : "Batches " + std::to_string(batchId) + "-" + std::to_string(batchId + count - 1u); }, "batch");
+		evaluatePackedBatches(batches, batchId, count, compiledGraph, settings, report);
+		batchId += count;
 	}
+
+	report.totalMs = millisecondsSince(start);
+	report.peakMemory = System::peakMemoryUsage();
+	report.success = true;
+	return report;
+}
+
+bool evaluateInBackground(const Graph& editGraph, ErrorContext& errors, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const EvaluationSettings& settings, std::atomic<int>& progress, EvaluationReport& report){
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	EvaluationReport localReport;
+	CompiledGraph compiledGraph;
 	// Populate batches with file info.
 	std::vector<Batch> batches;
-
-	// Collect file nodes.
-	if(!generateBatches( compiledGraph.inputs, compiledGraph.outputs, inputPaths, outputDir, batches)){
-		errors.addError("Not enough input files.");
+	if(!prepareEvaluation(editGraph, errors, inputPaths, outputDir, compiledGraph, batches, localReport)){
 		return false;
 	}
 
+	// The report can only be read once progress is reset.
+	progress = 0;
 	// Pass local objects by copy.
-	std::thread thread([&progress, compiledGraph, batches, outputRes, filterOutputRes, forceOutputRes ](){
+	std::thread thread([&progress, &report, compiledGraph, batches, settings, localReport, start ]() mutable {
 		progress = 0;
 		const int batchCost = (int)std::floor(1.f / float(batches.size()) * kProgressCostGranularity);
-		for(const Batch& batch : batches){
+		const std::vector<uint> groups = packBatches(batches, settings);
+		uint batchId = 0u;
+		for(uint count : groups){
 			if(progress >= kProgressImmediateStop){
 				break;
 			}
-			SharedContext sharedContext;
-			allocateContextForBatch(batch, compiledGraph, outputRes, filterOutputRes, forceOutputRes, sharedContext);
-
-			evaluateGraphForBatchOptimized(compiledGraph, sharedContext);
-
-			saveContextForBatch(batch, sharedContext);
-			progress += batchCost;
+			evaluatePackedBatches(batches, batchId, count, compiledGraph, settings, localReport);
+			batchId += count;
+			progress += batchCost * int(count);
 		}
+		localReport.totalMs = millisecondsSince(start);
+		localReport.peakMemory = System::peakMemoryUsage();
+		localReport.success = localReport.batches.size() == batches.size();
+		report = localReport;
 		progress = -1;
 	});
 	thread.detach();
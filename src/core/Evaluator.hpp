@@ -45,6 +45,18 @@ struct CompiledNode {
 	std::vector<int> outputs;
 };
 
+/// Node whose outputs are the same for all pixels, evaluated once per batch before the segment containing it.
+struct CompiledUniform {
+	CompiledNode node;
+	// Position in the per-pixel nodes, where a uniform node loads the outputs if they are read by varying nodes.
+	uint index{0u};
+	// Position of the outputs in the batch uniform values.
+	uint firstValue{0u};
+	// Nodes that read varying inputs are evaluated at a single pixel, after the per-pixel nodes they depend on.
+	std::vector<uint> probe;
+	bool probed{false};
+};
+
 class CompiledGraph {
 public:
 	CompiledGraph() = default;
@@ -61,11 +73,25 @@ public:
 	uint tmpImageCount{0u};
 	uint tmpGlobalImageCount{0u};
 	int firstDummyRegister{0u};
+	// Storage precision of each tmp image, full precision if empty.
+	std::vector<Image::Storage> tmpImageStorages;
+	// Global image of each prepared node, by node id. Nodes prepared in the same segment use different images.
+	std::vector<uint> globalImageIds;
+	// Bitmask of the channels read from each input.
+	std::vector<uint> inputChannels;
+	// Nodes evaluated once per batch, in order.
+	std::vector<CompiledUniform> uniforms;
+	uint uniformValueCount{0u};
 
 	void collectInputsAndOutputs();
 
 	void ensureGlobalNodesConsistency();
 
+	/// Does the node flush the registers in flight and start a new per-pixel segment. Other global nodes read a previous flush.
+	bool startsSegment(uint nodeId) const;
+
+	void hoistUniformNodes();
+
 	void clearInternalNodes();
 
 	~CompiledGraph();
@@ -77,20 +103,100 @@ struct Batch {
 	struct Output {
 		fs::path path;
 		Image::Format format;
+		Image::EXROptions exr;
 	};
 
 	std::vector<fs::path> inputs;
 	std::vector<Output> outputs;
 };
 
+struct EvaluationSettings {
+	glm::ivec2 outputRes{64, 64};
+	Image::Filter filterOutputRes{Image::Filter::SMOOTH};
+	bool forceOutputRes{false};
+	// Store all images at full float precision.
+	bool precise{false};
+	// Size in bytes of images kept in memory, the others are stored out-of-core. Unlimited if zero.
+	size_t memoryBudget{0u};
+	// PNG compression level, from 0 (store) to 9 (slowest).
+	int compressionLevel{PNGWriter::kDefaultCompressionLevel};
+	// Use per-thread sequential random generators, results depend on the thread count and scheduling.
+	bool legacyRandom{false};
+	// Only evaluate this region of the outputs, that are cropped to it. The full image if empty.
+	Region region;
+	// Evaluate graphs tile by tile, pulling on demand the tiles each output tile depends on. Disabled if zero.
+	uint tileSize{0u};
+	// Consecutive batches of the same resolution below this pixel count are evaluated together. Disabled if zero.
+	uint packedPixelCount{kDefaultPackedPixelCount};
+
+	static const uint kDefaultTileSize = 256u;
+	static const uint kDefaultPackedPixelCount = 256u * 256u;
+};
+
+struct GraphStatistics {
+	uint nodeCount{0u};
+	uint uniformCount{0u};
+	// Global nodes backing up the registers in flight.
+	uint flushCount{0u};
+	uint stackSize{0u};
+	uint tmpImageCount{0u};
+
+	explicit GraphStatistics(const CompiledGraph& compiledGraph);
+
+	GraphStatistics() = default;
+};
+
+struct BatchReport {
+	glm::ivec2 resolution{0, 0};
+	// Wall times, decoding includes the allocation of tmp images.
+	double decodeMs{0.0};
+	double computeMs{0.0};
+	double encodeMs{0.0};
+	bool streamed{false};
+	bool tiled{false};
+	// Number of batches evaluated together with this one, including it.
+	uint packedCount{1u};
+};
+
+struct EvaluationReport {
+	std::vector<BatchReport> batches;
+	GraphStatistics unoptimizedGraph;
+	GraphStatistics optimizedGraph;
+	size_t pixelCount{0u};
+	// Largest size of tmp images allocated for a batch.
+	size_t tmpImageBytes{0u};
+	size_t peakMemory{0u};
+	double totalMs{0.0};
+	bool success{false};
+
+	/// Processed megapixels per second.
+	double throughput() const;
+
+	void serialize(json& data) const;
+
+	explicit operator bool() const { return success; }
+};
+
 bool validate(const Graph& editGraph, ErrorContext& context );
 
 bool compile( const Graph& editGraph, bool optimize, ErrorContext& context, CompiledGraph& compiledGraph );
 
-void allocateContextForBatch(const Batch& batch, const CompiledGraph& compiledGraph, const glm::ivec2& fallbackRes, Image::Filter filter, bool forceRes, SharedContext& sharedContext, const glm::ivec2& maxRes = {INT_MAX, INT_MAX});
+void allocateContextForBatch(const Batch& batch, const CompiledGraph& compiledGraph, const EvaluationSettings& settings, SharedContext& sharedContext, const glm::ivec2& maxRes = {INT_MAX, INT_MAX});
 
 void evaluateGraphStepForBatch(const CompiledNode& compiledNode, uint stackSize, SharedContext& sharedContext);
 
-bool evaluate(const Graph& editGraph, ErrorContext& context, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const glm::ivec2& outputRes, Image::Filter filterOutputRes, bool forceOutputRes);
+bool generateBatches(const std::vector<const Node*>& inputs, const std::vector<const Node*>& outputs, const std::vector<fs::path>& inputPaths, const fs::path& outputPath, std::vector<Batch>& batches);
+
+void evaluateGraphForBatchOptimized(const CompiledGraph& compiledGraph, SharedContext& sharedContext);
+
+/// Evaluate the graph tile by tile, on demand from the tiles of the outputs, and return the size of the tmp images allocated.
+size_t evaluateGraphForBatchTiled(const CompiledGraph& compiledGraph, SharedContext& sharedContext, uint tileSize, size_t memoryBudget);
+
+bool canStreamGraph(const CompiledGraph& compiledGraph);
+
+void saveContextForBatch(const Batch& batch, const SharedContext& context, const EvaluationSettings& settings);
+
+EvaluationReport evaluate(const Graph& editGraph, ErrorContext& context, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const EvaluationSettings& settings);
 
-bool evaluateInBackground(const Graph& editGraph, ErrorContext& context, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const glm::ivec2& outputRes, Image::Filter filterOutputRes, bool forceOutputRes, std::atomic<int>& progress);
+/// The report is filled before progress is reset to -1, and should be kept alive until then.
+bool evaluateInBackground(const Graph& editGraph, ErrorContext& context, const std::vector<fs::path>& inputPaths, const fs::path& outputDir, const EvaluationSettings& settings, std::atomic<int>& progress, EvaluationReport& report);
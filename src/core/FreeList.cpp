@@ -1,12 +1,14 @@
 #include "core/FreeList.hpp"
 
+#include <functional>
+
 unsigned int FreeList::getIndex(){
 	if(_freeList.empty()){
 		return _maxIndex++;
 	}
-	unsigned int index = _freeList.front();
-	_freeList.pop_front();
-	// The list remains sorted.
+	std::pop_heap(_freeList.begin(), _freeList.end(), std::greater<unsigned int>());
+	unsigned int index = _freeList.back();
+	_freeList.pop_back();
 	return index;
 }
 
@@ -16,6 +18,7 @@ void FreeList::returnIndex(unsigned int id){
 		_maxIndex = id;
 		return;
 	}
-	// Otherwise, add to free list at the proper location to keep it sorted.
-	_freeList.insert(std::upper_bound(_freeList.begin(), _freeList.end(), id), id);
+	// Otherwise, add to the heap.
+	_freeList.push_back(id);
+	std::push_heap(_freeList.begin(), _freeList.end(), std::greater<unsigned int>());
 }
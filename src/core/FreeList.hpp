@@ -1,6 +1,5 @@
 #pragma once
 #include "core/Common.hpp"
-#include <list>
 
 class FreeList {
 public:
@@ -13,7 +12,7 @@ public:
 	
 private:
 
-	std::list<unsigned int> _freeList;
+	// Min-heap of returned indices, the smallest one is always reused first.
+	std::vector<unsigned int> _freeList;
 	unsigned int _maxIndex{0u};
 };
-
@@ -1,32 +1,63 @@
 #include "core/Graph.hpp"
 #include <json/json.hpp>
 #include "core/nodes/Nodes.hpp"
+#include "core/system/MappedFile.hpp"
+#include "core/system/TextUtilities.hpp"
+#include <fstream>
+#include <iomanip>
+#include <cctype>
 
 Graph::~Graph(){
 	clear();
 }
 
+namespace {
+
+	// Marks links to delete.
+	constexpr uint kSentinel = 0xFFFFFFFF;
+
+	uint64_t slotKey(uint node, uint slot){
+		return (uint64_t(node) << 32u) | uint64_t(slot);
+	}
+
+}
+
+size_t Graph::LinkHash::operator()(const Link& link) const {
+	const std::hash<uint64_t> hasher;
+	const size_t fromHash = hasher(slotKey(link.from.node, link.from.slot));
+	const size_t toHash = hasher(slotKey(link.to.node, link.to.slot));
+	return fromHash ^ (toHash + 0x9e3779b9u + (fromHash << 6u) + (fromHash >> 2u));
+}
+
 int Graph::findNode(const Node* const node){
 	if(node == nullptr)
 		return -1;
-
-	for(uint nodeIndex = 0u; nodeIndex < _nodes.size(); ++nodeIndex){
-		if(_nodes[ nodeIndex ] == node)
-			return (int)nodeIndex;
-	}
+	// Nodes know their index in the graph, but they might belong to another graph.
+	const uint nodeIndex = node->id();
+	if(nodeIndex < _nodes.size() && _nodes[nodeIndex] == node)
+		return (int)nodeIndex;
 	return -1;
 }
 
 int Graph::findLink( const Link& link ){
-	for( uint linkIndex = 0u; linkIndex < _links.size(); ++linkIndex ){
-		if( _links[ linkIndex ] == link )
-			return (int)linkIndex;
+	if(_linkIndicesDirty){
+		_linkIndices.clear();
+		_linkIndices.reserve(_links.size());
+		for(uint linkIndex = 0u; linkIndex < _links.size(); ++linkIndex){
+			// Keep the first occurrence of duplicated links.
+			_linkIndices.emplace(_links[linkIndex], linkIndex);
+		}
+		_linkIndicesDirty = false;
 	}
-	return -1;
+	auto index = _linkIndices.find(link);
+	if(index == _linkIndices.end())
+		return -1;
+	return (int)index->second;
 }
 
 uint Graph::addNode(Node* node){
 	uint index = _freeListNodes.getIndex();
+	node->_id = index;
 	if(index == _nodes.size()){
 		_nodes.push_back( node );
 	} else {
@@ -46,6 +77,9 @@ void Graph::removeNode(uint node){
 }
 
 void Graph::addLink(const Link& link){
+	if(!_linkIndicesDirty){
+		_linkIndices.emplace(link, (uint)_links.size());
+	}
 	_links.push_back(link);
 }
 
@@ -70,19 +104,22 @@ void Graph::serialize(json& data){
 bool Graph::deserialize(const json& data){
 	clear();
 
-	if(data.contains("nodes")){
+	auto nodesData = data.find("nodes");
+	if(nodesData != data.end()){
 
-		for(auto& nodeData : data["nodes"]){
+		_nodes.reserve(nodesData->size());
+		for(auto& nodeData : *nodesData){
 			// Ensure the free list is in the correct state.
-			uint nodeId =_freeListNodes.getIndex();
-			(void)nodeId;
-			if(nodeData.is_null() || !nodeData.contains("type")){
+			const uint nodeId =_freeListNodes.getIndex();
+			auto typeData = nodeData.is_object() ? nodeData.find("type") : nodeData.end();
+			if(typeData == nodeData.end()){
 				_nodes.push_back(nullptr);
 			} else {
-				uint type = nodeData["type"];
+				uint type = *typeData;
 				type = (std::min)(uint(NodeClass::COUNT_EXPOSED), type);
 				Node* node = createNode(NodeClass(type));
 				if(node){
+					node->_id = nodeId;
 					if(!node->deserialize(nodeData)){
 						delete node;
 						node = nullptr;
@@ -99,29 +136,92 @@ bool Graph::deserialize(const json& data){
 			}
 		}
 	}
-	if(data.contains("links")){
-		for(auto& linkData : data["links"]){
-			if(!linkData.contains("from") || !linkData.contains("to")){
-				continue;
-			}
-			const auto& fromData = linkData["from"];
-			if(!fromData.contains("node") || !fromData.contains("slot")){
-				continue;
-			}
-			const auto& toData = linkData["to"];
-			if(!toData.contains("node") || !toData.contains("slot")){
+	// Retrieve a slot, looking up each key once.
+	auto readSlot = [](const json& linkData, const char* key, Slot& slot){
+		auto slotData = linkData.find(key);
+		if(slotData == linkData.end()){
+			return false;
+		}
+		auto nodeData = slotData->find("node");
+		auto indexData = slotData->find("slot");
+		if(nodeData == slotData->end() || indexData == slotData->end()){
+			return false;
+		}
+		slot.node = *nodeData;
+		slot.slot = *indexData;
+		return true;
+	};
+
+	auto linksData = data.find("links");
+	if(linksData != data.end()){
+		_links.reserve(linksData->size());
+		for(auto& linkData : *linksData){
+			Link link;
+			if(!readSlot(linkData, "from", link.from) || !readSlot(linkData, "to", link.to)){
 				continue;
 			}
-			Link& link = _links.emplace_back();
-			link.from.node = fromData["node"];
-			link.from.slot = fromData["slot"];
-			link.to.node = toData["node"];
-			link.to.slot = toData["slot"];
+			_links.push_back(link);
 		}
 	}
+	_linkIndicesDirty = true;
 	return true;
 }
 
+bool Graph::load(const fs::path& path, json& data){
+	MappedFile file;
+	if(!file.open(path)){
+		return false;
+	}
+	const uchar* begin = file.data();
+	const uchar* end = begin + file.size();
+	// A serialized graph is always a map, whose first byte differs between encodings.
+	const uchar* first = begin;
+	while(first != end && std::isspace(*first)){
+		++first;
+	}
+	if(first == end){
+		return false;
+	}
+	if(*first >= 0xA0 && *first <= 0xBF){
+		data = json::from_cbor(begin, end, true, false);
+	} else if((*first >= 0x80 && *first <= 0x8F) || *first == 0xDE || *first == 0xDF){
+		data = json::from_msgpack(begin, end, true, false);
+	} else {
+		data = json::parse(begin, end, nullptr, false);
+	}
+	return !data.is_discarded();
+}
+
+bool Graph::save(const fs::path& path, const json& data, Encoding encoding){
+	if(encoding == Encoding::JSON){
+		std::ofstream file(path);
+		if(!file.is_open()){
+			return false;
+		}
+		file << std::setw(4) << data << "\n";
+		file.close();
+		return true;
+	}
+	std::vector<uchar> bytes;
+	if(encoding == Encoding::CBOR){
+		json::to_cbor(data, bytes);
+	} else {
+		json::to_msgpack(data, bytes);
+	}
+	return System::writeDataToFile(bytes.data(), bytes.size(), path);
+}
+
+Graph::Encoding Graph::encodingForPath(const fs::path& path){
+	const std::string ext = TextUtilities::lowercase(path.extension().string());
+	if(ext == ".cbor"){
+		return Encoding::CBOR;
+	}
+	if(ext == ".msgpack"){
+		return Encoding::MESSAGEPACK;
+	}
+	return Encoding::JSON;
+}
+
 void Graph::clear(){
 	uint nodesCount = _nodes.size();
 	for(uint nodeId = 0u; nodeId < nodesCount; ++nodeId){
@@ -129,6 +229,8 @@ void Graph::clear(){
 	}
 	_nodes.clear();
 	_links.clear();
+	_linkIndices.clear();
+	_linkIndicesDirty = false;
 }
 
 bool operator==(const Graph::Link& a, const Graph::Link& b){
@@ -148,18 +250,33 @@ GraphEditor::~GraphEditor(){
 }
 
 uint GraphEditor::addNode(Node* node){
-	auto existingNode = std::find_if( _addedNodes.begin(), _addedNodes.end(), [&node] ( const FutureNode& a ){
-		return a.node == node;
-	});
-	if( existingNode != _addedNodes.end()){
-		return existingNode->id;
+	auto existingNode = _addedNodesIds.find(node);
+	if( existingNode != _addedNodesIds.end()){
+		return existingNode->second;
 	}
 	const uint futureId = _nextFutureNodeId;
 	++_nextFutureNodeId;
 	_addedNodes.push_back( { node, futureId } );
+	_addedNodesIds[node] = futureId;
 	return futureId;
 }
 
+const std::vector<uint>& GraphEditor::existingLinks(uint node){
+	// Index links of the graph by node on first use, they won't change until commit.
+	if(!_existingLinksIndexed){
+		const uint linkCount = _graph.getLinkCount();
+		for(uint lid = 0; lid < linkCount; ++lid){
+			const Graph::Link& link = _graph.link(lid);
+			_existingLinksPerNode[link.from.node].push_back(lid);
+			if(link.to.node != link.from.node){
+				_existingLinksPerNode[link.to.node].push_back(lid);
+			}
+		}
+		_existingLinksIndexed = true;
+	}
+	return _existingLinksPerNode[node];
+}
+
 void GraphEditor::removeNode(uint node){
 	assert(node < _graph._nodes.size());
 	assert(_graph._nodes[node] != nullptr);
@@ -167,12 +284,8 @@ void GraphEditor::removeNode(uint node){
 	_deletedNodes.insert(node);
 
 	// Remove all associated links.
-	const size_t linkCount = _graph.getLinkCount();
-	for(size_t lid = 0; lid < linkCount; ++lid){
-		const Graph::Link& link = _graph.link(lid);
-		if(link.from.node == node || link.to.node == node){
-			_deletedLinks.insert(lid);
-		}
+	for(uint lid : existingLinks(node)){
+		_deletedLinks.insert(lid);
 	}
 	// For links that are waiting to be added, we'll handle them at the end.
 }
@@ -182,25 +295,27 @@ void GraphEditor::addLink(uint fromNode, uint fromSlot, uint toNode, uint toSlot
 	link.from = {fromNode, fromSlot };
 	link.to = { toNode, toSlot };
 
-	// Remove previously added links pointing to the same destination (including copies of this one).
-	auto itl = std::remove_if( _addedLinks.begin(), _addedLinks.end(), [&link] ( const Graph::Link& olink )
-	{
-		return olink.to.node == link.to.node && olink.to.slot == link.to.slot;
-	});
-	_addedLinks.erase( itl, _addedLinks.end() );
+	// Remove the previously added link pointing to the same destination (possibly a copy of this one).
+	// It is only flagged here and erased when committing, to preserve the order of the other links.
+	const uint64_t destination = slotKey(toNode, toSlot);
+	auto previousLink = _addedLinksPerDestination.find(destination);
+	if(previousLink != _addedLinksPerDestination.end()){
+		_addedLinks[previousLink->second].from.node = kSentinel;
+	}
 
 	// Remove existing links pointing to the same destination.
-	const size_t linkCount = _graph.getLinkCount();
-	for( size_t lid = 0; lid < linkCount; ++lid )
-	{
-		const Graph::Link& olink = _graph.link( lid );
-		if( olink.to.node == link.to.node && olink.to.slot == link.to.slot )
-		{
-			_deletedLinks.insert( lid );
+	if(toNode < _firstFutureNodeId){
+		for(uint lid : existingLinks(toNode)){
+			const Graph::Link& olink = _graph.link( lid );
+			if( olink.to.node == link.to.node && olink.to.slot == link.to.slot )
+			{
+				_deletedLinks.insert( lid );
+			}
 		}
 	}
 
 	// Add new link
+	_addedLinksPerDestination[destination] = (uint)_addedLinks.size();
 	_addedLinks.push_back( link );
 }
 
@@ -215,24 +330,26 @@ void GraphEditor::commit(){
 		_graph.removeNode(nodeToDelete);
 	}
 
-	// Removed added links that are not valid anymore.
+	// Removed added links that are not valid anymore, or have been replaced.
 	auto itl = std::remove_if(_addedLinks.begin(), _addedLinks.end(), [this](const Graph::Link& link){
-		return _deletedNodes.count(link.from.node) > 0u || _deletedNodes.count(link.to.node) > 0u;
+		return link.from.node == kSentinel || _deletedNodes.count(link.from.node) > 0u || _deletedNodes.count(link.to.node) > 0u;
 	});
 	_addedLinks.erase(itl, _addedLinks.end());
 
 	// Mark all links to delete with a sentinel node index.
-	constexpr uint kSentinel = 0xFFFFFFFF;
-
 	assert(kSentinel >= _graph._nodes.size());
 	for(uint linkToDelete : _deletedLinks){
 		_graph._links[linkToDelete].from.node = kSentinel;
 	}
 	// Erase them.
-	auto itg = std::remove_if(_graph._links.begin(), _graph._links.end(), [kSentinel](const Graph::Link& link){
+	auto itg = std::remove_if(_graph._links.begin(), _graph._links.end(), [](const Graph::Link& link){
 		return link.from.node == kSentinel;
 	});
-	_graph._links.erase(itg, _graph._links.end());
+	if(itg != _graph._links.end()){
+		_graph._links.erase(itg, _graph._links.end());
+		// Link indices have been shifted.
+		_graph._linkIndicesDirty = true;
+	}
 
 	// Add all new nodes
 	std::unordered_map<uint, uint> futureIndices;
@@ -260,6 +377,10 @@ void GraphEditor::commit(){
 	_deletedLinks.clear();
 	_addedLinks.clear();
 	_addedNodes.clear();
+	_addedNodesIds.clear();
+	_addedLinksPerDestination.clear();
+	_existingLinksPerNode.clear();
+	_existingLinksIndexed = false;
 	_firstFutureNodeId = _graph.getNodeCountUpperBound();
 	_nextFutureNodeId = _firstFutureNodeId;
 }
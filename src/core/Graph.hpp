@@ -2,7 +2,9 @@
 #include "core/Common.hpp"
 #include "core/FreeList.hpp"
 #include "core/nodes/Node.hpp"
+#include "core/system/System.hpp"
 #include <set>
+#include <unordered_map>
 
 struct GraphNodes;
 class GraphEditor;
@@ -24,6 +26,11 @@ public:
 		Slot to;
 	};
 
+	/// File encodings for serialized graphs, binary ones are faster to load.
+	enum class Encoding {
+		JSON, CBOR, MESSAGEPACK
+	};
+
 	~Graph();
 
 	int findNode( const Node* node );
@@ -41,6 +48,13 @@ public:
 	void serialize(json& data);
 	bool deserialize(const json& data);
 
+	/// Load serialized data from a file, detecting its encoding.
+	static bool load(const fs::path& path, json& data);
+	/// Save serialized data to a file in the given encoding.
+	static bool save(const fs::path& path, const json& data, Encoding encoding);
+	/// Binary encoding based on the file extension (.cbor or .msgpack), JSON otherwise.
+	static Encoding encodingForPath(const fs::path& path);
+
 private:
 
 	uint addNode(Node* node);
@@ -51,9 +65,15 @@ private:
 
 	void clear();
 
+	struct LinkHash {
+		size_t operator()(const Link& link) const;
+	};
+
 	std::vector<Node*> _nodes;
 	std::vector<Link> _links;
+	std::unordered_map<Link, uint, LinkHash> _linkIndices;
 	FreeList _freeListNodes;
+	bool _linkIndicesDirty{false};
 
 };
 
@@ -87,10 +107,17 @@ private:
 		uint id;
 	};
 
+	const std::vector<uint>& existingLinks(uint node);
+
 	std::set<uint> _deletedNodes;
 	std::set<uint> _deletedLinks;
 	std::vector<FutureNode> _addedNodes;
 	std::vector<Graph::Link> _addedLinks;
+	// Lookup tables, the links of the graph itself are only indexed when needed.
+	std::unordered_map<const Node*, uint> _addedNodesIds;
+	std::unordered_map<uint64_t, uint> _addedLinksPerDestination;
+	std::unordered_map<uint, std::vector<uint>> _existingLinksPerNode;
+	bool _existingLinksIndexed{false};
 	uint _firstFutureNodeId{ 0u };
 	uint _nextFutureNodeId{ 0u };
 };
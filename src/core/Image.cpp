@@ -8,77 +8,781 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image/stb_image_write.h>
 
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-#include <stb_image/stb_image_resize.h>
-
 #define TINYEXR_IMPLEMENTATION
 #define TINYEXR_USE_MINIZ 0
 #define TINYEXR_USE_STB_ZLIB 1
+#define TINYEXR_USE_THREAD 1
 #include <tinyexr/tinyexr.h>
 
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/constants.hpp>
 #include <unordered_map>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define PACKO_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace {
+
+	// Below this pixel count, conversions are performed on the calling thread.
+	const size_t kParallelConversionPixelCount = 1u << 18u;
+
+	struct Unorm8Table {
+		float values[256];
+
+		Unorm8Table(){
+			for(uint i = 0; i < 256; ++i){
+				values[i] = float(i) / 255.f;
+			}
+		}
+	};
+
+	// Exact, same as dividing by 255.
+	const Unorm8Table kUnorm8ToFloat;
+
+	// Conversions are all bit-exact with their scalar counterparts:
+	// unorm to float divides, float to unorm rounds half away from zero, float to LDR truncates.
+
+	void unorm8ToFloats(const uchar* src, size_t count, float* dst){
+		for(size_t i = 0; i < count; ++i){
+			dst[i] = kUnorm8ToFloat.values[src[i]];
+		}
+	}
+
+	void unorm16ToFloats(const glm::uint16* src, size_t count, float* dst){
+		size_t i = 0;
+#ifdef PACKO_SSE2
+		const __m128 scale = _mm_set1_ps(65535.f);
+		const __m128i zero = _mm_setzero_si128();
+		for(; i + 8 <= count; i += 8){
+			const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			const __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+			const __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero));
+			_mm_storeu_ps(dst + i, _mm_div_ps(lo, scale));
+			_mm_storeu_ps(dst + i + 4, _mm_div_ps(hi, scale));
+		}
+#endif
+		for(; i < count; ++i){
+			dst[i] = float(src[i]) / 65535.f;
+		}
+	}
+
+#ifdef PACKO_SSE2
+	// Round half away from zero non-negative values, as glm::round.
+	__m128i roundPositive(const __m128& x){
+		const __m128i truncated = _mm_cvttps_epi32(x);
+		const __m128 frac = _mm_sub_ps(x, _mm_cvtepi32_ps(truncated));
+		const __m128i roundUp = _mm_castps_si128(_mm_cmpge_ps(frac, _mm_set1_ps(0.5f)));
+		return _mm_sub_epi32(truncated, roundUp);
+	}
+#endif
+
+	void floatsToUnorm16(const float* src, size_t count, glm::uint16* dst){
+		size_t i = 0;
+#ifdef PACKO_SSE2
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 scale = _mm_set1_ps(65535.f);
+		const __m128i bias = _mm_set1_epi32(32768);
+		const __m128i biasShort = _mm_set1_epi16(-32768);
+		for(; i + 8 <= count; i += 8){
+			const __m128 lo = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one), scale);
+			const __m128 hi = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), zero), one), scale);
+			// SSE2 only has a signed saturating pack, shift to the signed range and back.
+			const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(roundPositive(lo), bias), _mm_sub_epi32(roundPositive(hi), bias));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(packed, biasShort));
+		}
+#endif
+		for(; i < count; ++i){
+			dst[i] = glm::uint16(glm::round(glm::clamp(src[i], 0.f, 1.f) * 65535.f));
+		}
+	}
+
+	void floatsToUnorm8(const float* src, size_t count, uchar* dst){
+		size_t i = 0;
+#ifdef PACKO_SSE2
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 scale = _mm_set1_ps(255.f);
+		for(; i + 8 <= count; i += 8){
+			const __m128 lo = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one), scale);
+			const __m128 hi = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), zero), one), scale);
+			const __m128i packed = _mm_packs_epi32(roundPositive(lo), roundPositive(hi));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(packed, packed));
+		}
+#endif
+		for(; i < count; ++i){
+			dst[i] = uchar(glm::round(glm::clamp(src[i], 0.f, 1.f) * 255.f));
+		}
+	}
+
+	void floatsToLDR(const float* src, size_t count, uchar* dst){
+		size_t i = 0;
+#ifdef PACKO_SSE2
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 scale = _mm_set1_ps(255.f);
+		for(; i + 16 <= count; i += 16){
+			__m128i values[4];
+			for(uint k = 0; k < 4; ++k){
+				const __m128 x = _mm_mul_ps(_mm_loadu_ps(src + i + 4 * k), scale);
+				values[k] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, zero), scale));
+			}
+			const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(values[0], values[1]), _mm_packs_epi32(values[2], values[3]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+		}
+#endif
+		for(; i < count; ++i){
+			dst[i] = (uchar)glm::clamp(src[i] * 255.f, 0.f, 255.f);
+		}
+	}
+
+	template<typename RowFunc>
+	void forEachRow(uint w, uint h, RowFunc func){
+		if(size_t(w) * h < kParallelConversionPixelCount){
+			for(uint y = 0; y < h; ++y){
+				func(y);
+			}
+			return;
+		}
+		System::forParallel(0, h, func);
+	}
+
+	// Resampling kernels, as a function of the distance to the sample center in pixels.
+
+	float kernelBox(float x){
+		return (x > -0.5f && x <= 0.5f) ? 1.f : 0.f;
+	}
+
+	float kernelTriangle(float x){
+		return std::max(1.f - std::abs(x), 0.f);
+	}
+
+	float kernelCubic(float x, float b, float c){
+		x = std::abs(x);
+		if(x < 1.f){
+			return ((12.f - 9.f * b - 6.f * c) * x * x * x + (-18.f + 12.f * b + 6.f * c) * x * x + (6.f - 2.f * b)) / 6.f;
+		}
+		if(x < 2.f){
+			return ((-b - 6.f * c) * x * x * x + (6.f * b + 30.f * c) * x * x + (-12.f * b - 48.f * c) * x + (8.f * b + 24.f * c)) / 6.f;
+		}
+		return 0.f;
+	}
+
+	float kernelMitchell(float x){
+		return kernelCubic(x, 1.f / 3.f, 1.f / 3.f);
+	}
+
+	float kernelCatmullRom(float x){
+		return kernelCubic(x, 0.f, 0.5f);
+	}
+
+	float kernelLanczos(float x){
+		const float kRadius = 3.f;
+		x = std::abs(x);
+		if(x < 1e-6f){
+			return 1.f;
+		}
+		if(x >= kRadius){
+			return 0.f;
+		}
+		const float px = glm::pi<float>() * x;
+		return kRadius * std::sin(px) * std::sin(px / kRadius) / (px * px);
+	}
+
+	// For each destination pixel along an axis, the weights of a contiguous range of source pixels.
+	struct Contributions {
+		std::vector<uint> first;
+		std::vector<uint> count;
+		std::vector<float> weights;
+		uint stride{0u};
+	};
+
+	void computeContributions(uint srcSize, uint dstSize, Image::Filter filter, Contributions& contribs){
+		const bool upsampling = dstSize > srcSize;
+		float (*kernel)(float) = kernelTriangle;
+		float support = 1.f;
+		switch(filter){
+			case Image::Filter::BOX:
+				kernel = kernelBox;
+				support = 0.5f;
+				break;
+			case Image::Filter::BILINEAR:
+				break;
+			case Image::Filter::SMOOTH:
+				// Same choice as stb_image_resize defaults.
+				kernel = upsampling ? kernelCatmullRom : kernelMitchell;
+				support = 2.f;
+				break;
+			case Image::Filter::MITCHELL:
+				kernel = kernelMitchell;
+				support = 2.f;
+				break;
+			case Image::Filter::LANCZOS:
+				kernel = kernelLanczos;
+				support = 3.f;
+				break;
+			default:
+				assert(false);
+				break;
+		}
+		// When downsampling, the kernel is stretched to cover all source pixels.
+		const float scale = float(srcSize) / float(dstSize);
+		const float kernelScale = std::max(scale, 1.f);
+		const float radius = support * kernelScale;
+		contribs.stride = uint(std::ceil(2.f * radius)) + 2u;
+		contribs.first.assign(dstSize, 0u);
+		contribs.count.assign(dstSize, 0u);
+		contribs.weights.assign(size_t(dstSize) * contribs.stride, 0.f);
+
+		for(uint i = 0u; i < dstSize; ++i){
+			const float center = (float(i) + 0.5f) * scale - 0.5f;
+			const int lo = int(std::ceil(center - radius));
+			const int hi = int(std::floor(center + radius));
+			// Samples outside the source are clamped to the edge.
+			const int first = glm::clamp(lo, 0, int(srcSize) - 1);
+			const int last = glm::clamp(hi, 0, int(srcSize) - 1);
+			float* weights = &contribs.weights[size_t(i) * contribs.stride];
+			float sum = 0.f;
+			for(int j = lo; j <= hi; ++j){
+				const float weight = kernel((float(j) - center) / kernelScale);
+				weights[glm::clamp(j, first, last) - first] += weight;
+				sum += weight;
+			}
+			const uint count = uint(last - first + 1);
+			assert(count <= contribs.stride);
+			if(std::abs(sum) > 1e-8f){
+				for(uint k = 0u; k < count; ++k){
+					weights[k] /= sum;
+				}
+			} else {
+				weights[0] = 1.f;
+			}
+			contribs.first[i] = uint(first);
+			contribs.count[i] = count;
+		}
+	}
+
+	// dst[x] += weight * src[x] for count RGBA pixels.
+	void accumulatePixels(const glm::vec4* src, float weight, size_t count, glm::vec4* dst){
+		float* dstValues = &(dst[0][0]);
+		const float* srcValues = &(src[0][0]);
+		size_t i = 0;
+#ifdef PACKO_SSE2
+		const __m128 w = _mm_set1_ps(weight);
+		for(; i + 4 <= 4u * count; i += 4){
+			_mm_storeu_ps(dstValues + i, _mm_add_ps(_mm_loadu_ps(dstValues + i), _mm_mul_ps(_mm_loadu_ps(srcValues + i), w)));
+		}
+#endif
+		for(; i < 4u * count; ++i){
+			dstValues[i] += weight * srcValues[i];
+		}
+	}
+
+	// Horizontal then vertical separable passes, parallelized over rows.
+	void resampleSeparable(const glm::vec4* src, uint srcW, uint srcH, glm::vec4* dst, uint dstW, uint dstH, Image::Filter filter){
+		Contributions contribsX;
+		Contributions contribsY;
+		computeContributions(srcW, dstW, filter, contribsX);
+		computeContributions(srcH, dstH, filter, contribsY);
+
+		std::vector<glm::vec4> tmp(size_t(dstW) * srcH);
+		forEachRow(dstW, srcH, [src, srcW, dstW, &contribsX, &tmp](size_t y){
+			const glm::vec4* srcRow = src + y * srcW;
+			glm::vec4* tmpRow = tmp.data() + y * dstW;
+			for(uint x = 0u; x < dstW; ++x){
+				const float* weights = &contribsX.weights[size_t(x) * contribsX.stride];
+				const glm::vec4* taps = srcRow + contribsX.first[x];
+#ifdef PACKO_SSE2
+				__m128 acc = _mm_setzero_ps();
+				for(uint k = 0u; k < contribsX.count[x]; ++k){
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&(taps[k][0])), _mm_set1_ps(weights[k])));
+				}
+				_mm_storeu_ps(&(tmpRow[x][0]), acc);
+#else
+				glm::vec4 acc(0.f);
+				for(uint k = 0u; k < contribsX.count[x]; ++k){
+					acc += weights[k] * taps[k];
+				}
+				tmpRow[x] = acc;
+#endif
+			}
+		});
+
+		forEachRow(dstW, dstH, [dst, dstW, &contribsY, &tmp](size_t y){
+			glm::vec4* dstRow = dst + y * dstW;
+			const float* weights = &contribsY.weights[y * contribsY.stride];
+			const glm::vec4* taps = tmp.data() + size_t(contribsY.first[y]) * dstW;
+			const uint count = contribsY.count[y];
+			for(uint x = 0u; x < dstW; ++x){
+#ifdef PACKO_SSE2
+				__m128 acc = _mm_setzero_ps();
+				for(uint k = 0u; k < count; ++k){
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&(taps[size_t(k) * dstW + x][0])), _mm_set1_ps(weights[k])));
+				}
+				_mm_storeu_ps(&(dstRow[x][0]), acc);
+#else
+				glm::vec4 acc(0.f);
+				for(uint k = 0u; k < count; ++k){
+					acc += weights[k] * taps[size_t(k) * dstW + x];
+				}
+				dstRow[x] = acc;
+#endif
+			}
+		});
+	}
+
+	// Average of each block of ratioX x ratioY source pixels.
+	void resampleIntegerBox(const glm::vec4* src, uint srcW, glm::vec4* dst, uint dstW, uint dstH, uint ratioX, uint ratioY){
+		const float weight = 1.f / float(ratioX * ratioY);
+		forEachRow(dstW, dstH, [src, srcW, dst, dstW, ratioX, ratioY, weight](size_t y){
+			std::vector<glm::vec4> sums(size_t(dstW) * ratioX, glm::vec4(0.f));
+			for(uint k = 0u; k < ratioY; ++k){
+				accumulatePixels(src + (y * ratioY + k) * srcW, 1.f, size_t(dstW) * ratioX, sums.data());
+			}
+			glm::vec4* dstRow = dst + y * dstW;
+			for(uint x = 0u; x < dstW; ++x){
+				glm::vec4 sum(0.f);
+				for(uint k = 0u; k < ratioX; ++k){
+					sum += sums[size_t(x) * ratioX + k];
+				}
+				dstRow[x] = sum * weight;
+			}
+		});
+	}
+
+	void resampleNearest(const glm::vec4* src, uint srcW, uint srcH, glm::vec4* dst, uint dstW, uint dstH){
+		auto sourceIndex = [](uint i, uint srcSize, uint dstSize){
+			const float coord = (float(i) + 0.5f) / float(dstSize) * float(srcSize) - 0.5f;
+			return uint(glm::clamp(std::floor(coord), 0.f, float(srcSize) - 1.f));
+		};
+		std::vector<uint> srcX(dstW);
+		for(uint x = 0u; x < dstW; ++x){
+			srcX[x] = sourceIndex(x, srcW, dstW);
+		}
+		forEachRow(dstW, dstH, [src, srcW, srcH, dst, dstW, dstH, &srcX, &sourceIndex](size_t y){
+			const glm::vec4* srcRow = src + size_t(sourceIndex(uint(y), srcH, dstH)) * srcW;
+			glm::vec4* dstRow = dst + y * dstW;
+			for(uint x = 0u; x < dstW; ++x){
+				dstRow[x] = srcRow[srcX[x]];
+			}
+		});
+	}
+
+	bool isEXR(const fs::path& path){
+		return TextUtilities::lowercase(path.extension().string()) == ".exr";
+	}
+
+	bool isRaw(const fs::path& path){
+		return TextUtilities::lowercase(path.extension().string()) == ".raw";
+	}
+
+	// Raw images start with this header, followed by the RGBA pixels row by row from the top,
+	// tightly packed in the header storage precision, little-endian.
+	// The header size keeps the pixels aligned when the file is mapped.
+	struct RawHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t storage;
+		uchar padding[40];
+	};
+	static_assert(sizeof(RawHeader) == 64, "Unexpected raw header size.");
+
+	const char kRawMagic[8] = {'P', 'A', 'C', 'K', 'O', 'R', 'A', 'W'};
+	const uint32_t kRawVersion = 1u;
+
+	bool readRawHeader(const MappedFile& file, RawHeader& header){
+		if(file.size() < sizeof(RawHeader)){
+			return false;
+		}
+		std::memcpy(&header, file.data(), sizeof(RawHeader));
+		if(std::memcmp(header.magic, kRawMagic, sizeof(kRawMagic)) != 0 || header.version != kRawVersion){
+			return false;
+		}
+		if(header.storage > uint32_t(Image::Storage::UNORM8) || header.width == 0u || header.height == 0u){
+			return false;
+		}
+		return file.size() >= sizeof(RawHeader) + Image::byteSize(header.width, header.height, Image::Storage(header.storage));
+	}
+
+}
+
 Image::Image(uint w, uint h, const glm::vec4& defaultColor) {
 	_w = w;
 	_h = h;
-	_pixels.resize(_w * _h, defaultColor);
+	_pixels.resize(size_t(_w) * _h, defaultColor);
+	updateData();
 }
 
-bool Image::load(const fs::path& path){
+Image::Image(uint w, uint h, Storage storage, const glm::vec4& defaultColor, bool outOfCore) {
+	_w = w;
+	_h = h;
+	_storage = storage;
+	if(outOfCore){
+		// Tiles are stored contiguously, padding the image to a multiple of the tile size.
+		_tileCountX = (_w + kTileSize - 1u) / kTileSize;
+		const size_t tileCountY = (_h + kTileSize - 1u) / kTileSize;
+		const size_t size = _tileCountX * tileCountY * kTileSize * kTileSize * 4u * bytesPerChannel(_storage);
+		_mapping.reset(new MappedFile());
+		if(_mapping->createScratch(size)){
+			// Scratch files are zero-initialized.
+			_tiled = true;
+			_data = _mapping->data();
+		} else {
+			Log::Warning() << "Unable to allocate out-of-core storage, using memory instead." << std::endl;
+			_mapping.reset();
+			_tileCountX = 0u;
+		}
+	}
+	if(!_tiled){
+		if(_storage == Storage::FLOAT32){
+			_pixels.resize(size_t(_w) * _h, defaultColor);
+			updateData();
+			return;
+		}
+		_packed.resize(byteSize(_w, _h, _storage));
+		updateData();
+	}
+	if(defaultColor != glm::vec4(0.0f)){
+		for(uint y = 0; y < _h; ++y){
+			for(uint x = 0; x < _w; ++x){
+				setColor(x, y, defaultColor);
+			}
+		}
+	}
+}
 
-	const auto dstPathStr = path.u8string();
+void Image::updateData(){
+	if(_mapping){
+		_data = _mapping->data() + _mappingOffset;
+	} else if(_storage == Storage::FLOAT32){
+		_data = _pixels.empty() ? nullptr : reinterpret_cast<uchar*>(_pixels.data());
+	} else {
+		_data = _packed.empty() ? nullptr : _packed.data();
+	}
+}
+
+void Image::swap(Image& other){
+	std::swap(_pixels, other._pixels);
+	std::swap(_packed, other._packed);
+	std::swap(_mapping, other._mapping);
+	std::swap(_mappingOffset, other._mappingOffset);
+	std::swap(_data, other._data);
+	std::swap(_w, other._w);
+	std::swap(_h, other._h);
+	std::swap(_tileCountX, other._tileCountX);
+	std::swap(_storage, other._storage);
+	std::swap(_tiled, other._tiled);
+}
+
+uint Image::bytesPerChannel(Storage storage){
+	switch(storage){
+		case Storage::FLOAT32:
+			return 4u;
+		case Storage::HALF:
+		case Storage::UNORM16:
+			return 2u;
+		case Storage::UNORM8:
+			return 1u;
+		default:
+			assert(false);
+			break;
+	}
+	return 4u;
+}
+
+size_t Image::byteSize(uint w, uint h, Storage storage){
+	return size_t(w) * size_t(h) * 4u * bytesPerChannel(storage);
+}
+
+float Image::unpack(size_t index, uint c) const {
+	const size_t offset = index * 4u + c;
+	switch(_storage){
+		case Storage::HALF:
+			return glm::unpackHalf1x16(reinterpret_cast<const glm::uint16*>(_data)[offset]);
+		case Storage::UNORM16:
+			return float(reinterpret_cast<const glm::uint16*>(_data)[offset]) / 65535.f;
+		case Storage::UNORM8:
+			return kUnorm8ToFloat.values[_data[offset]];
+		default:
+			assert(false);
+			break;
+	}
+	return 0.f;
+}
+
+void Image::pack(size_t index, uint c, float value){
+	const size_t offset = index * 4u + c;
+	switch(_storage){
+		case Storage::HALF:
+			reinterpret_cast<glm::uint16*>(_data)[offset] = glm::packHalf1x16(value);
+			break;
+		case Storage::UNORM16:
+			reinterpret_cast<glm::uint16*>(_data)[offset] = glm::uint16(glm::round(glm::clamp(value, 0.f, 1.f) * 65535.f));
+			break;
+		case Storage::UNORM8:
+			_data[offset] = uchar(glm::round(glm::clamp(value, 0.f, 1.f) * 255.f));
+			break;
+		default:
+			assert(false);
+			break;
+	}
+}
+
+glm::vec4 Image::color(int x, int y) const {
+	assert(x >= 0 && x < int(_w) && y >= 0 && y < int(_h));
+	const size_t id = index(x, y);
+	if(_storage == Storage::FLOAT32){
+		return floats()[id];
+	}
+	return { unpack(id, 0), unpack(id, 1), unpack(id, 2), unpack(id, 3) };
+}
+
+void Image::setColor(int x, int y, const glm::vec4& color){
+	assert(x >= 0 && x < int(_w) && y >= 0 && y < int(_h));
+	const size_t id = index(x, y);
+	if(_storage == Storage::FLOAT32){
+		floats()[id] = color;
+		return;
+	}
+	for(uint c = 0; c < 4; ++c){
+		pack(id, c, color[c]);
+	}
+}
+
+glm::vec4 Image::gather(const glm::ivec2& c00, const glm::ivec2& c11, uint c) const {
+	assert(c00.x >= 0 && c00.x < int(_w) && c00.y >= 0 && c00.y < int(_h));
+	assert(c11.x >= 0 && c11.x < int(_w) && c11.y >= 0 && c11.y < int(_h));
+	const size_t i00 = index(c00.x, c00.y);
+	// Most footprints are contained in a single tile (or row pair), only compute the first index.
+	const bool sameTile = !_tiled || (((c00.x ^ c11.x) >> kTileShift) == 0 && ((c00.y ^ c11.y) >> kTileShift) == 0);
+	if(sameTile){
+		const size_t stride = _tiled ? kTileSize : _w;
+		const size_t i10 = i00 + size_t(c11.x - c00.x);
+		const size_t i01 = i00 + size_t(c11.y - c00.y) * stride;
+		const size_t i11 = i01 + size_t(c11.x - c00.x);
+		return { value(i00, c), value(i10, c), value(i01, c), value(i11, c) };
+	}
+	return { value(i00, c), value(index(c11.x, c00.y), c), value(index(c00.x, c11.y), c), value(index(c11.x, c11.y), c) };
+}
 
-	if(path.extension() == "exr"){
-		float* data = nullptr;
-		int wi = 0;
-		int hi = 0;
+void Image::gatherColors(const glm::ivec2& c00, const glm::ivec2& c11, glm::vec4 colors[4]) const {
+	if(_storage == Storage::FLOAT32 && !_tiled){
+		colors[0] = pixel(c00.x, c00.y);
+		colors[1] = pixel(c11.x, c00.y);
+		colors[2] = pixel(c00.x, c11.y);
+		colors[3] = pixel(c11.x, c11.y);
+		return;
+	}
+	for(uint c = 0; c < 4; ++c){
+		const glm::vec4 values = gather(c00, c11, c);
+		for(uint i = 0; i < 4; ++i){
+			colors[i][c] = values[i];
+		}
+	}
+}
+
+void Image::readRow(uint y, glm::vec4* dst) const {
+	if(_tiled){
+		for(uint x = 0; x < _w; ++x){
+			dst[x] = color(x, y);
+		}
+		return;
+	}
+	const size_t offset = size_t(_w) * y * 4u;
+	float* values = &(dst[0][0]);
+	switch(_storage){
+		case Storage::FLOAT32:
+			std::memcpy(values, floats() + size_t(_w) * y, sizeof(glm::vec4) * _w);
+			break;
+		case Storage::HALF:
+			for(size_t i = 0; i < size_t(_w) * 4u; ++i){
+				values[i] = glm::unpackHalf1x16(reinterpret_cast<const glm::uint16*>(_data)[offset + i]);
+			}
+			break;
+		case Storage::UNORM16:
+			unorm16ToFloats(reinterpret_cast<const glm::uint16*>(_data) + offset, size_t(_w) * 4u, values);
+			break;
+		case Storage::UNORM8:
+			unorm8ToFloats(_data + offset, size_t(_w) * 4u, values);
+			break;
+		default:
+			assert(false);
+			break;
+	}
+}
+
+void Image::writeRow(uint y, const glm::vec4* src){
+	if(_tiled){
+		for(uint x = 0; x < _w; ++x){
+			setColor(x, y, src[x]);
+		}
+		return;
+	}
+	const size_t offset = size_t(_w) * y * 4u;
+	const float* values = &(src[0][0]);
+	switch(_storage){
+		case Storage::FLOAT32:
+			std::memcpy(floats() + size_t(_w) * y, values, sizeof(glm::vec4) * _w);
+			break;
+		case Storage::HALF:
+			for(size_t i = 0; i < size_t(_w) * 4u; ++i){
+				reinterpret_cast<glm::uint16*>(_data)[offset + i] = glm::packHalf1x16(values[i]);
+			}
+			break;
+		case Storage::UNORM16:
+			floatsToUnorm16(values, size_t(_w) * 4u, reinterpret_cast<glm::uint16*>(_data) + offset);
+			break;
+		case Storage::UNORM8:
+			floatsToUnorm8(values, size_t(_w) * 4u, _data + offset);
+			break;
+		default:
+			assert(false);
+			break;
+	}
+}
+
+void Image::copyConverted(const Image& src){
+	assert(src._w == _w && src._h == _h);
+	forEachRow(_w, _h, [this, &src](size_t y){
+		std::vector<glm::vec4> row(_w);
+		src.readRow(uint(y), row.data());
+		writeRow(uint(y), row.data());
+	});
+}
+
+void Image::convert(Storage storage){
+	if(storage == _storage){
+		return;
+	}
+	Image dst(_w, _h, storage, glm::vec4(0.0f), outOfCore());
+	dst.copyConverted(*this);
+	swap(dst);
+}
+
+bool Image::moveOutOfCore(){
+	if(outOfCore()){
+		return true;
+	}
+	Image dst(_w, _h, _storage, glm::vec4(0.0f), true);
+	if(!dst.outOfCore()){
+		return false;
+	}
+	dst.copyConverted(*this);
+	swap(dst);
+	return true;
+}
+
+bool Image::info(const fs::path& path, uint& w, uint& h){
+	MappedFile file;
+	if(!file.open(path)){
+		return false;
+	}
+	int wi = 0;
+	int hi = 0;
+	if(isRaw(path)){
+		RawHeader header;
+		if(!readRawHeader(file, header)){
+			return false;
+		}
+		wi = int(header.width);
+		hi = int(header.height);
+	} else if(isEXR(path)){
+		EXRVersion version;
+		if(ParseEXRVersionFromMemory(&version, file.data(), file.size()) != TINYEXR_SUCCESS){
+			return false;
+		}
+		EXRHeader header;
+		InitEXRHeader(&header);
 		const char* error = nullptr;
-		const int res = LoadEXR(&data, &wi, &hi, dstPathStr.c_str(), &error);
-		if(res != TINYEXR_SUCCESS){
-			// Should we free the error? doc is unclear.
+		if(ParseEXRHeaderFromMemory(&header, &version, file.data(), file.size(), &error) != TINYEXR_SUCCESS){
+			FreeEXRErrorMessage(error);
 			return false;
 		}
-		if(data == nullptr || wi == 0 || hi == 0){
-			if(data){
-				free(data);
-			}
+		wi = header.data_window.max_x - header.data_window.min_x + 1;
+		hi = header.data_window.max_y - header.data_window.min_y + 1;
+		FreeEXRHeader(&header);
+	} else {
+		int n = 0;
+		if(stbi_info_from_memory(file.data(), int(file.size()), &wi, &hi, &n) == 0){
 			return false;
 		}
-		_w = (uint)wi;
-		_h = (uint)hi;
-		_pixels.resize(_w * _h);
-		std::memcpy(_pixels.data(), data, sizeof(glm::vec4) * _w * _h);
-		free(data);
-		return true;
+	}
+	if(wi <= 0 || hi <= 0){
+		return false;
+	}
+	w = uint(wi);
+	h = uint(hi);
+	return true;
+}
+
+bool Image::load(const fs::path& path, uint channelMask){
+
+	if(isRaw(path)){
+		return loadRaw(path);
 	}
 
-	// Load image.
+	MappedFile file;
+	if(!file.open(path)){
+		return false;
+	}
+
+	if(isEXR(path)){
+		return loadEXR(file, channelMask);
+	}
+
+	const int fileSize = int(file.size());
 	int wi = 0;
 	int hi = 0;
-	int n;
-	
-	unsigned char* data = stbi_load( dstPathStr.c_str(), &wi, &hi, &n, 4);
-	if(data == nullptr || wi == 0 || hi == 0){
+	int n = 0;
+	if(stbi_info_from_memory(file.data(), fileSize, &wi, &hi, &n) == 0){
 		return false;
 	}
+	// Skip the alpha channel if it is not read, grayscale images are decoded as-is.
+	const bool needsAlpha = (channelMask & 0x8u) != 0u;
+	const int components = (!needsAlpha && (n == 2 || n == 4)) ? (n - 1) : n;
 
-	_w = (uint)wi;
-	_h = (uint)hi;
+	unsigned char* data = stbi_load_from_memory(file.data(), fileSize, &wi, &hi, &n, components);
+	if(data == nullptr || wi == 0 || hi == 0){
+		if(data){
+			stbi_image_free(data);
+		}
+		return false;
+	}
 
-	_pixels.resize(_w * _h);
-	for (uint y = 0; y < _h; ++y) {
-		for (uint x = 0; x < _w; ++x) {
-			for (uint c = 0; c < 4; ++c) {
-				_pixels[_w * y + x][c] = (float)(data[(_w * y + x) * 4 + c]) / 255.f;
+	// 8 bits data is kept as-is, without loss of precision.
+	// Expand to RGBA the same way stb_image would.
+	Image loaded((uint)wi, (uint)hi, Storage::UNORM8);
+	if(components == 4){
+		std::memcpy(loaded._packed.data(), data, loaded._packed.size());
+	} else {
+		const uint w = loaded._w;
+		uchar* dstData = loaded._packed.data();
+		const bool gray = components < 3;
+		forEachRow(loaded._w, loaded._h, [w, components, gray, data, dstData](size_t y){
+			const uchar* src = data + size_t(w) * y * components;
+			uchar* dst = dstData + size_t(w) * y * 4u;
+			for(uint x = 0u; x < w; ++x, src += components, dst += 4){
+				dst[0] = src[0];
+				dst[1] = gray ? src[0] : src[1];
+				dst[2] = gray ? src[0] : src[2];
+				dst[3] = (components == 2) ? src[1] : 255u;
 			}
-		}
+		});
 	}
+	swap(loaded);
 
 	stbi_image_free(data);
 	return true;
 }
 
-bool Image::save(const fs::path& path, Format format) const {
+bool Image::save(const fs::path& path, Format format, int compressionLevel) const {
+	return save(path, format, compressionLevel, EXROptions());
+}
+
+bool Image::save(const fs::path& path, Format format, int compressionLevel, const EXROptions& exrOptions) const {
 
 	const std::unordered_map<Format, std::string> extensions = {
 		{Format::PNG, "png"},
@@ -86,6 +790,7 @@ bool Image::save(const fs::path& path, Format format) const {
 		{Format::TGA, "tga"},
 		{Format::JPEG, "jpg"},
 		{Format::EXR, "exr"},
+		{Format::RAW, "raw"},
 	};
 
 	fs::path dstPath = path;
@@ -93,26 +798,18 @@ bool Image::save(const fs::path& path, Format format) const {
 	const auto dstPathStr = dstPath.u8string();
 
 	if(format == Format::EXR){
-		const char* err = nullptr;
-		const int res = SaveEXR((float*)_pixels.data(), _w, _h, 4, false, dstPathStr.c_str(), &err);
-		// Should we free err?
-		return res == TINYEXR_SUCCESS;
-
+		return saveEXR(dstPath, exrOptions);
 	}
-	// Convert data to LDR
-	std::vector<unsigned char> data(_w * _h * 4);
-	for (uint y = 0; y < _h; ++y) {
-		for (uint x = 0; x < _w; ++x) {
-			for (uint c = 0; c < 4; ++c) {
-				data[(_w * y + x) * 4 + c] = (unsigned char)glm::clamp(_pixels[_w * y + x][c] * 255.f, 0.f, 255.f);
-			}
-		}
+	if(format == Format::RAW){
+		return saveRaw(dstPath);
 	}
+	// Convert data to LDR
+	std::vector<unsigned char> data(size_t(_w) * _h * 4);
+	getLDRRows(0, _h, data.data());
 	int res = -1;
 	switch (format) {
 		case Format::PNG:
-			res = stbi_write_png( dstPathStr.c_str(), _w, _h, 4, data.data(), 4 * _w);
-			break;
+			return PNGWriter::write(dstPath, _w, _h, data.data(), compressionLevel);
 		case Format::BMP:
 			res = stbi_write_bmp( dstPathStr.c_str(), _w, _h, 4, data.data());
 			break;
@@ -130,38 +827,253 @@ bool Image::save(const fs::path& path, Format format) const {
 	return res == 0;
 }
 
-void Image::resize(const glm::ivec2& newRes, Filter filter){
-	if(_w == 0 || _h == 0){
-		return;
+bool Image::loadEXR(const MappedFile& file, uint channelMask){
+	EXRVersion version;
+	if(ParseEXRVersionFromMemory(&version, file.data(), file.size()) != TINYEXR_SUCCESS){
+		return false;
+	}
+	EXRHeader header;
+	InitEXRHeader(&header);
+	const char* error = nullptr;
+	if(ParseEXRHeaderFromMemory(&header, &version, file.data(), file.size(), &error) != TINYEXR_SUCCESS){
+		FreeEXRErrorMessage(error);
+		return false;
+	}
+	// Read half channels as floats.
+	for(int i = 0; i < header.num_channels; ++i){
+		if(header.pixel_types[i] == TINYEXR_PIXELTYPE_HALF){
+			header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
+		}
+	}
+	EXRImage image;
+	InitEXRImage(&image);
+	if(LoadEXRImageFromMemory(&image, &header, file.data(), file.size(), &error) != TINYEXR_SUCCESS){
+		FreeEXRErrorMessage(error);
+		FreeEXRHeader(&header);
+		return false;
 	}
 
-	std::vector<glm::vec4> newPixels(newRes.x * newRes.y);
+	// Find the source of each channel, a single channel is broadcast to all four.
+	// Channels that are not requested or are missing are left at their default value.
+	int sources[4] = {-1, -1, -1, -1};
+	const char* names[4] = {"R", "G", "B", "A"};
+	for(int i = 0; i < header.num_channels; ++i){
+		for(uint c = 0u; c < 4u; ++c){
+			if(header.num_channels == 1 || std::strcmp(header.channels[i].name, names[c]) == 0){
+				sources[c] = i;
+			}
+		}
+	}
+	// Color channels are required, a missing alpha is opaque.
+	bool valid = image.width > 0 && image.height > 0;
+	for(uint c = 0u; c < 4u; ++c){
+		valid &= c == 3u || sources[c] >= 0;
+		if((channelMask & (1u << c)) == 0u){
+			sources[c] = -1;
+		}
+	}
+	if(!valid){
+		FreeEXRImage(&image);
+		FreeEXRHeader(&header);
+		return false;
+	}
 
-	bool success = false;
-	if(filter == Filter::SMOOTH){
-		float* input = &(_pixels[0][0]);
-		float* output = &(newPixels[0][0]);
+	Image loaded(uint(image.width), uint(image.height), Storage::FLOAT32, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	// Copy a block of planar channels in the interleaved pixels.
+	auto copyBlock = [&loaded, &sources](const float* const* planes, uint x0, uint y0, uint blockW, uint blockH, uint y){
+		if(y >= blockH || y0 + y >= loaded._h){
+			return;
+		}
+		const uint rowW = std::min(blockW, loaded._w - std::min(x0, loaded._w));
+		glm::vec4* dst = loaded._pixels.data() + size_t(y0 + y) * loaded._w + x0;
+		for(uint c = 0u; c < 4u; ++c){
+			if(sources[c] < 0){
+				continue;
+			}
+			const float* src = planes[sources[c]] + size_t(y) * blockW;
+			for(uint x = 0u; x < rowW; ++x){
+				dst[x][c] = src[x];
+			}
+		}
+	};
+	if(header.tiled){
+		const uint tileW = uint(header.tile_size_x);
+		const uint tileH = uint(header.tile_size_y);
+		System::forParallel(0, size_t(image.num_tiles), [&image, &copyBlock, tileW, tileH](size_t t){
+			const EXRTile& tile = image.tiles[t];
+			const float* const* planes = reinterpret_cast<const float* const*>(tile.images);
+			for(uint y = 0u; y < tileH; ++y){
+				copyBlock(planes, uint(tile.offset_x) * tileW, uint(tile.offset_y) * tileH, tileW, tileH, y);
+			}
+		});
+	} else {
+		const float* const* planes = reinterpret_cast<const float* const*>(image.images);
+		forEachRow(loaded._w, loaded._h, [&copyBlock, &loaded, planes](size_t y){
+			copyBlock(planes, 0u, 0u, loaded._w, loaded._h, uint(y));
+		});
+	}
+	swap(loaded);
+	FreeEXRImage(&image);
+	FreeEXRHeader(&header);
+	return true;
+}
+
+bool Image::saveEXR(const fs::path& path, const EXROptions& options) const {
 
-		int res = stbir_resize_float(input, _w, _h , sizeof(glm::vec4) * _w, output, newRes.x, newRes.y, sizeof(glm::vec4) * newRes.x, 4);
-		success = (res == 1);
-	} else if(filter == Filter::NEAREST){
-		const glm::vec2 srcRes(_w, _h);
-		for(uint y = 0u; y < uint(newRes.y); ++y){
-			for(uint x = 0u; x < uint(newRes.x); ++x){
-				const glm::vec2 uv = (glm::vec2(x, y) + 0.5f) / glm::vec2(newRes);
-				const glm::vec2 srcCoords = uv * srcRes - 0.5f;
-				const glm::ivec2 srcPix = glm::clamp(glm::floor(srcCoords), glm::vec2(0.f), srcRes - 1.f);
-				newPixels[y * newRes.x + x] = pixel(srcPix);
+	const size_t pixelCount = size_t(_w) * _h;
+	// Channels are stored in ABGR order, as expected by most viewers.
+	const char* names[4] = {"A", "B", "G", "R"};
+	std::vector<float> planes(4u * pixelCount);
+	forEachRow(_w, _h, [this, &planes, pixelCount](size_t y){
+		std::vector<glm::vec4> row(_w);
+		readRow(uint(y), row.data());
+		for(uint c = 0u; c < 4u; ++c){
+			float* dst = planes.data() + (3u - c) * pixelCount + y * _w;
+			for(uint x = 0u; x < _w; ++x){
+				dst[x] = row[x][c];
 			}
 		}
-		success = true;
+	});
+
+	static const std::unordered_map<EXRCompression, int> compressions = {
+		{EXRCompression::ZIP, TINYEXR_COMPRESSIONTYPE_ZIP},
+		{EXRCompression::PIZ, TINYEXR_COMPRESSIONTYPE_PIZ},
+		{EXRCompression::NONE, TINYEXR_COMPRESSIONTYPE_NONE},
+	};
+
+	EXRChannelInfo channels[4];
+	int pixelTypes[4];
+	int requestedPixelTypes[4];
+	float* images[4];
+	for(uint c = 0u; c < 4u; ++c){
+		std::memset(&channels[c], 0, sizeof(EXRChannelInfo));
+		std::strncpy(channels[c].name, names[c], 255);
+		pixelTypes[c] = TINYEXR_PIXELTYPE_FLOAT;
+		requestedPixelTypes[c] = options.half ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT;
+		images[c] = planes.data() + c * pixelCount;
+	}
+
+	EXRHeader header;
+	InitEXRHeader(&header);
+	header.num_channels = 4;
+	header.channels = channels;
+	header.pixel_types = pixelTypes;
+	header.requested_pixel_types = requestedPixelTypes;
+	header.compression_type = compressions.at(options.compression);
+
+	EXRImage image;
+	InitEXRImage(&image);
+	image.num_channels = 4;
+	image.images = reinterpret_cast<unsigned char**>(images);
+	image.width = int(_w);
+	image.height = int(_h);
+
+	const char* error = nullptr;
+	const int res = SaveEXRImageToFile(&image, &header, path.u8string().c_str(), &error);
+	FreeEXRErrorMessage(error);
+	return res == TINYEXR_SUCCESS;
+}
+
+bool Image::loadRaw(const fs::path& path){
+	// Pixels are used in place, modifications are kept in memory.
+	std::unique_ptr<MappedFile> file(new MappedFile());
+	RawHeader header;
+	if(!file->open(path, true) || !readRawHeader(*file, header)){
+		return false;
+	}
+	Image loaded;
+	loaded._w = header.width;
+	loaded._h = header.height;
+	loaded._storage = Storage(header.storage);
+	loaded._mapping = std::move(file);
+	loaded._mappingOffset = sizeof(RawHeader);
+	loaded.updateData();
+	swap(loaded);
+	return true;
+}
+
+bool Image::saveRaw(const fs::path& path) const {
+	std::ofstream file(path, std::ios::binary);
+	if(!file.is_open()){
+		return false;
+	}
+	RawHeader header;
+	std::memset(&header, 0, sizeof(RawHeader));
+	std::memcpy(header.magic, kRawMagic, sizeof(kRawMagic));
+	header.version = kRawVersion;
+	header.width = _w;
+	header.height = _h;
+	header.storage = uint32_t(Storage::FLOAT32);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(RawHeader));
+
+	if(_storage == Storage::FLOAT32 && !_tiled){
+		file.write(reinterpret_cast<const char*>(floats()), std::streamsize(sizeof(glm::vec4) * _w * _h));
+	} else {
+		std::vector<glm::vec4> row(_w);
+		for(uint y = 0u; y < _h; ++y){
+			readRow(y, row.data());
+			file.write(reinterpret_cast<const char*>(row.data()), std::streamsize(sizeof(glm::vec4) * _w));
+		}
+	}
+	return file.good();
+}
+
+void Image::resize(const glm::ivec2& newRes, Filter filter){
+	if(_w == 0 || _h == 0 || newRes.x <= 0 || newRes.y <= 0){
+		return;
+	}
+	// Resampling is performed and stored at full precision, in memory.
+	if(outOfCore()){
+		Image linear(_w, _h, Storage::FLOAT32);
+		linear.copyRows(*this, 0, 0, _h);
+		swap(linear);
+	}
+	convert(Storage::FLOAT32);
+
+	const uint dstW = uint(newRes.x);
+	const uint dstH = uint(newRes.y);
+	std::vector<glm::vec4> newPixels(size_t(dstW) * dstH);
+	const glm::vec4* src = _pixels.data();
+	const bool integerRatio = dstW <= _w && dstH <= _h && (_w % dstW) == 0u && (_h % dstH) == 0u;
+
+	if(filter == Filter::NEAREST){
+		resampleNearest(src, _w, _h, newPixels.data(), dstW, dstH);
+	} else if(filter == Filter::BOX && integerRatio){
+		resampleIntegerBox(src, _w, newPixels.data(), dstW, dstH, _w / dstW, _h / dstH);
 	} else {
-		assert(false);
+		resampleSeparable(src, _w, _h, newPixels.data(), dstW, dstH, filter);
 	}
 
-	if(success){
-		_w = newRes.x;
-		_h = newRes.y;
-		std::swap(newPixels, _pixels);
+	_w = dstW;
+	_h = dstH;
+	std::swap(newPixels, _pixels);
+	updateData();
+}
+
+void Image::getLDRRows(uint y, uint count, uchar* data) const {
+	assert(y + count <= _h);
+	forEachRow(_w, count, [this, y, data](size_t r){
+		uchar* row = data + r * _w * 4u;
+		if(_storage == Storage::FLOAT32 && !_tiled){
+			floatsToLDR(&(floats()[size_t(_w) * (y + r)][0]), size_t(_w) * 4u, row);
+			return;
+		}
+		std::vector<glm::vec4> values(_w);
+		readRow(uint(y + r), values.data());
+		floatsToLDR(&(values[0][0]), size_t(_w) * 4u, row);
+	});
+}
+
+void Image::copyRows(const Image& src, uint srcY, uint dstY, uint count){
+	assert(src._w == _w && srcY + count <= src._h && dstY + count <= _h);
+	if(src._storage == _storage && !src._tiled && !_tiled){
+		const size_t rowSize = size_t(_w) * 4u * bytesPerChannel(_storage);
+		std::memcpy(_data + dstY * rowSize, src._data + srcY * rowSize, count * rowSize);
+		return;
 	}
+	forEachRow(_w, count, [this, &src, srcY, dstY](size_t r){
+		std::vector<glm::vec4> row(_w);
+		src.readRow(uint(srcY + r), row.data());
+		writeRow(uint(dstY + r), row.data());
+	});
 }
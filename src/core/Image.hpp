@@ -1,50 +1,160 @@
 #pragma once
 #include "core/Common.hpp"
 #include "core/system/System.hpp"
+#include "core/system/MappedFile.hpp"
+#include "core/PNGWriter.hpp"
 
 struct Image {
 public:
 
 	enum class Format {
-		PNG, JPEG, BMP, TGA, EXR
+		PNG, JPEG, BMP, TGA, EXR, RAW
 	};
 
 	enum class Filter {
-		NEAREST, SMOOTH
+		NEAREST, SMOOTH, BOX, BILINEAR, MITCHELL, LANCZOS
+	};
+
+	enum class EXRCompression {
+		ZIP, PIZ, NONE
+	};
+
+	struct EXROptions {
+		bool half{false};
+		EXRCompression compression{EXRCompression::ZIP};
+	};
+
+	/// Per-channel storage precision. Only FLOAT32 images expose their pixels by reference.
+	enum class Storage {
+		FLOAT32, HALF, UNORM16, UNORM8
 	};
 
 	Image() = default;
 
 	Image(uint w, uint h, const glm::vec4 & defaultColor = glm::vec4(0.0f));
 
+	Image(uint w, uint h, Storage storage, const glm::vec4 & defaultColor = glm::vec4(0.0f), bool outOfCore = false);
+
 	Image(const Image& ) = delete;
 	Image& operator=(const Image& ) = delete;
 
 	Image( Image&&) = default;
 	Image& operator=( Image&&) = delete;
 
-	bool load(const fs::path& path);
+	/// Load an image, only decoding the channels set in channelMask when possible. Skipped channels have undefined values.
+	bool load(const fs::path& path, uint channelMask = 0xFu);
+
+	/// Read the dimensions of an image without decoding it.
+	static bool info(const fs::path& path, uint& w, uint& h);
+
+	bool save(const fs::path& path, Format format, int compressionLevel = PNGWriter::kDefaultCompressionLevel) const;
 
-	bool save(const fs::path& path, Format format) const;
+	bool save(const fs::path& path, Format format, int compressionLevel, const EXROptions& exrOptions) const;
 
 	void resize(const glm::ivec2& newRes, Filter filter);
+
+	void convert(Storage storage);
+
+	/// Move the pixels to a tiled layout in a memory-mapped scratch file, paged in on demand.
+	/// Raw images are already mapped from their file.
+	bool moveOutOfCore();
+
+	/// Convert count rows starting at y to tightly packed RGBA8.
+	void getLDRRows(uint y, uint count, uchar* data) const;
+
+	/// Copy count rows from an image of the same width.
+	void copyRows(const Image& src, uint srcY, uint dstY, uint count);
 	
-	glm::vec4& pixel(int x, int y) { assert(x >= 0 && x < int(_w) && y >= 0 && y < int(_h)); return _pixels[_w * y + x]; }
+	glm::vec4& pixel(int x, int y) { assert(_storage == Storage::FLOAT32); assert(x >= 0 && x < int(_w) && y >= 0 && y < int(_h)); return floats()[index(x, y)]; }
+
+	const glm::vec4& pixel(int x, int y) const { assert(_storage == Storage::FLOAT32); assert(x >= 0 && x < int(_w) && y >= 0 && y < int(_h)); return floats()[index(x, y)]; }
+
+	glm::vec4& pixel( const glm::ivec2& c ) { return pixel(c.x, c.y); }
+
+	const glm::vec4& pixel( const glm::ivec2& c ) const { return pixel(c.x, c.y); }
+
+	// Storage-agnostic accessors.
+
+	float channel(int x, int y, uint c) const { assert(x >= 0 && x < int(_w) && y >= 0 && y < int(_h)); return value(index(x, y), c); }
+
+	float channel(const glm::ivec2& c, uint ch) const { return channel(c.x, c.y, ch); }
+
+	void setChannel(int x, int y, uint c, float value) { assert(x >= 0 && x < int(_w) && y >= 0 && y < int(_h)); if(_storage == Storage::FLOAT32){ floats()[index(x, y)][c] = value; } else { pack(index(x, y), c, value); } }
+
+	glm::vec4 color(int x, int y) const;
+
+	glm::vec4 color(const glm::ivec2& c) const { return color(c.x, c.y); }
 
-	const glm::vec4& pixel(int x, int y) const { assert(x >= 0 && x < int(_w) && y >= 0 && y < int(_h)); return _pixels[_w * y + x]; }
+	void setColor(int x, int y, const glm::vec4& color);
 
-	glm::vec4& pixel( const glm::ivec2& c ) { assert(c.x >= 0 && c.x < int(_w) && c.y >= 0 && c.y < int(_h)); return _pixels[ _w * c.y + c.x ]; }
+	void setColor(const glm::ivec2& c, const glm::vec4& color) { setColor(c.x, c.y, color); }
 
-	const glm::vec4& pixel( const glm::ivec2& c ) const { assert(c.x >= 0 && c.x < int(_w) && c.y >= 0 && c.y < int(_h)); return _pixels[ _w * c.y + c.x ]; }
+	/// Fetch a channel at the four corners c00, (c11.x, c00.y), (c00.x, c11.y), c11 of a bilinear footprint.
+	glm::vec4 gather(const glm::ivec2& c00, const glm::ivec2& c11, uint c) const;
+
+	/// Fetch the colors at the four corners of a bilinear footprint, in the same order as gather.
+	void gatherColors(const glm::ivec2& c00, const glm::ivec2& c11, glm::vec4 colors[4]) const;
 
 	uint w() const { return _w; }
 	uint h() const { return _h; }
+	Storage storage() const { return _storage; }
+	bool outOfCore() const { return _mapping != nullptr; }
+
+	float* rawPixels() { assert(_storage == Storage::FLOAT32 && !_tiled); return (_w*_h == 0) ? nullptr : &( floats()[ 0 ][ 0 ] ); }
+
+	static uint bytesPerChannel(Storage storage);
+
+	static size_t byteSize(uint w, uint h, Storage storage);
+
+	static const uint kTileShift = 6u;
+	static const uint kTileSize = 1u << kTileShift;
 
-	float* rawPixels() { return (_w*_h == 0) ? nullptr : &( _pixels[ 0 ][ 0 ] ); }
 private:
 
+	size_t index(int x, int y) const {
+		if(!_tiled){
+			return size_t(_w) * size_t(y) + size_t(x);
+		}
+		const size_t tile = size_t(y >> kTileShift) * _tileCountX + size_t(x >> kTileShift);
+		return (tile << (2u * kTileShift)) + (size_t(y & (kTileSize - 1)) << kTileShift) + size_t(x & (kTileSize - 1));
+	}
+
+	glm::vec4* floats() { return reinterpret_cast<glm::vec4*>(_data); }
+
+	const glm::vec4* floats() const { return reinterpret_cast<const glm::vec4*>(_data); }
+
+	float value(size_t index, uint c) const { return _storage == Storage::FLOAT32 ? floats()[index][c] : unpack(index, c); }
+
+	float unpack(size_t index, uint c) const;
+
+	void pack(size_t index, uint c, float value);
+
+	void updateData();
+
+	void readRow(uint y, glm::vec4* dst) const;
+
+	void writeRow(uint y, const glm::vec4* src);
+
+	void copyConverted(const Image& src);
+
+	bool loadEXR(const MappedFile& file, uint channelMask);
+
+	bool loadRaw(const fs::path& path);
+
+	bool saveRaw(const fs::path& path) const;
+
+	bool saveEXR(const fs::path& path, const EXROptions& options) const;
+
+	void swap(Image& other);
+
 	std::vector<glm::vec4> _pixels;
+	std::vector<uchar> _packed;
+	std::unique_ptr<MappedFile> _mapping;
+	size_t _mappingOffset = 0u;
+	uchar* _data = nullptr;
 	unsigned int _w = 0u;
 	unsigned int _h = 0u;
+	size_t _tileCountX = 0u;
+	Storage _storage = Storage::FLOAT32;
+	bool _tiled = false;
 };
-
@@ -0,0 +1,460 @@
+#include "core/PNGWriter.hpp"
+#include <cstring>
+
+namespace {
+
+	const uint kWindowSize = 32768u;
+	const uint kHashBits = 15u;
+	const uint kMinMatch = 3u;
+	const uint kMaxMatch = 258u;
+	// Size of the uncompressed data compressed by each task.
+	const size_t kChunkSize = 256u * 1024u;
+	// Size of the uncompressed data processed at once when writing a full image.
+	const size_t kStripSize = 16u * 1024u * 1024u;
+
+	const uint kLengthBase[] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+	const uint kLengthExtra[] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+	const uint kDistBase[] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+	const uint kDistExtra[] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+	uint reverseBits(uint code, uint bitCount){
+		uint res = 0u;
+		for(uint i = 0u; i < bitCount; ++i){
+			res = (res << 1u) | (code & 1u);
+			code >>= 1u;
+		}
+		return res;
+	}
+
+	// Fixed Huffman codes, bit-reversed so that they can be emitted LSB first.
+	struct FixedCodes {
+		uint literals[288];
+		uint literalBits[288];
+		uint distances[30];
+		uint lengthSymbols[kMaxMatch + 1];
+		uint crc[256];
+
+		FixedCodes(){
+			for(uint i = 0u; i < 288u; ++i){
+				uint code, bits;
+				if(i < 144u){
+					code = 0x30u + i; bits = 8u;
+				} else if(i < 256u){
+					code = 0x190u + (i - 144u); bits = 9u;
+				} else if(i < 280u){
+					code = i - 256u; bits = 7u;
+				} else {
+					code = 0xC0u + (i - 280u); bits = 8u;
+				}
+				literals[i] = reverseBits(code, bits);
+				literalBits[i] = bits;
+			}
+			for(uint i = 0u; i < 30u; ++i){
+				distances[i] = reverseBits(i, 5u);
+			}
+			uint symbol = 0u;
+			for(uint l = kMinMatch; l <= kMaxMatch; ++l){
+				while(symbol + 1u < 29u && kLengthBase[symbol + 1u] <= l){
+					++symbol;
+				}
+				lengthSymbols[l] = symbol;
+			}
+			for(uint i = 0u; i < 256u; ++i){
+				uint c = i;
+				for(uint k = 0u; k < 8u; ++k){
+					c = (c & 1u) ? (0xEDB88320u ^ (c >> 1u)) : (c >> 1u);
+				}
+				crc[i] = c;
+			}
+		}
+	};
+
+	const FixedCodes& fixedCodes(){
+		static const FixedCodes codes;
+		return codes;
+	}
+
+	class BitWriter {
+	public:
+		BitWriter(std::vector<uchar>& out) : _out(out) {}
+
+		void add(uint code, uint bitCount){
+			_buffer |= uint64_t(code) << _count;
+			_count += bitCount;
+			while(_count >= 8u){
+				_out.push_back(uchar(_buffer & 0xFFu));
+				_buffer >>= 8u;
+				_count -= 8u;
+			}
+		}
+
+		void align(){
+			if(_count > 0u){
+				_out.push_back(uchar(_buffer & 0xFFu));
+			}
+			_buffer = 0u;
+			_count = 0u;
+		}
+
+	private:
+		std::vector<uchar>& _out;
+		uint64_t _buffer{0u};
+		uint _count{0u};
+	};
+
+	void writeLiteral(BitWriter& bits, uint symbol){
+		const FixedCodes& codes = fixedCodes();
+		bits.add(codes.literals[symbol], codes.literalBits[symbol]);
+	}
+
+	void writeMatch(BitWriter& bits, uint length, uint distance){
+		const FixedCodes& codes = fixedCodes();
+		const uint lengthSymbol = codes.lengthSymbols[length];
+		writeLiteral(bits, 257u + lengthSymbol);
+		bits.add(length - kLengthBase[lengthSymbol], kLengthExtra[lengthSymbol]);
+		const uint distSymbol = uint(std::upper_bound(std::begin(kDistBase), std::end(kDistBase), distance) - std::begin(kDistBase)) - 1u;
+		bits.add(codes.distances[distSymbol], 5u);
+		bits.add(distance - kDistBase[distSymbol], kDistExtra[distSymbol]);
+	}
+
+	uint hash3(const uchar* data){
+		const uint v = (uint(data[0]) << 16u) | (uint(data[1]) << 8u) | uint(data[2]);
+		return (v * 2654435761u) >> (32u - kHashBits);
+	}
+
+	// Compress data[dictionarySize, size[ as non-final deflate blocks followed by a sync flush,
+	// the output is byte-aligned and can be concatenated with other flushed blocks.
+	// The preceding bytes data[0, dictionarySize[ can be referenced by matches, as in the previous blocks of the stream.
+	void deflateFlushed(const uchar* data, size_t dictionarySize, size_t size, int level, std::vector<uchar>& out){
+		BitWriter bits(out);
+
+		if(level <= 0){
+			size_t offset = dictionarySize;
+			while(offset < size){
+				const uint blockSize = uint((std::min)(size - offset, size_t(65535u)));
+				bits.add(0u, 1u);
+				bits.add(0u, 2u);
+				bits.align();
+				out.push_back(uchar(blockSize & 0xFFu));
+				out.push_back(uchar(blockSize >> 8u));
+				out.push_back(uchar(~blockSize & 0xFFu));
+				out.push_back(uchar((~blockSize >> 8u) & 0xFFu));
+				out.insert(out.end(), data + offset, data + offset + blockSize);
+				offset += blockSize;
+			}
+			return;
+		}
+
+		const uint maxChain = 4u << (uint(glm::clamp(level, 1, 9)) - 1u);
+		std::vector<int> head(size_t(1u) << kHashBits, -1);
+		std::vector<int> prev(kWindowSize, -1);
+
+		auto insert = [&](size_t i){
+			const uint h = hash3(data + i);
+			prev[i & (kWindowSize - 1u)] = head[h];
+			head[h] = int(i);
+		};
+
+		// Prime the window with the dictionary.
+		for(size_t i = 0u; i < dictionarySize && i + kMinMatch <= size; ++i){
+			insert(i);
+		}
+
+		auto findMatch = [&](size_t i, uint& distance) -> uint {
+			const uint maxLength = uint((std::min)(size - i, size_t(kMaxMatch)));
+			uint bestLength = 0u;
+			int candidate = head[hash3(data + i)];
+			uint chain = maxChain;
+			while(candidate >= 0 && (i - size_t(candidate)) < kWindowSize && chain-- > 0u){
+				const uchar* a = data + candidate;
+				const uchar* b = data + i;
+				if(a[bestLength] == b[bestLength]){
+					uint length = 0u;
+					while(length < maxLength && a[length] == b[length]){
+						++length;
+					}
+					if(length > bestLength){
+						bestLength = length;
+						distance = uint(i - size_t(candidate));
+						if(length == maxLength){
+							break;
+						}
+					}
+				}
+				const int next = prev[size_t(candidate) & (kWindowSize - 1u)];
+				if(next >= candidate){
+					break;
+				}
+				candidate = next;
+			}
+			return bestLength;
+		};
+
+		// Fixed Huffman block.
+		bits.add(0u, 1u);
+		bits.add(1u, 2u);
+
+		size_t i = dictionarySize;
+		while(i < size){
+			uint length = 0u;
+			uint distance = 0u;
+			if(i + kMinMatch <= size){
+				length = findMatch(i, distance);
+				insert(i);
+			}
+			// Lazy matching: prefer a literal if the next position has a longer match.
+			if(length >= kMinMatch && level >= 4 && i + 1u + kMinMatch <= size){
+				uint nextDistance = 0u;
+				const uint nextLength = findMatch(i + 1u, nextDistance);
+				if(nextLength > length){
+					writeLiteral(bits, data[i]);
+					++i;
+					continue;
+				}
+			}
+			if(length >= kMinMatch){
+				writeMatch(bits, length, distance);
+				for(size_t k = 1u; k < length; ++k){
+					if(i + k + kMinMatch <= size){
+						insert(i + k);
+					}
+				}
+				i += length;
+			} else {
+				writeLiteral(bits, data[i]);
+				++i;
+			}
+		}
+		// End of block, then sync flush with an empty stored block.
+		writeLiteral(bits, 256u);
+		bits.add(0u, 1u);
+		bits.add(0u, 2u);
+		bits.align();
+		out.push_back(0x00u);
+		out.push_back(0x00u);
+		out.push_back(0xFFu);
+		out.push_back(0xFFu);
+	}
+
+	uchar paeth(int a, int b, int c){
+		const int p = a + b - c;
+		const int pa = std::abs(p - a);
+		const int pb = std::abs(p - b);
+		const int pc = std::abs(p - c);
+		if(pa <= pb && pa <= pc){
+			return uchar(a);
+		}
+		return uchar(pb <= pc ? b : c);
+	}
+
+	void filterRow(uint type, const uchar* row, const uchar* previous, size_t size, uchar* dst){
+		const size_t bpp = 4u;
+		switch(type){
+			case 0:
+				std::memcpy(dst, row, size);
+				break;
+			case 1:
+				std::memcpy(dst, row, bpp);
+				for(size_t i = bpp; i < size; ++i){
+					dst[i] = uchar(row[i] - row[i - bpp]);
+				}
+				break;
+			case 2:
+				for(size_t i = 0u; i < size; ++i){
+					dst[i] = uchar(row[i] - previous[i]);
+				}
+				break;
+			case 3:
+				for(size_t i = 0u; i < bpp; ++i){
+					dst[i] = uchar(row[i] - (previous[i] >> 1));
+				}
+				for(size_t i = bpp; i < size; ++i){
+					dst[i] = uchar(row[i] - ((row[i - bpp] + previous[i]) >> 1));
+				}
+				break;
+			default:
+				for(size_t i = 0u; i < bpp; ++i){
+					dst[i] = uchar(row[i] - previous[i]);
+				}
+				for(size_t i = bpp; i < size; ++i){
+					dst[i] = uchar(row[i] - paeth(row[i - bpp], previous[i], previous[i - bpp]));
+				}
+				break;
+		}
+	}
+
+	void writeBigEndian(uchar* dst, uint value){
+		dst[0] = uchar(value >> 24u);
+		dst[1] = uchar(value >> 16u);
+		dst[2] = uchar(value >> 8u);
+		dst[3] = uchar(value);
+	}
+
+}
+
+PNGWriter::~PNGWriter(){
+	if(_file.is_open()){
+		_file.close();
+	}
+}
+
+bool PNGWriter::open(const fs::path& path, uint w, uint h, int compressionLevel){
+	_file.open(path, std::ios::binary);
+	if(!_file.is_open()){
+		Log::Error() << "Unable to save file at path \"" << path.string() << "\"." << std::endl;
+		return false;
+	}
+	_w = w;
+	_h = h;
+	_level = compressionLevel;
+	_writtenRows = 0u;
+	_filtered.clear();
+	_adlerA = 1u;
+	_adlerB = 0u;
+	_previousRow.assign(size_t(_w) * 4u, 0u);
+
+	static const uchar signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	_file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	uchar header[13];
+	writeBigEndian(header, _w);
+	writeBigEndian(header + 4, _h);
+	header[8] = 8u; // Bit depth
+	header[9] = 6u; // RGBA
+	header[10] = 0u; // Deflate
+	header[11] = 0u; // Adaptive filtering
+	header[12] = 0u; // No interlacing
+	writeChunk("IHDR", header, sizeof(header));
+	return _file.good();
+}
+
+bool PNGWriter::write(const uchar* rows, uint rowCount){
+	if(!_file.is_open() || rowCount == 0u || _writtenRows + rowCount > _h){
+		return false;
+	}
+	const size_t stride = size_t(_w) * 4u;
+	// Keep the end of the previous data as a dictionary.
+	const size_t dictionarySize = (std::min)(_filtered.size(), size_t(kWindowSize));
+	if(dictionarySize > 0u){
+		std::memmove(_filtered.data(), _filtered.data() + _filtered.size() - dictionarySize, dictionarySize);
+	}
+	_filtered.resize(dictionarySize + size_t(rowCount) * (stride + 1u));
+	uchar* filtered = _filtered.data() + dictionarySize;
+
+	System::forParallel(0u, rowCount, [&](size_t r){
+		const uchar* row = rows + r * stride;
+		const uchar* previous = r == 0u ? _previousRow.data() : (row - stride);
+		uchar* dst = filtered + r * (stride + 1u);
+		std::vector<uchar> candidate(stride);
+		// Pick the filter minimizing the sum of absolute differences.
+		int bestScore = INT_MAX;
+		for(uint type = 0u; type < 5u; ++type){
+			filterRow(type, row, previous, stride, candidate.data());
+			int score = 0;
+			for(size_t i = 0u; i < stride; ++i){
+				score += std::abs(int(static_cast<signed char>(candidate[i])));
+			}
+			if(score < bestScore){
+				bestScore = score;
+				dst[0] = uchar(type);
+				std::memcpy(dst + 1u, candidate.data(), stride);
+			}
+		}
+	});
+	std::memcpy(_previousRow.data(), rows + size_t(rowCount - 1u) * stride, stride);
+
+	// Compress chunks of rows in parallel, each using the preceding window as a dictionary.
+	// Chunks boundaries only depend on the image size, for a deterministic output.
+	const size_t chunkRows = (std::max)(size_t(1u), kChunkSize / (stride + 1u));
+	const size_t chunkCount = (rowCount + chunkRows - 1u) / chunkRows;
+	std::vector<std::vector<uchar>> chunks(chunkCount);
+	System::forParallel(0u, chunkCount, [&](size_t c){
+		const size_t begin = c * chunkRows * (stride + 1u);
+		const size_t end = (std::min)(size_t(rowCount), (c + 1u) * chunkRows) * (stride + 1u);
+		const size_t dictionary = (std::min)(dictionarySize + begin, size_t(kWindowSize));
+		const uchar* start = filtered + begin - dictionary;
+		deflateFlushed(start, dictionary, dictionary + end - begin, _level, chunks[c]);
+	});
+
+	// Adler checksum of the uncompressed stream.
+	const size_t filteredSize = size_t(rowCount) * (stride + 1u);
+	size_t offset = 0u;
+	while(offset < filteredSize){
+		const size_t blockEnd = (std::min)(filteredSize, offset + 5552u);
+		for(; offset < blockEnd; ++offset){
+			_adlerA += filtered[offset];
+			_adlerB += _adlerA;
+		}
+		_adlerA %= 65521u;
+		_adlerB %= 65521u;
+	}
+
+	if(_writtenRows == 0u){
+		// Zlib header.
+		const uchar header[] = {0x78u, 0x9Cu};
+		writeChunk("IDAT", header, sizeof(header));
+	}
+	for(const std::vector<uchar>& chunk : chunks){
+		writeChunk("IDAT", chunk.data(), chunk.size());
+	}
+
+	_writtenRows += rowCount;
+	return _file.good();
+}
+
+bool PNGWriter::write(const fs::path& path, uint w, uint h, const uchar* data, int compressionLevel){
+	PNGWriter writer;
+	if(!writer.open(path, w, h, compressionLevel)){
+		return false;
+	}
+	// Submit large strips to bound the size of the intermediate filtered data.
+	const uint stripRows = (std::max)(1u, uint(kStripSize / (size_t(w) * 4u + 1u)));
+	for(uint y = 0u; y < h; y += stripRows){
+		const uint rowCount = (std::min)(stripRows, h - y);
+		if(!writer.write(data + size_t(y) * w * 4u, rowCount)){
+			return false;
+		}
+	}
+	return writer.close();
+}
+
+bool PNGWriter::close(){
+	if(!_file.is_open()){
+		return false;
+	}
+	if(_writtenRows != _h){
+		Log::Error() << "Incomplete PNG image, " << _writtenRows << " rows written out of " << _h << "." << std::endl;
+		_file.close();
+		return false;
+	}
+	// Final empty fixed Huffman block and Adler checksum.
+	uchar end[6] = {0x03u, 0x00u};
+	writeBigEndian(end + 2, (_adlerB << 16u) | _adlerA);
+	writeChunk("IDAT", end, sizeof(end));
+	writeChunk("IEND", nullptr, 0u);
+	const bool success = _file.good();
+	_file.close();
+	return success;
+}
+
+void PNGWriter::writeChunk(const char* type, const uchar* data, size_t size){
+	const uint* crcTable = fixedCodes().crc;
+	uchar length[4];
+	writeBigEndian(length, uint(size));
+	_file.write(reinterpret_cast<const char*>(length), 4);
+	_file.write(type, 4);
+
+	uint crc = 0xFFFFFFFFu;
+	for(uint i = 0u; i < 4u; ++i){
+		crc = crcTable[(crc ^ uchar(type[i])) & 0xFFu] ^ (crc >> 8u);
+	}
+	for(size_t i = 0u; i < size; ++i){
+		crc = crcTable[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8u);
+	}
+	if(size > 0u){
+		_file.write(reinterpret_cast<const char*>(data), size);
+	}
+	uchar checksum[4];
+	writeBigEndian(checksum, ~crc);
+	_file.write(reinterpret_cast<const char*>(checksum), 4);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "core/Common.hpp"
+#include "core/system/System.hpp"
+#include <fstream>
+#include <climits>
+
+/// Incremental RGBA8 PNG encoder: rows are filtered, deflated and written to disk as soon as they are submitted.
+/// Submitted rows are split in chunks that are filtered and deflated in parallel, each ending with a sync flush.
+class PNGWriter {
+public:
+
+	PNGWriter() = default;
+
+	PNGWriter(const PNGWriter& ) = delete;
+	PNGWriter& operator=(const PNGWriter& ) = delete;
+
+	~PNGWriter();
+
+	bool open(const fs::path& path, uint w, uint h, int compressionLevel = kDefaultCompressionLevel);
+
+	/// Append rowCount rows of tightly packed RGBA8 pixels.
+	bool write(const uchar* rows, uint rowCount);
+
+	/// Write the end of the stream, all rows should have been submitted.
+	bool close();
+
+	/// Write a full image of tightly packed RGBA8 pixels.
+	static bool write(const fs::path& path, uint w, uint h, const uchar* data, int compressionLevel = kDefaultCompressionLevel);
+
+	static const int kDefaultCompressionLevel = 3;
+
+private:
+
+	void writeChunk(const char* type, const uchar* data, size_t size);
+
+	std::ofstream _file;
+	std::vector<uchar> _previousRow;
+	std::vector<uchar> _filtered;
+	uint _w{0u};
+	uint _h{0u};
+	uint _writtenRows{0u};
+	uint _adlerA{1u};
+	uint _adlerB{0u};
+	int _level{kDefaultCompressionLevel};
+};
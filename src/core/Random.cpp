@@ -39,6 +39,28 @@ glm::vec4 Random::Color(){
 	return glm::vec4(rgb, alpha);
 }
 
+glm::uvec4 Random::hash(const glm::uvec4& key){
+	// Jarzynski and Olano, "Hash Functions for GPU Rendering", 2020.
+	glm::uvec4 v = key * 1664525u + 1013904223u;
+	v.x += v.y * v.w; v.y += v.z * v.x; v.z += v.x * v.y; v.w += v.y * v.z;
+	v ^= v >> 16u;
+	v.x += v.y * v.w; v.y += v.z * v.x; v.z += v.x * v.y; v.w += v.y * v.z;
+	return v;
+}
+
+glm::vec4 Random::Floats(const glm::uvec4& key){
+	// Keep the 24 high bits, exactly representable.
+	return glm::vec4(hash(key) >> 8u) * (1.0f / 16777216.0f);
+}
+
+glm::vec4 Random::Color(const glm::vec4& uniforms){
+	const float hue = 360.0f * uniforms[0];
+	const float saturation = glm::mix(0.5f, 0.95f, uniforms[1]);
+	const float value = glm::mix(0.5f, 0.95f, uniforms[2]);
+	const glm::vec3 rgb = glm::rgbColor(glm::vec3(hue, saturation, value));
+	return glm::vec4(rgb, uniforms[3]);
+}
+
 Random::LocalMT19937::LocalMT19937() {
 	// Get a lock on the shared MT generator.
 	std::lock_guard<std::mutex> guard(_lock);
@@ -51,6 +51,25 @@ public:
 	 */
 	static glm::vec4 Color();
 
+	/** Hash four integers into four well-distributed values, using the PCG4D hash.
+	 Stateless, it can be used from any thread to get reproducible results.
+	 \param key the values to hash
+	 \return the hashed values
+	 */
+	static glm::uvec4 hash(const glm::uvec4& key);
+
+	/** Generate four floats in [0.0, 1.0) from a key, statelessly.
+	 \param key the counter to generate values for
+	 \return four floats in [0.0, 1.0)
+	 */
+	static glm::vec4 Floats(const glm::uvec4& key);
+
+	/** Convert four floats in [0.0, 1.0) to a random color, as in Color().
+	 \param uniforms four floats in [0.0, 1.0)
+	 \return an RGBA.
+	 */
+	static glm::vec4 Color(const glm::vec4& uniforms);
+
 private:
 	/** \brief A MT19937 generator seeded using the shared generator.
 	 	Used to provide per-thread MT19937 generators in a thread-safe way.
@@ -19,6 +19,16 @@ void AddNode::evaluate(LocalContext& context, const std::vector<int>& inputs, co
 	}
 }
 
+void AddNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		const ValueRange& x = inputs[i];
+		const ValueRange& y = inputs[i+_channelCount];
+		if(x.bounded() && y.bounded()){
+			outputs[i] = { x.min + y.min, x.max + y.max };
+		}
+	}
+}
+
 
 SubtractNode::SubtractNode(){
 	_name = "Minus";
@@ -38,6 +48,16 @@ void SubtractNode::evaluate(LocalContext& context, const std::vector<int>& input
 	}
 }
 
+void SubtractNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		const ValueRange& x = inputs[i];
+		const ValueRange& y = inputs[i+_channelCount];
+		if(x.bounded() && y.bounded()){
+			outputs[i] = { x.min - y.max, x.max - y.min };
+		}
+	}
+}
+
 ProductNode::ProductNode(){
 	_name = "Product";
 	_description = "M=X*Y";
@@ -56,6 +76,21 @@ void ProductNode::evaluate(LocalContext& context, const std::vector<int>& inputs
 	}
 }
 
+void ProductNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		const ValueRange& x = inputs[i];
+		const ValueRange& y = inputs[i+_channelCount];
+		// Only track small ranges to avoid overflows.
+		if(x.within(-1.f, 1.f) && y.within(-1.f, 1.f)){
+			const float p0 = x.min * y.min;
+			const float p1 = x.min * y.max;
+			const float p2 = x.max * y.min;
+			const float p3 = x.max * y.max;
+			outputs[i] = { (std::min)({p0, p1, p2, p3}), (std::max)({p0, p1, p2, p3}), x.binary && y.binary };
+		}
+	}
+}
+
 DivideNode::DivideNode(){
 	_name = "Divide";
 	_description = "M=X/Y";
@@ -95,6 +130,18 @@ void ScaleOffsetNode::evaluate(LocalContext& context, const std::vector<int>& in
 	}
 }
 
+void ScaleOffsetNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	const float a = _attributes[0].flt;
+	const float b = _attributes[1].flt;
+	for(uint i = 0; i < _channelCount; ++i){
+		if(inputs[i].bounded()){
+			const float v0 = a * inputs[i].min + b;
+			const float v1 = a * inputs[i].max + b;
+			outputs[i] = { (std::min)(v0, v1), (std::max)(v0, v1) };
+		}
+	}
+}
+
 MinNode::MinNode(){
 	_name = "Minimum";
 	_description = "M=min(X,Y)";
@@ -113,6 +160,14 @@ void MinNode::evaluate(LocalContext& context, const std::vector<int>& inputs, co
 	}
 }
 
+void MinNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		const ValueRange& x = inputs[i];
+		const ValueRange& y = inputs[i+_channelCount];
+		outputs[i] = { (std::min)(x.min, y.min), (std::min)(x.max, y.max), x.binary && y.binary };
+	}
+}
+
 MaxNode::MaxNode(){
 	_name = "Maximum";
 	_description = "M=max(X,Y)";
@@ -131,6 +186,14 @@ void MaxNode::evaluate(LocalContext& context, const std::vector<int>& inputs, co
 	}
 }
 
+void MaxNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		const ValueRange& x = inputs[i];
+		const ValueRange& y = inputs[i+_channelCount];
+		outputs[i] = { (std::max)(x.min, y.min), (std::max)(x.max, y.max), x.binary && y.binary };
+	}
+}
+
 ClampNode::ClampNode(){
 	_name = "Clamp";
 	_description = "M=min(max(X,A),B)";
@@ -152,6 +215,18 @@ void ClampNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 	}
 }
 
+void ClampNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	const float a = _attributes[0].flt;
+	const float b = _attributes[1].flt;
+	if(a > b){
+		return;
+	}
+	for(uint i = 0; i < _channelCount; ++i){
+		const ValueRange& x = inputs[i];
+		outputs[i] = { glm::clamp(x.min, a, b), glm::clamp(x.max, a, b), x.binary && a <= 0.f && b >= 1.f };
+	}
+}
+
 PowerNode::PowerNode(){
 	_name = "Power";
 	_description = "M=X^Y";
@@ -244,6 +319,16 @@ void MixNode::evaluate(LocalContext& context, const std::vector<int>& inputs, co
 	}
 }
 
+void MixNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		const ValueRange& t = inputs[i+2*_channelCount];
+		if(t.within(0.f, 1.f)){
+			outputs[i] = ValueRange::hull(inputs[i], inputs[i+_channelCount]);
+			outputs[i].binary &= t.binary;
+		}
+	}
+}
+
 SinNode::SinNode(){
 	_name = "Sine";
 	_description = "M=sin(X)";
@@ -262,6 +347,13 @@ void SinNode::evaluate(LocalContext& context, const std::vector<int>& inputs, co
 	}
 }
 
+void SinNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = { -1.f, 1.f };
+	}
+}
+
 CosNode::CosNode(){
 	_name = "Cosine";
 	_description = "M=cos(X)";
@@ -280,6 +372,13 @@ void CosNode::evaluate(LocalContext& context, const std::vector<int>& inputs, co
 	}
 }
 
+void CosNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = { -1.f, 1.f };
+	}
+}
+
 TanNode::TanNode(){
 	_name = "Tangent";
 	_description = "M=tan(X)";
@@ -393,6 +492,14 @@ void AbsNode::evaluate(LocalContext& context, const std::vector<int>& inputs, co
 	}
 }
 
+void AbsNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		const ValueRange& x = inputs[i];
+		const float mini = (x.min <= 0.f && x.max >= 0.f) ? 0.f : (std::min)(std::abs(x.min), std::abs(x.max));
+		outputs[i] = { mini, (std::max)(std::abs(x.min), std::abs(x.max)), x.binary };
+	}
+}
+
 FractNode::FractNode(){
 	_name = "Fractional part";
 	_description = "M=X-\\X/";
@@ -411,6 +518,13 @@ void FractNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 	}
 }
 
+void FractNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::unit();
+	}
+}
+
 ModuloNode::ModuloNode(){
 	_name = "Modulo";
 	_description = "M=X%Y"; 
@@ -483,6 +597,13 @@ void StepNode::evaluate(LocalContext& context, const std::vector<int>& inputs, c
 	}
 }
 
+void StepNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::boolean();
+	}
+}
+
 SmoothstepNode::SmoothstepNode(){
 	_name = "Smoothstep";
 	_description = "M=smooth transition from 0 to 1 when X goes from A to B";
@@ -501,6 +622,13 @@ void SmoothstepNode::evaluate(LocalContext& context, const std::vector<int>& inp
 	}
 }
 
+void SmoothstepNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::unit();
+	}
+}
+
 SignNode::SignNode(){
 	_name = "Sign";
 	_description = "M=if X > 0 then 1, if X < 0 then -1, if X = 0 then 0";
@@ -519,6 +647,13 @@ void SignNode::evaluate(LocalContext& context, const std::vector<int>& inputs, c
 	}
 }
 
+void SignNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = { -1.f, 1.f };
+	}
+}
+
 LengthNode::LengthNode(){
 	_name = "Length";
 	_description = "M=|X|";
@@ -564,3 +699,10 @@ void NormalizeNode::evaluate(LocalContext& context, const std::vector<int>& inpu
 		context.stack[outputs[i]] = context.stack[inputs[i]] / denom;
 	}
 }
+
+void NormalizeNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = { -1.f, 1.f };
+	}
+}
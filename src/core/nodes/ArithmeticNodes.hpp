@@ -8,6 +8,8 @@ public:
 	AddNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 
@@ -17,6 +19,8 @@ public:
 	SubtractNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class ProductNode : public Node {
@@ -25,6 +29,8 @@ public:
 	ProductNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class DivideNode : public Node {
@@ -41,6 +47,8 @@ public:
 	ScaleOffsetNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class MinNode : public Node {
@@ -49,6 +57,8 @@ public:
 	MinNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 
@@ -58,6 +68,8 @@ public:
 	MaxNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class ClampNode : public Node {
@@ -66,6 +78,8 @@ public:
 	ClampNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class PowerNode : public Node {
@@ -106,6 +120,8 @@ public:
 	MixNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class SinNode : public Node {
@@ -114,6 +130,8 @@ public:
 	SinNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class CosNode : public Node {
@@ -122,6 +140,8 @@ public:
 	CosNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class TanNode : public Node {
@@ -170,6 +190,8 @@ public:
 	AbsNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class FractNode : public Node {
@@ -178,6 +200,8 @@ public:
 	FractNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class ModuloNode : public Node {
@@ -210,6 +234,8 @@ public:
 	StepNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class SmoothstepNode : public Node {
@@ -218,6 +244,8 @@ public:
 	SmoothstepNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class SignNode : public Node {
@@ -226,6 +254,8 @@ public:
 	SignNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class LengthNode : public Node {
@@ -242,4 +272,6 @@ public:
 	NormalizeNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
@@ -19,6 +19,12 @@ void SelectNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 	}
 }
 
+void SelectNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::hull(inputs[i], inputs[i+_channelCount]);
+	}
+}
+
 static constexpr float kEpsilon = 1e-5f;
 
 EqualNode::EqualNode(){
@@ -40,6 +46,13 @@ void EqualNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 	}
 }
 
+void EqualNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::boolean();
+	}
+}
+
 DifferentNode::DifferentNode(){
 	_name = "Different";
 	_description = "B = (X!=Y) ?";
@@ -59,6 +72,13 @@ void DifferentNode::evaluate(LocalContext& context, const std::vector<int>& inpu
 	}
 }
 
+void DifferentNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::boolean();
+	}
+}
+
 GreaterNode::GreaterNode(){
 	_name = "Greater";
 	_description = "B = X>Y (strict)\nB = X≥Y (otherwise)";
@@ -86,6 +106,13 @@ void GreaterNode::evaluate(LocalContext& context, const std::vector<int>& inputs
 
 }
 
+void GreaterNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::boolean();
+	}
+}
+
 LessNode::LessNode(){
 	_name = "Less";
 	_description = "B = X<Y (strict)\nB = X≤Y (otherwise)";
@@ -111,6 +138,13 @@ void LessNode::evaluate(LocalContext& context, const std::vector<int>& inputs, c
 	}
 }
 
+void LessNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::boolean();
+	}
+}
+
 NegateNode::NegateNode(){
 	_name = "Not";
 	_description = "B= not X";
@@ -129,3 +163,10 @@ void NegateNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 	}
 }
 
+void NegateNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::boolean();
+	}
+}
+
@@ -9,6 +9,8 @@ public:
 	SelectNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 
@@ -18,6 +20,8 @@ public:
 	EqualNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class DifferentNode : public Node {
@@ -26,6 +30,8 @@ public:
 	DifferentNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 
@@ -35,6 +41,8 @@ public:
 	GreaterNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 
@@ -44,6 +52,8 @@ public:
 	LessNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 
@@ -53,4 +63,6 @@ public:
 	NegateNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
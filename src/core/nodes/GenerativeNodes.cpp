@@ -22,6 +22,14 @@ void ConstantFloatNode::evaluate(LocalContext& context, const std::vector<int>&
 	}
 }
 
+void ConstantFloatNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	const float value = _attributes[0].flt;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = { value, value, value == 0.f || value == 1.f };
+	}
+}
+
 ConstantRGBANode::ConstantRGBANode(){
 	_name = "Constant";
 	_description = "Constant RGBA value.";
@@ -42,6 +50,21 @@ void ConstantRGBANode::evaluate(LocalContext& context, const std::vector<int>& i
 	}
 }
 
+void ConstantRGBANode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0u; i < 4u; ++i){
+		const float value = _attributes[0].clr[i];
+		outputs[i] = { value, value, value == 0.f || value == 1.f };
+	}
+}
+
+// Counter-based random values, reproducible for any thread count and evaluation order.
+glm::vec4 pixelRandom(const LocalContext& context, uint nodeId){
+	const SharedContext& shared = *context.shared;
+	const glm::uvec4 key = Random::hash(glm::uvec4(shared.randomSeed, nodeId, shared.batch, 0u));
+	return Random::Floats(glm::uvec4(uint(context.coords.x), uint(context.coords.y), key.x, key.y));
+}
+
 UniformRandomNode::UniformRandomNode(){
 	_name = "Random";
 	_description = "Random value in [min, max[";
@@ -60,12 +83,21 @@ void UniformRandomNode::evaluate(LocalContext& context, const std::vector<int>&
 	(void)inputs;
 	const float mini = _attributes[0].flt;
 	const float maxi = _attributes[1].flt;
-	float val = Random::Float(mini, maxi);
+	const float val = context.shared->legacyRandom ? Random::Float(mini, maxi) : glm::mix(mini, maxi, pixelRandom(context, _id).x);
 	for(uint i = 0; i < _channelCount; ++i){
 		context.stack[outputs[i]] = val;
 	}
 }
 
+void UniformRandomNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	const float mini = _attributes[0].flt;
+	const float maxi = _attributes[1].flt;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = { (std::min)(mini, maxi), (std::max)(mini, maxi) };
+	}
+}
+
 RandomColorNode::RandomColorNode(){
 	_name = "Random color";
 	_description = "Random color in [0,1]^4";
@@ -80,12 +112,19 @@ void RandomColorNode::evaluate(LocalContext& context, const std::vector<int>& in
 	assert(outputs.size() == 4u);
 	(void)inputs;
 
-	const glm::vec4 rgba = Random::Color();
+	const glm::vec4 rgba = context.shared->legacyRandom ? Random::Color() : Random::Color(pixelRandom(context, _id));
 	for (uint i = 0u; i < 4u; ++i) {
 		context.stack[outputs[i]] = rgba[i];
 	}
 }
 
+void RandomColorNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0u; i < 4u; ++i){
+		outputs[i] = ValueRange::unit();
+	}
+}
+
 GradientNode::GradientNode(){
 	_name = "Gradient";
 	_description = "Gradient: radial, angular, diamond, mirror";
@@ -114,3 +153,101 @@ void GradientNode::evaluate(LocalContext& context, const std::vector<int>& input
 		context.stack[outputs[i]] = result[i];
 	}
 }
+
+void GradientNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0u; i < 4u; ++i){
+		outputs[i] = ValueRange::unit();
+	}
+}
+
+PerlinNoiseNode::PerlinNoiseNode(){
+	_name = "Perlin noise";
+	_description = "Tileable Perlin noise summed over octaves, each channel is independent";
+	_outputNames = { {"X", true} };
+	_attributes = { {"Scale", Attribute::Type::FLOAT}, {"Octaves", Attribute::Type::FLOAT}, {"Lacunarity", Attribute::Type::FLOAT},
+		{"Gain", Attribute::Type::FLOAT}, {"Seed", Attribute::Type::FLOAT} };
+	_attributes[0].flt = 8.f;
+	_attributes[1].flt = 4.f;
+	_attributes[2].flt = 2.f;
+	_attributes[3].flt = 0.5f;
+	_attributes[4].flt = 0.f;
+	finalize();
+}
+
+NODE_DEFINE_TYPE_AND_VERSION(PerlinNoiseNode, NodeClass::PERLIN_NOISE, 1)
+
+// Dot products between the offset to a lattice point and its gradients, one per channel.
+glm::vec4 perlinCornerContributions(uint x, uint y, uint key, const glm::vec2& offset){
+	static const glm::vec2 kGradients[8] = {
+		{1.f, 0.f}, {-1.f, 0.f}, {0.f, 1.f}, {0.f, -1.f},
+		{0.70710678f, 0.70710678f}, {-0.70710678f, 0.70710678f}, {0.70710678f, -0.70710678f}, {-0.70710678f, -0.70710678f},
+	};
+	// The hash replaces the permutation table, the three high bits pick a gradient for each channel.
+	const glm::uvec4 hash = Random::hash(glm::uvec4(x, y, key, 0u)) >> 29u;
+	glm::vec4 contributions;
+	for(uint i = 0u; i < 4u; ++i){
+		contributions[i] = glm::dot(kGradients[hash[i]], offset);
+	}
+	return contributions;
+}
+
+// Lattice coordinates wrap after period cells, for the noise to tile.
+glm::vec4 perlinNoise(const glm::vec2& p, int period, uint key){
+	const glm::vec2 cell = glm::floor(p);
+	const glm::vec2 f = p - cell;
+	const int x = int(cell.x) % period;
+	const int y = int(cell.y) % period;
+	const uint x0 = uint(x);
+	const uint y0 = uint(y);
+	const uint x1 = uint((x + 1) % period);
+	const uint y1 = uint((y + 1) % period);
+
+	const glm::vec4 n00 = perlinCornerContributions(x0, y0, key, f);
+	const glm::vec4 n10 = perlinCornerContributions(x1, y0, key, f - glm::vec2(1.f, 0.f));
+	const glm::vec4 n01 = perlinCornerContributions(x0, y1, key, f - glm::vec2(0.f, 1.f));
+	const glm::vec4 n11 = perlinCornerContributions(x1, y1, key, f - glm::vec2(1.f, 1.f));
+	// Quintic interpolation.
+	const glm::vec2 u = f * f * f * (f * (f * 6.f - 15.f) + 10.f);
+	return glm::mix(glm::mix(n00, n10, u.x), glm::mix(n01, n11, u.x), u.y);
+}
+
+void PerlinNoiseNode::evaluate(LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs) const {
+	assert(inputs.size() == 0u);
+	assert(outputs.size() == _channelCount);
+	(void)inputs;
+
+	const float scale = (std::max)(_attributes[0].flt, 1.f);
+	const int octaves = glm::clamp(int(std::round(_attributes[1].flt)), 1, 16);
+	const float lacunarity = (std::max)(_attributes[2].flt, 1.f);
+	const float gain = _attributes[3].flt;
+	const uint seed = uint(int(_attributes[4].flt));
+
+	// Noise is defined in UV space, to be identical in previews.
+	const glm::vec2 uv = (glm::vec2(context.coords) + 0.5f) / glm::vec2(context.shared->dims);
+	glm::vec4 sum(0.f);
+	float amplitude = 1.f;
+	float totalAmplitude = 0.f;
+	float frequency = scale;
+	for(int octave = 0; octave < octaves; ++octave){
+		// Round the frequency to an integer number of cells to preserve tiling.
+		const int period = (std::max)(int(std::round(frequency)), 1);
+		const uint key = Random::hash(glm::uvec4(seed, uint(octave), 0u, 0u)).x;
+		sum += amplitude * perlinNoise(uv * float(period), period, key);
+		totalAmplitude += std::abs(amplitude);
+		amplitude *= gain;
+		frequency *= lacunarity;
+	}
+	// Perlin noise with unit gradients is in [-sqrt(2)/2, sqrt(2)/2].
+	const glm::vec4 result = glm::clamp(0.5f + 0.5f * glm::root_two<float>() * sum / (std::max)(totalAmplitude, 1e-4f), 0.f, 1.f);
+	for(uint i = 0u; i < _channelCount; ++i){
+		context.stack[outputs[i]] = result[i];
+	}
+}
+
+void PerlinNoiseNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0u; i < _channelCount; ++i){
+		outputs[i] = ValueRange::unit();
+	}
+}
@@ -8,6 +8,8 @@ public:
 	ConstantFloatNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class ConstantRGBANode : public Node {
@@ -16,6 +18,8 @@ public:
 	ConstantRGBANode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 class UniformRandomNode : public Node {
@@ -24,6 +28,10 @@ public:
 	UniformRandomNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
 };
 
 class RandomColorNode : public Node {
@@ -32,6 +40,10 @@ public:
 	RandomColorNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
 };
 
 class GradientNode : public Node {
@@ -40,4 +52,20 @@ public:
 	GradientNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
+};
+
+class PerlinNoiseNode : public Node {
+public:
+
+	PerlinNoiseNode();
+
+	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
 };
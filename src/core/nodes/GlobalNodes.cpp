@@ -1,29 +1,92 @@
 #include "core/nodes/GlobalNodes.hpp"
 #include "core/nodes/Nodes.hpp"
+#include "core/system/System.hpp"
 
 
-void copyInputsToImage(const std::vector<Image>& srcs, const std::vector<int>& inputs, Image& dst){
+void copyInputsToImage(const std::vector<Image>& srcs, const std::vector<int>& inputs, Image& dst, const Region& region){
 	const uint channelCount = glm::min(4u, (uint)inputs.size());
 	for(uint i = 0u; i < channelCount; ++i){
 		const uint srcId = inputs[i];
 		const uint imageId = srcId / 4u;
 		const uint channelId = srcId % 4u;
 		const Image& src = srcs[imageId];
-		for(uint y = 0; y < dst.h(); ++y){
-			for(uint x = 0; x < dst.w(); ++x){
-				dst.pixel(x, y)[i] = src.pixel(x,y)[channelId];
+		for(int y = region.min.y; y < region.max.y; ++y){
+			for(int x = region.min.x; x < region.max.x; ++x){
+				dst.pixel(x, y)[i] = src.channel(x, y, channelId);
 			}
 		}
 	}
 	for(uint i = channelCount; i < 4u; ++i){
-		for(uint y = 0; y < dst.h(); ++y){
-			for(uint x = 0; x < dst.w(); ++x){
+		for(int y = region.min.y; y < region.max.y; ++y){
+			for(int x = region.min.x; x < region.max.x; ++x){
 				dst.pixel(x, y)[i] = 0.f;
 			}
 		}
 	}
 }
 
+// Read the first four inputs of a node at a given pixel, from the images they are stored in.
+glm::vec4 readInputs(const std::vector<Image>& srcs, const std::vector<int>& inputs, const glm::ivec2& coords){
+	glm::vec4 values(0.f);
+	const uint channelCount = glm::min(4u, (uint)inputs.size());
+	for(uint i = 0u; i < channelCount; ++i){
+		const uint srcId = inputs[i];
+		values[i] = srcs[srcId / 4u].channel(coords, srcId % 4u);
+	}
+	return values;
+}
+
+const uint kReductionChunkCount = 64u;
+const uint kHistogramBinCount = 256u;
+
+/// Reduce the rows of an image in parallel. Rows are split in a fixed number of chunks, each with its own partial result,
+/// combined in order at the end so that the result does not depend on the thread count.
+template<typename T, typename ReduceRow, typename Combine>
+T reduceRows(uint h, const T& identity, ReduceRow reduceRow, Combine combine){
+	const uint chunkCount = glm::clamp(h, 1u, kReductionChunkCount);
+	std::vector<T> partials(chunkCount, identity);
+	System::forParallel(0, chunkCount, [&partials, &reduceRow, h, chunkCount](size_t chunk){
+		const uint firstRow = uint(chunk * h / chunkCount);
+		const uint endRow = uint((chunk + 1u) * h / chunkCount);
+		for(uint y = firstRow; y < endRow; ++y){
+			reduceRow(partials[chunk], y);
+		}
+	});
+	T result = identity;
+	for(const T& partial : partials){
+		combine(result, partial);
+	}
+	return result;
+}
+
+struct ChannelStatistics {
+	glm::vec4 min{FLT_MAX};
+	glm::vec4 max{-FLT_MAX};
+	glm::dvec4 sum{0.0};
+};
+
+ChannelStatistics computeStatistics(const std::vector<Image>& srcs, const std::vector<int>& inputs, const glm::ivec2& dims){
+	const uint channelCount = glm::min(4u, (uint)inputs.size());
+	auto reduceRow = [&srcs, &inputs, channelCount, &dims](ChannelStatistics& stats, uint y){
+		for(uint i = 0u; i < channelCount; ++i){
+			const Image& src = srcs[inputs[i] / 4u];
+			const uint channelId = inputs[i] % 4u;
+			for(int x = 0; x < dims.x; ++x){
+				const float value = src.channel(x, y, channelId);
+				stats.min[i] = glm::min(stats.min[i], value);
+				stats.max[i] = glm::max(stats.max[i], value);
+				stats.sum[i] += value;
+			}
+		}
+	};
+	auto combine = [](ChannelStatistics& stats, const ChannelStatistics& other){
+		stats.min = glm::min(stats.min, other.min);
+		stats.max = glm::max(stats.max, other.max);
+		stats.sum += other.sum;
+	};
+	return reduceRows(dims.y, ChannelStatistics(), reduceRow, combine);
+}
+
 FlipNode::FlipNode(){
 	_name = "Flip";
 	_description = "Flip an image content along the horizontal/vertical axis";
@@ -53,8 +116,27 @@ void FlipNode::evaluate(LocalContext& context, const std::vector<int>& inputs, c
 		const uint channelId = srcId % 4u;
 
 		const Image& src = context.shared->tmpImagesRead[imageId];
-		context.stack[dstId] = src.pixel(xOld, yOld)[channelId];
+		context.stack[dstId] = src.channel(xOld, yOld, channelId);
+	}
+}
+
+void FlipNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = inputs[i];
+	}
+}
+
+Region FlipNode::footprint(const Region& region, const SharedContext& context) const {
+	const bool horizontal = _attributes[0].cmb == 0;
+	Region mirrored = region;
+	if(horizontal){
+		mirrored.min.y = context.dims.y - region.max.y;
+		mirrored.max.y = context.dims.y - region.min.y;
+	} else {
+		mirrored.min.x = context.dims.x - region.max.x;
+		mirrored.max.x = context.dims.x - region.min.x;
 	}
+	return mirrored;
 }
 
 
@@ -99,16 +181,20 @@ void TileNode::evaluate(LocalContext& context, const std::vector<int>& inputs, c
 
 		const Image& src = context.shared->tmpImagesRead[ imageId ];
 
-		const float px0y0 = src.pixel(c00.x, c00.y)[channelId];
-		const float px1y0 = src.pixel(c11.x, c00.y)[channelId];
-		const float px0y1 = src.pixel(c00.x, c11.y)[channelId];
-		const float px1y1 = src.pixel(c11.x, c11.y)[channelId];
+		const glm::vec4 px = src.gather(c00, c11, channelId);
 
-		const float value = (1.f - frac.x) * (1.f - frac.y) * px0y0 + (frac.x) * (1.f - frac.y) * px1y0 + (1.f - frac.x) * (frac.y) * px0y1 + (frac.x) * (frac.y) * px1y1;
+		const float value = (1.f - frac.x) * (1.f - frac.y) * px[0] + (frac.x) * (1.f - frac.y) * px[1] + (1.f - frac.x) * (frac.y) * px[2] + (frac.x) * (frac.y) * px[3];
 		context.stack[ dstId ] = value;
 	}
 }
 
+void TileNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	// Interpolation preserves the range but not discrete values.
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = { inputs[i].min, inputs[i].max };
+	}
+}
+
 
 RotateNode::RotateNode(){
 	_name = "Rotate";
@@ -155,16 +241,21 @@ void RotateNode::evaluate( LocalContext& context, const std::vector<int>& inputs
 
 		const Image& src = context.shared->tmpImagesRead[ imageId ];
 
-		const float px0y0 = src.pixel(c00.x, c00.y)[channelId];
-		const float px1y0 = src.pixel(c11.x, c00.y)[channelId];
-		const float px0y1 = src.pixel(c00.x, c11.y)[channelId];
-		const float px1y1 = src.pixel(c11.x, c11.y)[channelId];
+		const glm::vec4 px = src.gather(c00, c11, channelId);
 
-		const float value = (1.f - frac.x) * (1.f - frac.y) * px0y0 + (frac.x) * (1.f - frac.y) * px1y0 + (1.f - frac.x) * (frac.y) * px0y1 + (frac.x) * (frac.y) * px1y1;
+		const float value = (1.f - frac.x) * (1.f - frac.y) * px[0] + (frac.x) * (1.f - frac.y) * px[1] + (1.f - frac.x) * (frac.y) * px[2] + (frac.x) * (frac.y) * px[3];
 		context.stack[ dstId ] = value;
 	}
 }
 
+void RotateNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	// Interpolation preserves the range but not discrete values.
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = { inputs[i].min, inputs[i].max };
+	}
+}
+
+
 GaussianBlurNode::GaussianBlurNode(){
 	_name = "Gaussian Blur";
 	_description = "Apply a gaussian of a given radius to an image content.";
@@ -177,11 +268,11 @@ GaussianBlurNode::GaussianBlurNode(){
 
 NODE_DEFINE_TYPE_AND_VERSION(GaussianBlurNode, NodeClass::GAUSSIAN_BLUR, 1)
 
-void GaussianBlurNode::prepare(SharedContext& context, const std::vector<int>& inputs) const {
+void GaussianBlurNode::prepare(SharedContext& context, const std::vector<int>& inputs, const Region& region) const {
 	assert(inputs.size() == _channelCount);
 	assert(inputs.size() <= 4);
 
-	copyInputsToImage(context.tmpImagesRead, inputs, context.tmpImagesGlobal[0]);
+	copyInputsToImage(context.tmpImagesRead, inputs, context.globalImage(_id), footprint(region, context));
 }
 
 void GaussianBlurNode::evaluate(LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs) const {
@@ -194,7 +285,7 @@ void GaussianBlurNode::evaluate(LocalContext& context, const std::vector<int>& i
 	const int radius = (int)std::ceil(radiusFrac) + 1;
 	const float normalization = 1.f / (glm::two_pi<float>() * sigma2);
 
-	const Image& src = context.shared->tmpImagesGlobal[0];
+	const Image& src = context.shared->globalImage(_id);
 	glm::vec4 accum { 0.0f};
 	float denom = 0.f;
 	// No axis separation for now.
@@ -214,6 +305,18 @@ void GaussianBlurNode::evaluate(LocalContext& context, const std::vector<int>& i
 	}
 }
 
+void GaussianBlurNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	// Interpolation preserves the range but not discrete values.
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = { inputs[i].min, inputs[i].max };
+	}
+}
+
+int GaussianBlurNode::radius(const SharedContext& context) const {
+	const float radiusFrac = _attributes[0].flt * (context.scale.x + context.scale.y) * 0.5f;
+	return (int)std::ceil(radiusFrac) + 1;
+}
+
 PickerNode::PickerNode(){
 	_name = "Color picker";
 	_description = "Read the color at a given pixel and broadcast it to all.";
@@ -234,18 +337,39 @@ void PickerNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 	xy *= context.shared->scale;
 	const glm::ivec2 coords = glm::clamp( glm::ivec2(xy), {0, 0}, context.shared->dims - 1);
 
+	// The picked pixel has its inputs in registers. When evaluating nodes one at a time,
+	// other pixels read them from the previous step.
+	const bool picked = coords == context.coords;
 	for(uint i = 0u; i < _channelCount; ++i){
 		const uint srcId = inputs[i];
 		const uint dstId = outputs[i];
 
+		if(picked){
+			context.stack[dstId] = context.stack[srcId];
+			continue;
+		}
 		const uint imageId = srcId / 4u;
 		const uint channelId = srcId % 4u;
 
 		const Image& src = context.shared->tmpImagesRead[imageId];
-		context.stack[dstId] = src.pixel(coords)[channelId];
+		context.stack[dstId] = src.channel(coords, channelId);
+	}
+}
+
+void PickerNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = inputs[i];
 	}
 }
 
+Region PickerNode::footprint(const Region& region, const SharedContext& context) const {
+	(void)region;
+	glm::vec2 xy( _attributes[ 0 ].flt, _attributes[ 1 ].flt );
+	xy *= context.scale;
+	const glm::ivec2 coords = glm::clamp( glm::ivec2(xy), {0, 0}, context.dims - 1);
+	return { coords, coords + 1 };
+}
+
 FilterNode::FilterNode(){
 	_name = "Filter";
 	_description = "Apply a 3x3 filter to each pixel image, using its neighborhood.";
@@ -258,17 +382,17 @@ FilterNode::FilterNode(){
 
 NODE_DEFINE_TYPE_AND_VERSION(FilterNode, NodeClass::FILTER, 1)
 
-void FilterNode::prepare(SharedContext& context, const std::vector<int>& inputs) const {
+void FilterNode::prepare(SharedContext& context, const std::vector<int>& inputs, const Region& region) const {
 	assert(inputs.size() == _channelCount);
 	assert(inputs.size() <= 4);
 
-	copyInputsToImage(context.tmpImagesRead, inputs, context.tmpImagesGlobal[0]);
+	copyInputsToImage(context.tmpImagesRead, inputs, context.globalImage(_id), footprint(region, context));
 }
 
 void FilterNode::evaluate(LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs) const {
 	assert(outputs.size() == _channelCount);
 	assert(inputs.size() == _channelCount);
-	const Image& src = context.shared->tmpImagesGlobal[0];
+	const Image& src = context.shared->globalImage(_id);
 
 	const glm::mat3 m{ glm::vec3(_attributes[0].clr), glm::vec3(_attributes[1].clr), glm::vec3(_attributes[2].clr)};
 	glm::vec4 accum{ 0.0f};
@@ -292,6 +416,11 @@ void FilterNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 	}
 }
 
+int FilterNode::radius(const SharedContext& context) const {
+	(void)context;
+	return 1;
+}
+
 
 FloodFillNode::FloodFillNode(){
 	_name = "Flood fill";
@@ -303,8 +432,10 @@ FloodFillNode::FloodFillNode(){
 
 NODE_DEFINE_TYPE_AND_VERSION(FloodFillNode, NodeClass::FLOOD_FILL, 1)
 
-void FloodFillNode::prepare( SharedContext& context, const std::vector<int>& inputs) const {
+void FloodFillNode::prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region) const {
 	assert(inputs.size() == 1);
+	// Regions can span the whole image.
+	(void)region;
 
 	const uint w = context.dims.x;
 	const uint h = context.dims.y;
@@ -322,7 +453,7 @@ void FloodFillNode::prepare( SharedContext& context, const std::vector<int>& inp
 	// Collect seeds.
 	for(uint y = 0; y < h; ++y){
 		for(uint x = 0; x < w; ++x){
-			if(src.pixel(x,y)[channelId] == 0.f)
+			if(src.channel(x, y, channelId) == 0.f)
 				continue;
 			const int id = (int)y * (int)w + (int)x;
 			flags[id] = 1u;
@@ -355,7 +486,7 @@ void FloodFillNode::prepare( SharedContext& context, const std::vector<int>& inp
 	}
 
 	// Write to tmp storage for global nodes.
-	Image& dst = context.tmpImagesGlobal[0];
+	Image& dst = context.globalImage(_id);
 	for(uint y = 0; y < h; ++y){
 		for(uint x = 0; x < w; ++x){
 			const int id = seeds[y * w + x];
@@ -371,12 +502,19 @@ void FloodFillNode::evaluate(LocalContext& context, const std::vector<int>& inpu
 	assert(outputs.size() == 2);
 	assert(inputs.size() == 1);
 
-	const Image& uvMap = context.shared->tmpImagesGlobal[0];
+	const Image& uvMap = context.shared->globalImage(_id);
 	const glm::vec2 uvs = glm::vec2(uvMap.pixel(context.coords));
 	context.stack[outputs[0]] = uvs.x;
 	context.stack[outputs[1]] = uvs.y;
 }
 
+void FloodFillNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	outputs[0] = ValueRange::unit();
+	outputs[1] = ValueRange::unit();
+}
+
+
 MedianFilterNode::MedianFilterNode(){
 	_name = "Median filter";
 	_description = "Apply a median filter to each pixel of X, only for pixels in mask M";
@@ -390,10 +528,10 @@ MedianFilterNode::MedianFilterNode(){
 NODE_DEFINE_TYPE_AND_VERSION( MedianFilterNode, NodeClass::MEDIAN_FILTER, 1 )
 
 
-void MedianFilterNode::prepare(SharedContext& context, const std::vector<int>& inputs) const {
+void MedianFilterNode::prepare(SharedContext& context, const std::vector<int>& inputs, const Region& region) const {
 	assert(inputs.size() == 2);
 	// Second channel is used as mask.
-	copyInputsToImage(context.tmpImagesRead, inputs, context.tmpImagesGlobal[0]);
+	copyInputsToImage(context.tmpImagesRead, inputs, context.globalImage(_id), footprint(region, context));
 }
 
 void MedianFilterNode::evaluate( LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs ) const {
@@ -406,7 +544,7 @@ void MedianFilterNode::evaluate( LocalContext& context, const std::vector<int>&
 	std::vector<float> values; 
 	values.reserve( kSampleCount );
 
-	const Image& src = context.shared->tmpImagesGlobal[0];
+	const Image& src = context.shared->globalImage(_id);
 	for(int dy = -kRadius; dy <= kRadius; ++dy){
 		for(int dx = -kRadius; dx <= kRadius; ++dx){
 			glm::ivec2 dcoords{ context.coords.x + dx, context.coords.y + dy };
@@ -435,6 +573,15 @@ void MedianFilterNode::evaluate( LocalContext& context, const std::vector<int>&
 	context.stack[ outputs[ 0 ] ] = medianValue;
 }
 
+void MedianFilterNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	outputs[0] = inputs[0];
+}
+
+int MedianFilterNode::radius(const SharedContext& context) const {
+	(void)context;
+	return int(std::max(0.f, _attributes[ 0 ].flt));
+}
+
 
 QuantizeNode::QuantizeNode(){
 	_name = "Quantize";
@@ -449,13 +596,6 @@ QuantizeNode::QuantizeNode(){
 
 NODE_DEFINE_TYPE_AND_VERSION( QuantizeNode, NodeClass::QUANTIZE, 1 )
 
-void QuantizeNode::prepare(SharedContext& context, const std::vector<int>& inputs) const {
-	assert(inputs.size() == _channelCount);
-	assert(inputs.size() <= 4);
-
-	copyInputsToImage(context.tmpImagesRead, inputs, context.tmpImagesGlobal[0]);
-}
-
 void QuantizeNode::evaluate( LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs ) const
 {
 	assert( outputs.size() == _channelCount );
@@ -468,16 +608,16 @@ void QuantizeNode::evaluate( LocalContext& context, const std::vector<int>& inpu
 	const int sx = ( context.coords.x / scale) * scale;
 	const int sy = ( context.coords.y / scale) * scale;
 
-	const Image& src = context.shared->tmpImagesGlobal[0];
+	const std::vector<Image>& srcs = context.shared->tmpImagesRead;
 
-	glm::vec4 basePixel = src.pixel(sx, sy);
+	glm::vec4 basePixel = readInputs(srcs, inputs, {sx, sy});
 	if(bilinearUpscale){
 		const glm::vec4 c00 = basePixel;
 		const int sx1 = (sx + scale) < context.shared->dims.x ? (sx + scale) : sx;
 		const int sy1 = (sy + scale) < context.shared->dims.y ? (sy + scale) : sy;
-		const glm::vec4& c10 = src.pixel(sx1,  sy);
-		const glm::vec4& c01 = src.pixel( sx, sy1);
-		const glm::vec4& c11 = src.pixel(sx1, sy1);
+		const glm::vec4 c10 = readInputs(srcs, inputs, {sx1,  sy});
+		const glm::vec4 c01 = readInputs(srcs, inputs, { sx, sy1});
+		const glm::vec4 c11 = readInputs(srcs, inputs, {sx1, sy1});
 		const glm::vec2 frac = glm::vec2(context.coords - glm::ivec2(sx, sy)) / (float)scale;
 		basePixel = (1.f - frac.x) * (1.f - frac.y) * c00 + (1.f - frac.x) * frac.y * c01 + frac.x * (1.f - frac.y) * c10 + frac.x * frac.y * c11;
 	}
@@ -488,6 +628,30 @@ void QuantizeNode::evaluate( LocalContext& context, const std::vector<int>& inpu
 
 }
 
+void QuantizeNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	const bool bilinear = _attributes[1].bln;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = inputs[i];
+		outputs[i].binary &= !bilinear;
+	}
+}
+
+Region QuantizeNode::footprint(const Region& region, const SharedContext& context) const {
+	if(region.empty()){
+		return region;
+	}
+	const bool bilinearUpscale = _attributes[1].bln;
+	const int scale = glm::max(1, int( _attributes[ 0 ].flt ));
+	// Pixels read are aligned on the quantization grid, with the next grid point for interpolation.
+	Region grid;
+	grid.min = (region.min / scale) * scale;
+	grid.max = ((region.max - 1) / scale) * scale + 1;
+	if(bilinearUpscale){
+		grid.max += scale;
+	}
+	return grid.clamped(context.dims);
+}
+
 SampleNode::SampleNode(){
 	_name = "Sample";
 	_description = "Sample an image at the given UV";
@@ -500,10 +664,12 @@ SampleNode::SampleNode(){
 
 NODE_DEFINE_TYPE_AND_VERSION( SampleNode, NodeClass::SAMPLING, 1 )
 
-void SampleNode::prepare( SharedContext& context, const std::vector<int>& inputs ) const {
+void SampleNode::prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const {
 	assert(inputs.size() == _channelCount + 2);
 
-	copyInputsToImage(context.tmpImagesRead, inputs, context.tmpImagesGlobal[ 0 ]);
+	// Samples can be anywhere in the image.
+	(void)region;
+	copyInputsToImage(context.tmpImagesRead, inputs, context.globalImage(_id), Region::full(context.dims));
 }
 
 void SampleNode::evaluate( LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs ) const
@@ -511,7 +677,7 @@ void SampleNode::evaluate( LocalContext& context, const std::vector<int>& inputs
 	assert( inputs.size() == _channelCount + 2 );
 	assert( outputs.size() == _channelCount );
 
-	const Image& src = context.shared->tmpImagesGlobal[ 0 ];
+	const Image& src = context.shared->globalImage(_id);
 
 	// Retrieve UVs from the last two input channels.
 	glm::vec2 coords( 0.f );
@@ -519,12 +685,12 @@ void SampleNode::evaluate( LocalContext& context, const std::vector<int>& inputs
 		const uint srcIdX = inputs[ _channelCount ];
 		const uint imageIdX = srcIdX / 4u;
 		const uint channelIdX = srcIdX % 4u;
-		coords.x = context.shared->tmpImagesRead[ imageIdX ].pixel(context.coords)[channelIdX];
+		coords.x = context.shared->tmpImagesRead[ imageIdX ].channel( context.coords, channelIdX );
 
 		const uint srcIdY = inputs[ _channelCount + 1 ];
 		const uint imageIdY = srcIdY / 4u;
 		const uint channelIdY = srcIdY % 4u;
-		coords.y = context.shared->tmpImagesRead[ imageIdY ].pixel( context.coords )[ channelIdY ];
+		coords.y = context.shared->tmpImagesRead[ imageIdY ].channel( context.coords, channelIdY );
 	}
 	coords = glm::fract( coords );
 
@@ -541,12 +707,10 @@ void SampleNode::evaluate( LocalContext& context, const std::vector<int>& inputs
 		glm::ivec2 coords00 = glm::ivec2(glm::floor(pixCoords));
 		coords00 = glm::clamp(coords00, {0, 0}, safeSize);
 		const glm::ivec2 coords11 = glm::min(coords00 + 1, safeSize);
-		const glm::vec4& c00 = src.pixel(coords00.x, coords00.y);
-		const glm::vec4& c10 = src.pixel(coords11.x, coords00.y);
-		const glm::vec4& c01 = src.pixel(coords00.x, coords11.y);
-		const glm::vec4& c11 = src.pixel(coords11.x, coords11.y);
+		glm::vec4 c[4];
+		src.gatherColors(coords00, coords11, c);
 		const glm::vec2 frac = pixCoords - glm::vec2(coords00);
-		basePixel = (1.f - frac.x) * (1.f - frac.y) * c00 + (1.f - frac.x) * frac.y * c01 + frac.x * (1.f - frac.y) * c10 + frac.x * frac.y * c11;
+		basePixel = (1.f - frac.x) * (1.f - frac.y) * c[0] + (1.f - frac.x) * frac.y * c[2] + frac.x * (1.f - frac.y) * c[1] + frac.x * frac.y * c[3];
 	} else {
 		glm::ivec2 coords00 = glm::ivec2(glm::round(pixCoords));
 		coords00 = glm::clamp(coords00, {0, 0}, safeSize);
@@ -557,3 +721,248 @@ void SampleNode::evaluate( LocalContext& context, const std::vector<int>& inputs
 		context.stack[ outputs[ i ] ] = basePixel[i];
 	}
 }
+
+void SampleNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	const bool bilinear = _attributes[0].bln;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = inputs[i];
+		outputs[i].binary &= !bilinear;
+	}
+}
+
+
+enum Statistic : int {
+	MINIMUM = 0, MAXIMUM, MEAN, SUM, PERCENTILE
+};
+
+StatisticsNode::StatisticsNode(){
+	_name = "Statistics";
+	_description = "Compute a statistic of each channel over the whole image, shared by all pixels.";
+	_inputNames = { {"X", true} };
+	_outputNames = { {"Y", true} };
+	_attributes = { {"Statistic", {"Minimum", "Maximum", "Mean", "Sum", "Percentile"}}, {"Percentile", Attribute::Type::FLOAT} };
+	_attributes[1].flt = 50.f;
+	finalize();
+}
+
+NODE_DEFINE_TYPE_AND_VERSION(StatisticsNode, NodeClass::STATISTICS, 1)
+
+void StatisticsNode::prepare(SharedContext& context, const std::vector<int>& inputs, const Region& region) const {
+	assert(inputs.size() == _channelCount);
+	assert(inputs.size() <= 4);
+	// Statistics always cover the whole image.
+	(void)region;
+
+	glm::vec4 result(0.f);
+	const int statistic = _attributes[0].cmb;
+	if(statistic == PERCENTILE){
+		// Partially sort a copy of each channel.
+		const float ratio = glm::clamp(_attributes[1].flt, 0.f, 100.f) / 100.f;
+		const size_t count = size_t(context.dims.x) * size_t(context.dims.y);
+		const size_t rank = size_t(std::round(ratio * float(count - 1u)));
+		System::forParallel(0, _channelCount, [&context, &inputs, &result, count, rank](size_t i){
+			const Image& src = context.tmpImagesRead[inputs[i] / 4u];
+			const uint channelId = inputs[i] % 4u;
+			std::vector<float> values(count);
+			for(int y = 0; y < context.dims.y; ++y){
+				for(int x = 0; x < context.dims.x; ++x){
+					values[size_t(y) * context.dims.x + x] = src.channel(x, y, channelId);
+				}
+			}
+			std::nth_element(values.begin(), values.begin() + rank, values.end());
+			result[i] = values[rank];
+		});
+	} else {
+		const ChannelStatistics stats = computeStatistics(context.tmpImagesRead, inputs, context.dims);
+		const double count = double(context.dims.x) * double(context.dims.y);
+		switch(statistic){
+			case MINIMUM:
+				result = stats.min;
+				break;
+			case MAXIMUM:
+				result = stats.max;
+				break;
+			case MEAN:
+				result = glm::vec4(stats.sum / count);
+				break;
+			default:
+				result = glm::vec4(stats.sum);
+				break;
+		}
+	}
+	// All pixels read the same value.
+	context.globalImage(_id).pixel(0, 0) = result;
+}
+
+void StatisticsNode::evaluate(LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs) const {
+	assert(outputs.size() == _channelCount);
+	assert(inputs.size() == _channelCount);
+	(void)inputs;
+	const glm::vec4& result = context.shared->globalImage(_id).pixel(0, 0);
+	for(uint i = 0u; i < _channelCount; ++i){
+		context.stack[outputs[i]] = result[i];
+	}
+}
+
+void StatisticsNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	const int statistic = _attributes[0].cmb;
+	for(uint i = 0; i < _channelCount; ++i){
+		if(statistic == SUM){
+			outputs[i] = ValueRange();
+		} else {
+			// The mean can take any value in the range.
+			outputs[i] = inputs[i];
+			outputs[i].binary &= statistic != MEAN;
+		}
+	}
+}
+
+
+AutoLevelsNode::AutoLevelsNode(){
+	_name = "Auto levels";
+	_description = "Stretch each channel to [0,1] based on its minimum and maximum over the image, or the same for all channels if linked.";
+	_inputNames = { {"X", true} };
+	_outputNames = { {"Y", true} };
+	_attributes = { {"Linked", Attribute::Type::BOOL} };
+	finalize();
+}
+
+NODE_DEFINE_TYPE_AND_VERSION(AutoLevelsNode, NodeClass::AUTO_LEVELS, 1)
+
+void AutoLevelsNode::prepare(SharedContext& context, const std::vector<int>& inputs, const Region& region) const {
+	assert(inputs.size() == _channelCount);
+	assert(inputs.size() <= 4);
+	(void)region;
+
+	const ChannelStatistics stats = computeStatistics(context.tmpImagesRead, inputs, context.dims);
+	glm::vec4 mini = stats.min;
+	glm::vec4 maxi = stats.max;
+	if(_attributes[0].bln){
+		for(uint i = 1u; i < _channelCount; ++i){
+			mini[0] = glm::min(mini[0], mini[i]);
+			maxi[0] = glm::max(maxi[0], maxi[i]);
+		}
+		mini = glm::vec4(mini[0]);
+		maxi = glm::vec4(maxi[0]);
+	}
+	// Constant channels are mapped to 0.
+	glm::vec4 scale(0.f);
+	for(uint i = 0u; i < _channelCount; ++i){
+		scale[i] = maxi[i] > mini[i] ? 1.f / (maxi[i] - mini[i]) : 0.f;
+	}
+
+	Image& dst = context.globalImage(_id);
+	const uint channelCount = _channelCount;
+	System::forParallel(0, dst.h(), [&context, &inputs, &dst, &mini, &scale, channelCount](size_t y){
+		for(uint x = 0; x < dst.w(); ++x){
+			glm::vec4& pixel = dst.pixel(x, y);
+			pixel = glm::vec4(0.f);
+			for(uint i = 0u; i < channelCount; ++i){
+				const float value = context.tmpImagesRead[inputs[i] / 4u].channel(x, y, inputs[i] % 4u);
+				pixel[i] = glm::clamp((value - mini[i]) * scale[i], 0.f, 1.f);
+			}
+		}
+	});
+}
+
+void AutoLevelsNode::evaluate(LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs) const {
+	assert(outputs.size() == _channelCount);
+	assert(inputs.size() == _channelCount);
+	(void)inputs;
+	const glm::vec4& pixel = context.shared->globalImage(_id).pixel(context.coords);
+	for(uint i = 0u; i < _channelCount; ++i){
+		context.stack[outputs[i]] = pixel[i];
+	}
+}
+
+void AutoLevelsNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange(0.f, 1.f, inputs[i].binary);
+	}
+}
+
+
+EqualizeNode::EqualizeNode(){
+	_name = "Equalize";
+	_description = "Equalize the histogram of each channel, for values in [0,1].";
+	_inputNames = { {"X", true} };
+	_outputNames = { {"Y", true} };
+	finalize();
+}
+
+NODE_DEFINE_TYPE_AND_VERSION(EqualizeNode, NodeClass::EQUALIZE, 1)
+
+void EqualizeNode::prepare(SharedContext& context, const std::vector<int>& inputs, const Region& region) const {
+	assert(inputs.size() == _channelCount);
+	assert(inputs.size() <= 4);
+	(void)region;
+
+	auto binIndex = [](float value){
+		return uint(glm::clamp(value * float(kHistogramBinCount), 0.f, float(kHistogramBinCount - 1u)));
+	};
+
+	// Histogram of all channels, one after the other.
+	const uint channelCount = _channelCount;
+	auto reduceRow = [&context, &inputs, &binIndex, channelCount](std::vector<size_t>& histogram, uint y){
+		for(uint i = 0u; i < channelCount; ++i){
+			const Image& src = context.tmpImagesRead[inputs[i] / 4u];
+			const uint channelId = inputs[i] % 4u;
+			for(int x = 0; x < context.dims.x; ++x){
+				++histogram[i * kHistogramBinCount + binIndex(src.channel(x, y, channelId))];
+			}
+		}
+	};
+	auto combine = [](std::vector<size_t>& histogram, const std::vector<size_t>& other){
+		for(size_t i = 0u; i < histogram.size(); ++i){
+			histogram[i] += other[i];
+		}
+	};
+	const std::vector<size_t> histogram = reduceRows(context.dims.y, std::vector<size_t>(4u * kHistogramBinCount, 0u), reduceRow, combine);
+
+	// Map each bin to its cumulative distribution, ignoring the empty bins at the start.
+	std::vector<float> mapping(4u * kHistogramBinCount, 0.f);
+	const size_t pixelCount = size_t(context.dims.x) * size_t(context.dims.y);
+	for(uint i = 0u; i < channelCount; ++i){
+		size_t cumulated = 0u;
+		size_t firstCount = 0u;
+		for(uint b = 0u; b < kHistogramBinCount; ++b){
+			const size_t count = histogram[i * kHistogramBinCount + b];
+			cumulated += count;
+			if(firstCount == 0u){
+				firstCount = count;
+			}
+			const size_t range = pixelCount - firstCount;
+			mapping[i * kHistogramBinCount + b] = range > 0u ? float(cumulated - firstCount) / float(range) : 0.f;
+		}
+	}
+
+	Image& dst = context.globalImage(_id);
+	System::forParallel(0, dst.h(), [&context, &inputs, &dst, &mapping, &binIndex, channelCount](size_t y){
+		for(uint x = 0; x < dst.w(); ++x){
+			glm::vec4& pixel = dst.pixel(x, y);
+			pixel = glm::vec4(0.f);
+			for(uint i = 0u; i < channelCount; ++i){
+				const float value = context.tmpImagesRead[inputs[i] / 4u].channel(x, y, inputs[i] % 4u);
+				pixel[i] = mapping[i * kHistogramBinCount + binIndex(value)];
+			}
+		}
+	});
+}
+
+void EqualizeNode::evaluate(LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs) const {
+	assert(outputs.size() == _channelCount);
+	assert(inputs.size() == _channelCount);
+	(void)inputs;
+	const glm::vec4& pixel = context.shared->globalImage(_id).pixel(context.coords);
+	for(uint i = 0u; i < _channelCount; ++i){
+		context.stack[outputs[i]] = pixel[i];
+	}
+}
+
+void EqualizeNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::unit();
+	}
+}
+
@@ -9,7 +9,11 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	bool global() const override { return true; }
+	NODE_DECLARE_FOOTPRINT()
+
+	NODE_DECLARE_RANGES()
+
+	Access access() const override { return Access::REMAP; }
 };
 
 class TileNode : public Node
@@ -20,7 +24,9 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	bool global() const override { return true; }
+	NODE_DECLARE_RANGES()
+
+	Access access() const override { return Access::REMAP; }
 };
 
 class RotateNode : public Node
@@ -31,7 +37,9 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	bool global() const override { return true; }
+	NODE_DECLARE_RANGES()
+
+	Access access() const override { return Access::REMAP; }
 };
 
 
@@ -42,9 +50,13 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	void prepare( SharedContext& context, const std::vector<int>& inputs) const override;
+	NODE_DECLARE_RANGES()
+
+	void prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const override;
+
+	Access access() const override { return Access::STENCIL; }
 
-	bool global() const override { return true; }
+	int radius(const SharedContext& context) const override;
 };
 
 class PickerNode : public Node {
@@ -54,7 +66,11 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	bool global() const override { return true; }
+	NODE_DECLARE_FOOTPRINT()
+
+	NODE_DECLARE_RANGES()
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::UNIFORM; }
 };
 
 class FilterNode : public Node {
@@ -64,9 +80,11 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	void prepare( SharedContext& context, const std::vector<int>& inputs) const override;
+	void prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const override;
+
+	Access access() const override { return Access::STENCIL; }
 
-	bool global() const override { return true; }
+	int radius(const SharedContext& context) const override;
 };
 
 class FloodFillNode : public Node {
@@ -76,9 +94,11 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	void prepare( SharedContext& context, const std::vector<int>& inputs) const override;
+	NODE_DECLARE_RANGES()
 
-	bool global() const override { return true; }
+	void prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const override;
+
+	Access access() const override { return Access::WHOLE_IMAGE; }
 };
 
 
@@ -90,9 +110,13 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	void prepare( SharedContext& context, const std::vector<int>& inputs) const override;
+	NODE_DECLARE_RANGES()
+
+	void prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const override;
+
+	Access access() const override { return Access::STENCIL; }
 
-	bool global() const override { return true; }
+	int radius(const SharedContext& context) const override;
 };
 
 class QuantizeNode : public Node
@@ -103,9 +127,11 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	void prepare( SharedContext& context, const std::vector<int>& inputs) const override;
+	NODE_DECLARE_FOOTPRINT()
 
-	bool global() const override { return true; }
+	NODE_DECLARE_RANGES()
+
+	Access access() const override { return Access::REMAP; }
 };
 
 class SampleNode : public Node
@@ -116,7 +142,56 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
-	void prepare( SharedContext& context, const std::vector<int>& inputs ) const override;
+	NODE_DECLARE_RANGES()
+
+	void prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const override;
+
+	Access access() const override { return Access::GATHER; }
+};
+
+class StatisticsNode : public Node
+{
+public:
+
+	StatisticsNode();
+
+	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 
-	bool global() const override { return true; }
-};
\ No newline at end of file
+	void prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const override;
+
+	Access access() const override { return Access::WHOLE_IMAGE; }
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::UNIFORM; }
+};
+
+class AutoLevelsNode : public Node
+{
+public:
+
+	AutoLevelsNode();
+
+	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
+
+	void prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const override;
+
+	Access access() const override { return Access::WHOLE_IMAGE; }
+};
+
+class EqualizeNode : public Node
+{
+public:
+
+	EqualizeNode();
+
+	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
+
+	void prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const override;
+
+	Access access() const override { return Access::WHOLE_IMAGE; }
+};
@@ -68,6 +68,13 @@ void LogNode::evaluate(LocalContext& context, const std::vector<int>& inputs, co
 
 }
 
+void LogNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	// The debug circle is drawn with 0 and 1 values.
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = ValueRange::hull(inputs[i], ValueRange::boolean());
+	}
+}
+
 ResolutionNode::ResolutionNode(){
 	_name = "Resolution";
 	_description = "Output image(s) resolution.";
@@ -112,6 +119,14 @@ void CoordinatesNode::evaluate( LocalContext& context, const std::vector<int>& i
 	context.stack[ outputs[ 1 ] ] = coords[1];
 }
 
+void CoordinatesNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	const bool unit = _attributes[ 0 ].cmb == 0;
+	for(uint i = 0u; i < 2u; ++i){
+		outputs[i] = unit ? ValueRange::unit() : ValueRange(0.f, FLT_MAX);
+	}
+}
+
 MathConstantNode::MathConstantNode(){
 	_name = "Math constant";
 	_description = "if invert then 1/(constant * scale) else (constant*scale)";
@@ -160,3 +175,9 @@ void BroadcastNode::evaluate(LocalContext& context, const std::vector<int>& inpu
 		context.stack[outputs[i]] = context.stack[inputs[0]];
 	}
 }
+
+void BroadcastNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	for(uint i = 0; i < _channelCount; ++i){
+		outputs[i] = inputs[0];
+	}
+}
@@ -16,6 +16,10 @@ public:
 	LogNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
 };
 
 class ResolutionNode : public Node {
@@ -24,6 +28,8 @@ public:
 	ResolutionNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::UNIFORM; }
 };
 
 class CoordinatesNode : public Node
@@ -33,6 +39,10 @@ public:
 	CoordinatesNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
 };
 
 class MathConstantNode : public Node {
@@ -49,6 +59,8 @@ public:
 	BroadcastNode();
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
+	NODE_DECLARE_RANGES()
 };
 
 
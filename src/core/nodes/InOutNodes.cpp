@@ -23,12 +23,20 @@ void InputNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 	(void)inputs;
 
 	const Image& inputImg = context.shared->inputImages[_index];
-	const glm::vec4& color = inputImg.pixel(context.coords);
+	const glm::vec4 color = inputImg.color(context.coords);
 	for (uint i = 0u; i < 4u; ++i) {
 		context.stack[outputs[i]] = color[i];
 	}
 }
 
+void InputNode::evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const {
+	(void)inputs;
+	// Assume LDR content, the evaluator falls back to full precision for HDR inputs.
+	for(uint i = 0u; i < 4u; ++i){
+		outputs[i] = ValueRange::unit();
+	}
+}
+
 FreeList OutputNode::_freeList;
 
 OutputNode::OutputNode() {
@@ -36,7 +44,8 @@ OutputNode::OutputNode() {
 	_name = "Output " + std::to_string(_index);
 	_description = "Output an image to the disk.";
 	 _inputNames = { {"R", false }, {"G", false }, {"B", false}, {"A", false} };
-	_attributes = { {"Format", {"PNG", "BMP", "JPEG", "TGA", "EXR"}}, {"Prefix", Attribute::Type::STRING}, {"Suffix", Attribute::Type::STRING} };
+	_attributes = { {"Format", {"PNG", "BMP", "JPEG", "TGA", "EXR", "Raw"}}, {"Prefix", Attribute::Type::STRING}, {"Suffix", Attribute::Type::STRING},
+		{"EXR pixels", {"Float", "Half"}}, {"EXR compression", {"ZIP", "PIZ", "None"}} };
 	finalize();
 }
 
@@ -52,9 +61,13 @@ void OutputNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 	(void)outputs;
 	
 	Image& outImage = context.shared->outputImages[_index];
-	glm::vec4& color = outImage.pixel(context.coords);
+	const glm::ivec2 coords = context.coords - context.shared->outputOrigin;
+	// Pixels around the output region can be evaluated for other nodes.
+	if(coords.x < 0 || coords.y < 0 || coords.x >= int(outImage.w()) || coords.y >= int(outImage.h())){
+		return;
+	}
 	for (uint i = 0u; i < 4u; ++i) {
-		color[i] = context.stack[inputs[i]];
+		outImage.setChannel(coords.x, coords.y, i, context.stack[inputs[i]]);
 	}
 }
 
@@ -62,7 +75,7 @@ std::string OutputNode::generateFileName(uint batch, Image::Format& format) cons
 	std::string prefix(_attributes[1].str);
 	std::string suffix(_attributes[2].str);
 
-	static const std::vector<Image::Format> formats = { Image::Format::PNG, Image::Format::BMP, Image::Format::JPEG, Image::Format::TGA, Image::Format::EXR };
+	static const std::vector<Image::Format> formats = { Image::Format::PNG, Image::Format::BMP, Image::Format::JPEG, Image::Format::TGA, Image::Format::EXR, Image::Format::RAW };
 	const int fmtIndex = glm::clamp(_attributes[0].cmb, 0, int(formats.size()) - 1);
 	format = formats[fmtIndex];
 
@@ -80,6 +93,14 @@ std::string OutputNode::generateFileName(uint batch, Image::Format& format) cons
 	return prefix + std::to_string(batch) + suffix;
 }
 
+Image::EXROptions OutputNode::exrOptions() const {
+	static const std::vector<Image::EXRCompression> compressions = { Image::EXRCompression::ZIP, Image::EXRCompression::PIZ, Image::EXRCompression::NONE };
+	Image::EXROptions options;
+	options.half = _attributes[3].cmb == 1;
+	options.compression = compressions[glm::clamp(_attributes[4].cmb, 0, int(compressions.size()) - 1)];
+	return options;
+}
+
 BackupNode::BackupNode(){
 	_name = "Backup";
 	finalize();
@@ -99,7 +120,7 @@ void BackupNode::evaluate(LocalContext& context, const std::vector<int>& inputs,
 		const uint channelId = dstId % 4u;
 		Image& img = context.shared->tmpImagesWrite[imageId];
 
-		img.pixel(context.coords)[channelId] = context.stack[srcId];
+		img.setChannel(context.coords.x, context.coords.y, channelId, context.stack[srcId]);
 	}
 }
 
@@ -122,6 +143,23 @@ void RestoreNode::evaluate(LocalContext& context, const std::vector<int>& inputs
 		const uint channelId = srcId % 4u;
 		const Image& img = context.shared->tmpImagesRead[imageId];
 
-		context.stack[dstId] = img.pixel(context.coords)[channelId];
+		context.stack[dstId] = img.channel(context.coords, channelId);
+	}
+}
+
+UniformNode::UniformNode(){
+	_name = "Uniform";
+	finalize();
+}
+
+NODE_DEFINE_TYPE_AND_VERSION(UniformNode, NodeClass::INTERNAL_UNIFORM, 1)
+
+void UniformNode::evaluate(LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs) const {
+	assert(inputs.size() == outputs.size());
+
+	// Inputs are indices in the values computed once for the batch.
+	const uint count = outputs.size();
+	for(uint i = 0u; i < count; ++i){
+		context.stack[outputs[i]] = context.shared->uniforms[inputs[i]];
 	}
 }
@@ -12,6 +12,12 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
+	NODE_DECLARE_RANGES()
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
+
+	uint index() const { return _index; }
+
 private:
 	unsigned int _index{0u};
 	static FreeList _freeList;
@@ -27,6 +33,12 @@ public:
 
 	std::string generateFileName(uint batch, Image::Format& format) const;
 
+	Image::EXROptions exrOptions() const;
+
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
+
+	uint index() const { return _index; }
+
 private:
 	unsigned int _index{0u};
 	static FreeList _freeList;
@@ -39,6 +51,7 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
 };
 
 class RestoreNode : public Node {
@@ -48,4 +61,14 @@ public:
 
 	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
 
+	Variation variation(Variation inputs) const override { (void)inputs; return Variation::VARYING; }
+};
+
+class UniformNode : public Node {
+public:
+
+	UniformNode();
+
+	NODE_DECLARE_EVAL_TYPE_AND_VERSION()
+
 };
@@ -26,6 +26,17 @@ Node::Attribute::Attribute( const std::string& aname, const std::vector<std::str
 
 Node::Attribute::~Attribute() {}
 
+Region Node::footprint(const Region& region, const SharedContext& context) const {
+	const Access pattern = access();
+	if(pattern == Access::POINTWISE || region.empty()){
+		return region;
+	}
+	if(pattern == Access::STENCIL){
+		return region.expanded(radius(context)).clamped(context.dims);
+	}
+	return Region::full(context.dims);
+}
+
 void Node::setChannelCount(uint c){
 	if( !channeled() ){
 		_currentInputs = _inputNames;
@@ -3,6 +3,37 @@
 #include "core/Image.hpp"
 
 #include <vector>
+#include <cfloat>
+
+/// Rectangle of pixels, from min included to max excluded.
+struct Region {
+	glm::ivec2 min{0, 0};
+	glm::ivec2 max{0, 0};
+
+	Region() = default;
+
+	Region(const glm::ivec2& amin, const glm::ivec2& amax) : min(amin), max(amax) {}
+
+	bool empty() const { return max.x <= min.x || max.y <= min.y; }
+
+	glm::ivec2 size() const { return empty() ? glm::ivec2(0) : max - min; }
+
+	Region expanded(int radius) const { return { min - radius, max + radius }; }
+
+	Region clamped(const glm::ivec2& dims) const { return { glm::clamp(min, {0, 0}, dims), glm::clamp(max, {0, 0}, dims) }; }
+
+	static Region full(const glm::ivec2& dims) { return { {0, 0}, dims }; }
+
+	static Region hull(const Region& a, const Region& b){
+		if(a.empty()){
+			return b;
+		}
+		if(b.empty()){
+			return a;
+		}
+		return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+	}
+};
 
 struct SharedContext {
 	std::vector<Image> inputImages;
@@ -12,6 +43,63 @@ struct SharedContext {
 	std::vector<Image> tmpImagesGlobal;
 	glm::ivec2 dims;
 	glm::vec2 scale;
+	// Position of the first output pixel when outputs only cover a strip of the image.
+	glm::ivec2 outputOrigin{0, 0};
+	// Region of the outputs to evaluate, the full image if empty.
+	Region region;
+	// Values shared by all pixels, computed once per batch.
+	std::vector<float> uniforms;
+	// Keys for counter-based random generation.
+	uint randomSeed{0u};
+	uint batch{0u};
+	// Use the shared sequential generators instead, results depend on the thread count.
+	bool legacyRandom{false};
+	// Global image holding the prepared data of each global node, by node id. The first one if not listed.
+	std::vector<uint> globalImageIds;
+
+	Image& globalImage(uint nodeId) { return tmpImagesGlobal[nodeId < globalImageIds.size() ? globalImageIds[nodeId] : 0u]; }
+
+	const Image& globalImage(uint nodeId) const { return tmpImagesGlobal[nodeId < globalImageIds.size() ? globalImageIds[nodeId] : 0u]; }
+};
+
+struct ValueRange {
+	float min{-FLT_MAX};
+	float max{FLT_MAX};
+	bool binary{false};
+
+	ValueRange() = default;
+
+	ValueRange(float amin, float amax, bool abinary = false) : min(amin), max(amax), binary(abinary) {}
+
+	bool within(float a, float b) const { return min >= a && max <= b; }
+
+	bool bounded() const { return min > -FLT_MAX && max < FLT_MAX; }
+
+	static ValueRange hull(const ValueRange& a, const ValueRange& b){ return { (std::min)(a.min, b.min), (std::max)(a.max, b.max), a.binary && b.binary }; }
+
+	static ValueRange unit() { return { 0.f, 1.f }; }
+
+	static ValueRange boolean() { return { 0.f, 1.f, true }; }
+};
+
+/// How values change across the pixels of a batch, from the least to the most varying.
+enum class Variation : uint {
+	CONSTANT, UNIFORM, VARYING
+};
+
+/// Which input pixels are read to evaluate an output pixel, from the most local to the most global.
+/// Remaps read their inputs directly from the backed up images, other global nodes prepare them first.
+enum class Access : uint {
+	// The same pixel.
+	POINTWISE,
+	// Pixels at positions that only depend on the output pixel.
+	REMAP,
+	// Pixels at a bounded distance of the output pixel, see radius().
+	STENCIL,
+	// Pixels at positions that depend on input values.
+	GATHER,
+	// All pixels.
+	WHOLE_IMAGE
 };
 
 struct LocalContext {
@@ -24,6 +112,9 @@ struct LocalContext {
 };
 
 class Node {
+
+	friend class Graph;
+
 public:
 
 	struct Attribute
@@ -56,10 +147,26 @@ public:
 
 	};
 	
-	virtual void prepare( SharedContext& context, const std::vector<int>& inputs) const { (void)context; (void)inputs; assert(global());};
+	/// Prepare the data read by a global node to evaluate a region of its outputs.
+	virtual void prepare( SharedContext& context, const std::vector<int>& inputs, const Region& region ) const { (void)context; (void)inputs; (void)region; assert(global());};
 
 	virtual void evaluate( LocalContext& context, const std::vector<int>& inputs, const std::vector<int>& outputs ) const = 0;
 
+	/// Estimate the range of each output given the ranges of the inputs. Outputs are unbounded by default.
+	virtual void evaluateRanges( const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs ) const { (void)inputs; (void)outputs; }
+
+	/// Region of the inputs read to evaluate a region of the outputs, by default based on the access pattern.
+	virtual Region footprint( const Region& region, const SharedContext& context ) const;
+
+	virtual Access access() const { return Access::POINTWISE; }
+
+	/// Largest distance between an output pixel and the input pixels read by a stencil.
+	virtual int radius( const SharedContext& context ) const { (void)context; return 0; }
+
+	/// How the outputs vary across pixels, given the most varying input. Outputs only depend on the inputs by default.
+	/// Nodes with uniform outputs that still read varying inputs are evaluated once, at the first pixel of their footprint.
+	virtual Variation variation( Variation inputs ) const { return inputs; }
+
 	virtual ~Node() = default;
 
 	virtual void serialize(json& data) const;
@@ -67,11 +174,13 @@ public:
 
 	virtual uint type() const = 0;
 	virtual uint version() const = 0;
-	virtual bool global() const { return false; }
+	bool global() const { return access() != Access::POINTWISE; }
 	bool channeled() const { return _channeled; }
 
 	void setChannelCount(uint c);
 	uint channelCount() const { return _channelCount; }
+	/// Index of the node in its graph, stable across save and load.
+	uint id() const { return _id; }
 
 	const std::string& name() const { return _name; }
 	const std::string& description() const { return _description; }
@@ -92,6 +201,7 @@ protected:
 	std::vector<PinInfos> _currentOutputs;
 	std::vector<Attribute> _attributes;
 	uint _channelCount = 1;
+	uint _id = 0;
 	bool _channeled = false;
 };
 
@@ -100,6 +210,12 @@ void evaluate(LocalContext& context, const std::vector<int>& inputs, const std::
 uint type() const override; \
 uint version() const override;
 
+#define NODE_DECLARE_RANGES() \
+void evaluateRanges(const std::vector<ValueRange>& inputs, std::vector<ValueRange>& outputs) const override;
+
+#define NODE_DECLARE_FOOTPRINT() \
+Region footprint(const Region& region, const SharedContext& context) const override;
+
 #define NODE_DEFINE_TYPE_AND_VERSION(C, T, V) \
 uint C::type() const { return T; } \
 uint C::version() const { return V; }
@@ -121,6 +121,14 @@ Node* createNode(NodeClass type){
 			return new QuantizeNode();
 		case SAMPLING:
 			return new SampleNode();
+		case PERLIN_NOISE:
+			return new PerlinNoiseNode();
+		case STATISTICS:
+			return new StatisticsNode();
+		case AUTO_LEVELS:
+			return new AutoLevelsNode();
+		case EQUALIZE:
+			return new EqualizeNode();
 		default:
 			assert(false);
 			break;
@@ -136,8 +144,9 @@ const std::string& getNodeName(NodeClass type){
 		"Select", "Equal", "Different", "Not", "Greater", "Less", "Interpolate", "Comment", "Log Color", "Pick Color", "Gradient",
 		"Sine", "Cosine", "Tangent", "Arc Sine", "Arc Cosine", "Arc Tangent", "Dot product", "Filter", "Absolute value",
 		"Fract", "Modulo", "Floor", "Ceiling", "Step", "Smoothstep", "Sign", "Resolution", "Constant Math", "Coordinates",
-		"Length", "Normalize", "Scale & Offset", "Broadcast", "Flood fill", "Median", "Quantize", "Sampling",
-		"Internal", "Backup", "Restore",
+		"Length", "Normalize", "Scale & Offset", "Broadcast", "Flood fill", "Median", "Quantize", "Sampling", "Perlin noise",
+		"Statistics", "Auto levels", "Equalize",
+		"Internal", "Backup", "Restore", "Uniform",
 		"Unknown"
 	};
 	assert(names.size() == NodeClass::COUNT+1);
@@ -150,7 +159,7 @@ NodeClass getOrderedType(uint i){
 		// Inputs outputs
 		INPUT_IMG, OUTPUT_IMG,
 		// Scalars
-		CONST_FLOAT, RANDOM_FLOAT, CONST_MATH, GRADIENT,
+		CONST_FLOAT, RANDOM_FLOAT, CONST_MATH, GRADIENT, PERLIN_NOISE,
 		// Colors
 		CONST_COLOR, RANDOM_COLOR, PICKER,
 		// Math
@@ -164,6 +173,8 @@ NodeClass getOrderedType(uint i){
 		SELECT, EQUAL, DIFFERENT, NOT, GREATER, LESSER,
 		// Global
 		FLIP, TILE, ROTATE, SAMPLING, FLOOD_FILL, GAUSSIAN_BLUR, FILTER, MEDIAN_FILTER, QUANTIZE,
+		// Statistics
+		STATISTICS, AUTO_LEVELS, EQUALIZE,
 		// Helpers
 		BROADCAST, COORDINATES, RESOLUTION, COMMENT, LOG
 	};
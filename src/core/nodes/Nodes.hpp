@@ -63,9 +63,14 @@ enum NodeClass : uint {
 	MEDIAN_FILTER,
 	QUANTIZE,
 	SAMPLING,
+	PERLIN_NOISE,
+	STATISTICS,
+	AUTO_LEVELS,
+	EQUALIZE,
 	COUNT_EXPOSED,
 	INTERNAL_BACKUP,
 	INTERNAL_RESTORE,
+	INTERNAL_UNIFORM,
 	COUNT
 };
 
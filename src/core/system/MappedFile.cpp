@@ -0,0 +1,170 @@
+#include "core/system/MappedFile.hpp"
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	fs::path generateScratchPath(){
+		static std::atomic<uint> counter{0u};
+		std::error_code ec;
+		fs::path dir = fs::temp_directory_path(ec);
+		if(ec){
+			dir = fs::current_path();
+		}
+#ifdef _WIN32
+		const ulong pid = GetCurrentProcessId();
+#else
+		const ulong pid = ulong(getpid());
+#endif
+		return dir / ("packo_scratch_" + std::to_string(pid) + "_" + std::to_string(counter++) + ".bin");
+	}
+
+}
+
+MappedFile::~MappedFile(){
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const fs::path& path, bool copyOnWrite){
+	close();
+	_file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(_file == INVALID_HANDLE_VALUE){
+		_file = nullptr;
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(_file, &fileSize) || fileSize.QuadPart == 0){
+		close();
+		return false;
+	}
+	_mapping = CreateFileMappingW(_file, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+	if(_mapping == nullptr){
+		close();
+		return false;
+	}
+	_data = static_cast<uchar*>(MapViewOfFile(_mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+	if(_data == nullptr){
+		close();
+		return false;
+	}
+	_size = size_t(fileSize.QuadPart);
+	return true;
+}
+
+bool MappedFile::createScratch(size_t size){
+	close();
+	if(size == 0u){
+		return false;
+	}
+	const fs::path path = generateScratchPath();
+	_file = CreateFileW(path.wstring().c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	if(_file == INVALID_HANDLE_VALUE){
+		_file = nullptr;
+		Log::Error() << "Unable to create scratch file at path \"" << path.string() << "\"." << std::endl;
+		return false;
+	}
+	const ULONGLONG size64 = ULONGLONG(size);
+	_mapping = CreateFileMappingW(_file, nullptr, PAGE_READWRITE, DWORD(size64 >> 32u), DWORD(size64 & 0xFFFFFFFFu), nullptr);
+	if(_mapping == nullptr){
+		close();
+		return false;
+	}
+	_data = static_cast<uchar*>(MapViewOfFile(_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+	if(_data == nullptr){
+		close();
+		return false;
+	}
+	_size = size;
+	return true;
+}
+
+void MappedFile::close(){
+	if(_data){
+		UnmapViewOfFile(_data);
+	}
+	if(_mapping){
+		CloseHandle(_mapping);
+	}
+	if(_file){
+		CloseHandle(_file);
+	}
+	_data = nullptr;
+	_mapping = nullptr;
+	_file = nullptr;
+	_size = 0u;
+}
+
+#else
+
+bool MappedFile::open(const fs::path& path, bool copyOnWrite){
+	close();
+	_file = ::open(path.c_str(), O_RDONLY);
+	if(_file < 0){
+		return false;
+	}
+	struct stat infos;
+	if(fstat(_file, &infos) != 0 || infos.st_size == 0){
+		close();
+		return false;
+	}
+	void* data = mmap(nullptr, size_t(infos.st_size), copyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_PRIVATE, _file, 0);
+	if(data == MAP_FAILED){
+		close();
+		return false;
+	}
+	_data = static_cast<uchar*>(data);
+	_size = size_t(infos.st_size);
+	return true;
+}
+
+bool MappedFile::createScratch(size_t size){
+	close();
+	if(size == 0u){
+		return false;
+	}
+	const fs::path path = generateScratchPath();
+	_file = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if(_file < 0){
+		Log::Error() << "Unable to create scratch file at path \"" << path.string() << "\"." << std::endl;
+		return false;
+	}
+	// The file will be removed as soon as it is unmapped and closed.
+	unlink(path.c_str());
+	if(ftruncate(_file, off_t(size)) != 0){
+		close();
+		return false;
+	}
+	void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+	if(data == MAP_FAILED){
+		close();
+		return false;
+	}
+	_data = static_cast<uchar*>(data);
+	_size = size;
+	return true;
+}
+
+void MappedFile::close(){
+	if(_data){
+		munmap(_data, _size);
+	}
+	if(_file >= 0){
+		::close(_file);
+	}
+	_data = nullptr;
+	_file = -1;
+	_size = 0u;
+}
+
+#endif
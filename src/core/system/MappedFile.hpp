@@ -0,0 +1,51 @@
+#pragma once
+
+#include "core/system/System.hpp"
+
+/**
+ \brief Maps a file in memory, either an existing file for reading or an anonymous scratch file that is deleted when unmapped.
+ \ingroup System
+ */
+class MappedFile {
+public:
+
+	MappedFile() = default;
+
+	MappedFile(const MappedFile& ) = delete;
+	MappedFile& operator=(const MappedFile& ) = delete;
+
+	~MappedFile();
+
+	/** Map an existing file, read-only by default.
+	 \param path the file to map
+	 \param copyOnWrite allow modifications of the mapped data, that are never written back to the file
+	 \return true if the file was mapped
+	 */
+	bool open(const fs::path& path, bool copyOnWrite = false);
+
+	/** Create a read-write scratch file of a given size in the temporary directory, and map it.
+	 Pages are loaded and written back by the system on demand.
+	 \param size the size in bytes
+	 \return true if the file was created and mapped
+	 */
+	bool createScratch(size_t size);
+
+	void close();
+
+	uchar* data() { return _data; }
+
+	const uchar* data() const { return _data; }
+
+	size_t size() const { return _size; }
+
+private:
+
+	uchar* _data{nullptr};
+	size_t _size{0u};
+#ifdef _WIN32
+	void* _file{nullptr};
+	void* _mapping{nullptr};
+#else
+	int _file{-1};
+#endif
+};
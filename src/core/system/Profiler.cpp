@@ -0,0 +1,116 @@
+#include "core/system/Profiler.hpp"
+
+#include <json/json.hpp>
+#include <atomic>
+#include <mutex>
+#include <set>
+
+namespace {
+
+	struct Event {
+		std::string name;
+		const char* category;
+		Profiler::Clock::time_point start;
+		Profiler::Clock::time_point end;
+		uint thread;
+		Profiler::Arguments args;
+	};
+
+	std::atomic<bool> recording{false};
+	std::mutex eventsLock;
+	std::vector<Event> events;
+	Profiler::Clock::time_point origin;
+
+	// Worker threads are short-lived, identifiers are recycled to keep a small number of tracks in trace viewers.
+	std::mutex threadIdsLock;
+	std::set<uint> freeThreadIds;
+	uint nextThreadId = 0u;
+
+	struct ThreadId {
+
+		ThreadId(){
+			std::lock_guard<std::mutex> guard(threadIdsLock);
+			if(freeThreadIds.empty()){
+				id = nextThreadId++;
+			} else {
+				id = *freeThreadIds.begin();
+				freeThreadIds.erase(freeThreadIds.begin());
+			}
+		}
+
+		~ThreadId(){
+			std::lock_guard<std::mutex> guard(threadIdsLock);
+			freeThreadIds.insert(id);
+		}
+
+		uint id;
+	};
+
+	uint currentThreadId(){
+		thread_local const ThreadId threadId;
+		return threadId.id;
+	}
+
+}
+
+void Profiler::enable(bool enabled){
+	std::lock_guard<std::mutex> guard(eventsLock);
+	if(enabled && !recording){
+		events.clear();
+		origin = Clock::now();
+	}
+	recording = enabled;
+}
+
+bool Profiler::enabled(){
+	return recording;
+}
+
+void Profiler::addEvent(const std::string& name, const char* category, const Clock::time_point& start, const Clock::time_point& end, const Arguments& args){
+	if(!recording){
+		return;
+	}
+	const uint thread = currentThreadId();
+	std::lock_guard<std::mutex> guard(eventsLock);
+	events.push_back({name, category, start, end, thread, args});
+}
+
+bool Profiler::save(const fs::path& path){
+	json trace;
+	trace["displayTimeUnit"] = "ms";
+	json& traceEvents = trace["traceEvents"];
+	traceEvents = json::array();
+	{
+		std::lock_guard<std::mutex> guard(eventsLock);
+		for(const Event& event : events){
+			json& entry = traceEvents.emplace_back();
+			entry["name"] = event.name;
+			entry["cat"] = event.category;
+			entry["ph"] = "X";
+			entry["ts"] = std::chrono::duration<double, std::micro>(event.start - origin).count();
+			entry["dur"] = std::chrono::duration<double, std::micro>(event.end - event.start).count();
+			entry["pid"] = 0;
+			entry["tid"] = event.thread;
+			if(!event.args.empty()){
+				json& args = entry["args"];
+				for(const auto& arg : event.args){
+					args[arg.first] = arg.second;
+				}
+			}
+		}
+	}
+	return System::writeStringToFile(trace.dump(), path);
+}
+
+Profiler::Scope::Scope(const char* name, const char* category) : _category(category), _active(recording) {
+	if(_active){
+		_name = name;
+		_start = Clock::now();
+	}
+}
+
+Profiler::Scope::~Scope(){
+	if(_active){
+		addEvent(_name, _category, _start, Clock::now());
+	}
+}
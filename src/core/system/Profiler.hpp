@@ -0,0 +1,66 @@
+#pragma once
+
+#include "core/system/System.hpp"
+
+#include <chrono>
+
+/**
+ \brief Records timed events from any thread, and exports them in the Chrome trace format (readable by chrome://tracing and Perfetto).
+ Recording is disabled by default, and is then a no-op.
+ \ingroup System
+ */
+class Profiler {
+public:
+
+	using Clock = std::chrono::steady_clock;
+	using Arguments = std::vector<std::pair<std::string, double>>;
+
+	/** Start or stop recording events. Enabling clears previously recorded events.
+	 \param enabled the new recording state
+	 */
+	static void enable(bool enabled);
+
+	static bool enabled();
+
+	/** Record an event on the current thread.
+	 \param name the event name
+	 \param category the event category, used for filtering
+	 \param start the event start time
+	 \param end the event end time
+	 \param args additional values displayed with the event
+	 */
+	static void addEvent(const std::string& name, const char* category, const Clock::time_point& start, const Clock::time_point& end, const Arguments& args = {});
+
+	/** Write all recorded events to a JSON trace file.
+	 \param path the destination file
+	 \return true if the file was written
+	 */
+	static bool save(const fs::path& path);
+
+	/** Record an event covering the lifetime of the object, if recording is enabled at creation. */
+	class Scope {
+	public:
+
+		Scope(const char* name, const char* category);
+
+		/** The name is built by calling makeName, only if recording is enabled. */
+		template<typename NameFunc>
+		Scope(const NameFunc& makeName, const char* category) : _category(category), _active(enabled()) {
+			if(_active){
+				_name = makeName();
+				_start = Clock::now();
+			}
+		}
+
+		Scope(const Scope& ) = delete;
+		Scope& operator=(const Scope& ) = delete;
+
+		~Scope();
+
+	private:
+		std::string _name;
+		const char* _category;
+		Clock::time_point _start;
+		bool _active;
+	};
+};
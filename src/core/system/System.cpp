@@ -6,12 +6,19 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#include <psapi.h>
 #include <stdio.h>
 #include <io.h>
 #else
 #include <unistd.h>
+#include <sys/resource.h>
 #endif
 #include <iomanip>
+#include <atomic>
+
+namespace {
+	std::atomic<uint> customThreadCount{0u};
+}
 
 void System::ping() {
 	Log::Info() << '\a' << std::endl;
@@ -67,3 +74,37 @@ std::string System::timestamp(){
 	str << std::put_time(&ltime, "%Y_%m_%d_%H_%M_%S");
 	return str.str();
 }
+
+void System::setThreadCount(uint count){
+	customThreadCount = count;
+}
+
+uint System::threadCount(){
+	const uint count = customThreadCount;
+	if(count != 0u){
+		return count;
+	}
+	// Always leave one thread free.
+	return uint(std::max(int(std::thread::hardware_concurrency()) - 1, 1));
+}
+
+size_t System::peakMemoryUsage(){
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))){
+		return 0u;
+	}
+	return size_t(counters.PeakWorkingSetSize);
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0){
+		return 0u;
+	}
+#ifdef __APPLE__
+	return size_t(usage.ru_maxrss);
+#else
+	// Reported in kilobytes.
+	return size_t(usage.ru_maxrss) * 1024u;
+#endif
+#endif
+}
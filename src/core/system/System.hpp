@@ -28,6 +28,41 @@ public:
 
 	static std::string timestamp();
 
+	/** Set the number of threads used by forParallel.
+	 \param count the thread count, or 0 to use all cores but one
+	 */
+	static void setThreadCount(uint count);
+
+	static uint threadCount();
+
+	/** \return the peak resident memory of the process, in bytes */
+	static size_t peakMemoryUsage();
+
+	/** \return the number of threads parallel loops started on the current thread can use */
+	static uint availableThreadCount(){
+		const uint budget = threadBudget();
+		return budget != 0u ? std::min(budget, threadCount()) : threadCount();
+	}
+
+	/** While alive, parallel loops started on the current thread use at most a given number of threads, and their
+	 workers run nested loops on their own thread. Used by tasks that are already spread across threads.
+	 */
+	class ThreadBudgetScope {
+	public:
+		explicit ThreadBudgetScope(uint budget) : _previous(threadBudget()) { threadBudget() = budget; }
+		~ThreadBudgetScope() { threadBudget() = _previous; }
+		ThreadBudgetScope(const ThreadBudgetScope& ) = delete;
+		ThreadBudgetScope& operator=(const ThreadBudgetScope& ) = delete;
+	private:
+		uint _previous;
+	};
+
+	/** While alive, parallel loops started on the current thread run on it. */
+	class SerialScope : public ThreadBudgetScope {
+	public:
+		SerialScope() : ThreadBudgetScope(1u) {}
+	};
+
 	template<typename ThreadFunc>
 	static void forParallel(size_t low, size_t high, ThreadFunc func) {
 		// Make sure the loop is increasing.
@@ -36,16 +71,25 @@ public:
 			low				  = high;
 			high			  = temp;
 		}
+		// Don't spawn more threads than iterations or than the budget, and run on the calling thread if it is serial.
+		const uint budget = threadBudget();
+		const size_t count = std::min(size_t(availableThreadCount()), high - low);
+		if(count <= 1u){
+			for(size_t i = low; i < high; ++i) {
+				func(i);
+			}
+			return;
+		}
 		// Prepare the threads pool.
-		// Always leave one thread free.
-		const size_t count = size_t(std::max(int(std::thread::hardware_concurrency())-1, 1));
 		std::vector<std::thread> threads;
 		threads.reserve(count);
 
 		// Compute the span of each thread.
 		const size_t span = std::max(size_t(1), (high - low) / count);
 		// Helper to execute the function passed on a subset of the total interval.
-		auto launchThread = [&func](size_t a, size_t b) {
+		auto launchThread = [&func, budget](size_t a, size_t b) {
+			// Workers of a loop with a budget don't spawn more threads.
+			ThreadBudgetScope scope(budget != 0u ? 1u : 0u);
 			for(size_t i = a; i < b; ++i) {
 				func(i);
 			}
@@ -53,11 +97,19 @@ public:
 
 		for(size_t tid = 0; tid < count; ++tid) {
 			// For each thread, call the same lambda with different bounds as arguments.
-			const size_t threadLow  = tid * span;
-			const size_t threadHigh = tid == (count-1) ? high : ((tid + 1) * span);
+			const size_t threadLow  = std::min(low + tid * span, high);
+			const size_t threadHigh = tid == (count-1) ? high : std::min(low + (tid + 1) * span, high);
 			threads.emplace_back(launchThread, threadLow, threadHigh);
 		}
 		// Wait for all threads to finish.
 		std::for_each(threads.begin(), threads.end(), [](std::thread & x) { x.join(); });
 	}
+
+private:
+
+	// Maximum number of threads used by parallel loops started on the current thread, unlimited if zero.
+	static uint& threadBudget(){
+		static thread_local uint budget = 0u;
+		return budget;
+	}
 };
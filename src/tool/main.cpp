@@ -6,10 +6,12 @@
 
 #include "core/system/Config.hpp"
 #include "core/system/System.hpp"
+#include "core/system/Profiler.hpp"
 #include "core/system/TextUtilities.hpp"
 #include "core/system/Terminal.hpp"
 
 #include <json/json.hpp>
+#include <unordered_map>
 
 class PackoConfig : public Config {
 public:
@@ -28,15 +30,57 @@ public:
 			if((arg.key == "graph" || arg.key == "g") && !arg.values.empty()){
 				graphPath = arg.values[0];
 			}
+			if(arg.key == "export" && !arg.values.empty()){
+				exportPath = arg.values[0];
+			}
 			
 			if((arg.key == "resolution" || arg.key == "r") && arg.values.size() > 1){
 				outResolution[0] = std::stoi(arg.values[0]);
 				outResolution[1] = std::stoi(arg.values[1]);
 				forceOutResolution = true;
 			}
+			if(arg.key == "region" && arg.values.size() > 3){
+				const glm::ivec2 origin(std::stoi(arg.values[0]), std::stoi(arg.values[1]));
+				const glm::ivec2 size(std::stoi(arg.values[2]), std::stoi(arg.values[3]));
+				region = Region(origin, origin + size);
+			}
+			if(arg.key == "filter" && !arg.values.empty()){
+				static const std::unordered_map<std::string, Image::Filter> filters = {
+					{"nearest", Image::Filter::NEAREST}, {"smooth", Image::Filter::SMOOTH}, {"box", Image::Filter::BOX},
+					{"bilinear", Image::Filter::BILINEAR}, {"mitchell", Image::Filter::MITCHELL}, {"lanczos", Image::Filter::LANCZOS},
+				};
+				const auto filter = filters.find(TextUtilities::lowercase(arg.values[0]));
+				if(filter != filters.end()){
+					filterResolution = filter->second;
+				}
+			}
 			if((arg.key == "seed" || arg.key == "s") && !arg.values.empty()){
 				seed = std::stoi(arg.values[0]);
 			}
+			if(arg.key == "precise"){
+				precise = true;
+			}
+			if(arg.key == "compression" && !arg.values.empty()){
+				compressionLevel = glm::clamp(std::stoi(arg.values[0]), 0, 9);
+			}
+			if(arg.key == "memory-budget" && !arg.values.empty()){
+				memoryBudget = size_t(std::stoull(arg.values[0])) * 1024u * 1024u;
+			}
+			if(arg.key == "legacy-random"){
+				legacyRandom = true;
+			}
+			if(arg.key == "tiled"){
+				tileSize = arg.values.empty() ? EvaluationSettings::kDefaultTileSize : uint(std::max(1, std::stoi(arg.values[0])));
+			}
+			if(arg.key == "pack" && !arg.values.empty()){
+				packedPixelCount = uint(std::max(0, std::stoi(arg.values[0])));
+			}
+			if(arg.key == "profile" && !arg.values.empty()){
+				profilePath = arg.values[0];
+			}
+			if(arg.key == "stats" && !arg.values.empty()){
+				statsPath = arg.values[0];
+			}
 
 			if(arg.key == "version" || arg.key == "v") {
 				version = true;
@@ -51,11 +95,22 @@ public:
 
 		registerArgument("in", "i", "Input directory containing images to process.", "path to directory");
 		registerArgument("out", "o", "Destination directory.", "path to directory");
-		registerArgument("graph", "g", "Graph file.", "path to file");
+		registerArgument("graph", "g", "Graph file, in JSON, CBOR or MessagePack.", "path to file");
+		registerArgument("export", "", "Save the graph in CBOR or MessagePack if the extension is .cbor or .msgpack, in JSON otherwise.", "path to file");
 
 		registerSection("Settings");
 		registerArgument("resolution", "r", "Force the output resolution.", std::vector<std::string>{"w", "h"});
+		registerArgument("region", "", "Only evaluate a region of the outputs, saved as cropped images.", std::vector<std::string>{"x", "y", "w", "h"});
+		registerArgument("filter", "", "Filter used to resize inputs: nearest, smooth, box, bilinear, mitchell or lanczos.", "name");
 		registerArgument("seed", "s", "Integer seed for random number generation.", "seed");
+		registerArgument("precise", "", "Store all intermediate and output images at full float precision.");
+		registerArgument("compression", "", "PNG compression level, from 0 (fastest) to 9 (smallest).", "level");
+		registerArgument("memory-budget", "", "Maximum size of images kept in memory, others are paged from scratch files.", "MB");
+		registerArgument("legacy-random", "", "Use the previous random generators, whose results depend on the thread count.");
+		registerArgument("tiled", "", "Evaluate tile by tile, only computing the tiles each output tile depends on (default size: " + std::to_string(EvaluationSettings::kDefaultTileSize) + ").", "size");
+		registerArgument("pack", "", "Evaluate together consecutive images of the same resolution below this pixel count, 0 to disable (default: " + std::to_string(EvaluationSettings::kDefaultPackedPixelCount) + ").", "pixels");
+		registerArgument("profile", "", "Record timings and save them as a Chrome trace, viewable in chrome://tracing or Perfetto.", "path to file");
+		registerArgument("stats", "", "Save a JSON summary of the run: timings, throughput, memory and graph statistics.", "path to file");
 
 		registerSection("Infos");
 		registerArgument("version", "v", "Displays the current Packo version.");
@@ -66,9 +121,20 @@ public:
 	fs::path inputDir;
 	fs::path outputDir;
 	fs::path graphPath;
+	fs::path exportPath;
 	glm::ivec2 outResolution{64, 64};
 	bool forceOutResolution = false;
+	Region region;
+	Image::Filter filterResolution = Image::Filter::SMOOTH;
 	int seed = 743936;
+	bool precise = false;
+	size_t memoryBudget = 0u;
+	bool legacyRandom = false;
+	uint tileSize = 0u;
+	uint packedPixelCount = EvaluationSettings::kDefaultPackedPixelCount;
+	fs::path profilePath;
+	fs::path statsPath;
+	int compressionLevel = PNGWriter::kDefaultCompressionLevel;
 
 	// Messages.
 	bool version = false;
@@ -77,7 +143,7 @@ public:
 };
 
 std::vector<fs::path> listFiles(const fs::path& dir){
-	static const std::vector<std::string> validExts = {"png", "bmp", "tga", "jpeg", "exr"};
+	static const std::vector<std::string> validExts = {"png", "bmp", "tga", "jpeg", "exr", "raw"};
 	if(!fs::exists(dir)){
 		return {};
 	}
@@ -111,7 +177,7 @@ int main(int argc, char** argv){
 	} else if(config.showHelp(false)){
 		return 0;
 	}
-	if(config.graphPath.empty() || config.outputDir.empty()){
+	if(config.graphPath.empty() || (config.outputDir.empty() && config.exportPath.empty())){
 		config.showHelp(true);
 		return 0;
 	}
@@ -122,18 +188,9 @@ int main(int argc, char** argv){
 	Graph graph;
 	{
 		const std::string path = config.graphPath.string();
-		std::ifstream file(path);
-		if(!file.is_open()){
-			Log::Error() << "Unable to load graph from file at path \"" << path<< "\"" << std::endl;
-			return 1;
-		}
-
-		json data = json::parse(file, nullptr, false);
-		// Done with the file.
-		file.close();
-		// Invalid JSON.
-		if(data.is_discarded()){
-			Log::Error() << "Unable to parse graph from file at path \"" << path << "\"" << std::endl;
+		json data;
+		if(!Graph::load(config.graphPath, data)){
+			Log::Error() << "Unable to load graph from file at path \"" << path << "\"" << std::endl;
 			return 1;
 		}
 		if(!graph.deserialize(data)){
@@ -142,6 +199,18 @@ int main(int argc, char** argv){
 		}
 	}
 
+	if(!config.exportPath.empty()){
+		json data;
+		graph.serialize(data);
+		if(!Graph::save(config.exportPath, data, Graph::encodingForPath(config.exportPath))){
+			Log::Error() << "Unable to export graph to file at path \"" << config.exportPath.string() << "\"" << std::endl;
+			return 1;
+		}
+		if(config.outputDir.empty()){
+			return 0;
+		}
+	}
+
 	// List input files
 	std::vector<fs::path> inputPaths;
 	if(!config.inputDir.empty()){
@@ -154,8 +223,29 @@ int main(int argc, char** argv){
 
 	// Evaluate
 	ErrorContext errorContext;
-	bool res = evaluate(graph, errorContext, inputPaths, config.outputDir, config.outResolution, config.forceOutResolution);
-	if(!res || errorContext.hasErrors()){
+	EvaluationSettings settings;
+	settings.outputRes = config.outResolution;
+	settings.forceOutputRes = config.forceOutResolution;
+	settings.region = config.region;
+	settings.filterOutputRes = config.filterResolution;
+	settings.precise = config.precise;
+	settings.memoryBudget = config.memoryBudget;
+	settings.compressionLevel = config.compressionLevel;
+	settings.legacyRandom = config.legacyRandom;
+	settings.tileSize = config.tileSize;
+	settings.packedPixelCount = config.packedPixelCount;
+	Profiler::enable(!config.profilePath.empty());
+	const EvaluationReport report = evaluate(graph, errorContext, inputPaths, config.outputDir, settings);
+	if(Profiler::enabled()){
+		Profiler::enable(false);
+		Profiler::save(config.profilePath);
+	}
+	if(!config.statsPath.empty()){
+		json stats;
+		report.serialize(stats);
+		System::writeStringToFile(stats.dump(4), config.statsPath);
+	}
+	if(!report || errorContext.hasErrors()){
 		Log::Error() << "Encountered an error while executing the graph." << std::endl;
 		Log::Error() << errorContext.summarizeErrors() << std::endl;
 		return 1;